@@ -0,0 +1,12 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef BENCH_MOCK_TLS_H
+#define BENCH_MOCK_TLS_H 1
+
+#include <openssl/ssl.h>
+
+// Server context for the mock servers: a throwaway P-256 key and a certificate for localhost signed with it, made at
+// startup. The library doesn't verify certificates so nothing has to trust it. NULL if openssl failed
+SSL_CTX* CreateSelfSignedContext(void);
+
+#endif //BENCH_MOCK_TLS_H
@@ -0,0 +1,24 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef BENCH_PAYLOADS_H
+#define BENCH_PAYLOADS_H 1
+
+#include <stddef.h>
+
+// Gateway payloads for the benchmarks, either one per line from a recorded .jsonl file or a synthetic mix of
+// MESSAGE_CREATE/PRESENCE_UPDATE/TYPING_START dispatches plus one big GUILD_CREATE
+
+typedef struct Payload {
+    char* data;
+    size_t length;
+} Payload;
+
+extern Payload* g_payloads;
+extern size_t g_payload_count;
+
+// path == NULL or "-" generates the synthetic set. Returns nonzero if the file couldn't be read
+int LoadOrGeneratePayloads(const char* path);
+
+double CpuSeconds(void);
+
+#endif //BENCH_PAYLOADS_H
@@ -0,0 +1,123 @@
+// Copyright 2025 JesusTouchMe
+
+// Compares what a gateway connection costs with and without compress=zlib-stream.
+// usage: gateway_compression_bench [payloads.jsonl] [event count]
+// without a payload file it uses synthetic MESSAGE_CREATE/PRESENCE_UPDATE/TYPING_START/GUILD_CREATE dispatches
+
+#include "payloads.h"
+
+#include "internal/memory.h"
+
+#include "utils/jsonutils.h"
+#include "utils/zlibstream.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static jsmntok_t* g_tokens = NULL;
+static int g_token_capacity = 0;
+
+// same two pass tokenize that HandleGatewayEvent does
+static int Tokenize(const char* json, size_t length) {
+    jsmn_parser parser;
+    jsmn_init(&parser);
+
+    int count = jsmn_parse(&parser, json, length, NULL, 0);
+    if (count <= 0) return -1;
+
+    if (count > g_token_capacity) {
+        g_token_capacity = count;
+        g_tokens = HeapRealloc(g_tokens, count * sizeof(jsmntok_t));
+    }
+
+    jsmn_init(&parser);
+    return jsmn_parse(&parser, json, length, g_tokens, count);
+}
+
+int main(int argc, char** argv) {
+    if (LoadOrGeneratePayloads(argc > 1 ? argv[1] : NULL) != 0) {
+        printf("couldn't load payloads from %s\n", argv[1]);
+        return 1;
+    }
+
+    size_t event_count = argc > 2 ? strtoull(argv[2], NULL, 10) : 5000;
+
+    // the server side of zlib-stream: one deflate context for the whole connection, sync flush after every message
+    z_stream deflater = {0};
+    deflateInit(&deflater, Z_DEFAULT_COMPRESSION);
+
+    Payload* compressed = HeapAlloc(event_count * sizeof(Payload));
+
+    uint64_t plain_bytes = 0;
+    uint64_t compressed_bytes = 0;
+
+    for (size_t i = 0; i < event_count; i++) {
+        const Payload* payload = &g_payloads[i % g_payload_count];
+        plain_bytes += payload->length;
+
+        size_t bound = deflateBound(&deflater, payload->length) + 16;
+        unsigned char* out = HeapAlloc(bound);
+
+        deflater.next_in = (Bytef*) payload->data;
+        deflater.avail_in = (uInt) payload->length;
+        deflater.next_out = out;
+        deflater.avail_out = (uInt) bound;
+        deflate(&deflater, Z_SYNC_FLUSH);
+
+        size_t length = bound - deflater.avail_out;
+        compressed[i].data = HeapRealloc(out, length);
+        compressed[i].length = length;
+        compressed_bytes += compressed[i].length;
+    }
+
+    deflateEnd(&deflater);
+
+    // warm up the token buffer so neither side pays for growing it
+    for (size_t i = 0; i < g_payload_count; i++) Tokenize(g_payloads[i].data, g_payloads[i].length);
+
+    double start = CpuSeconds();
+    for (size_t i = 0; i < event_count; i++) {
+        const Payload* payload = &g_payloads[i % g_payload_count];
+        if (Tokenize(payload->data, payload->length) < 0) {
+            printf("tokenize failed on plain payload %zu\n", i);
+            return 1;
+        }
+    }
+    double plain_cpu = CpuSeconds() - start;
+
+    ZlibStream inflater;
+    ZlibStream_Init(&inflater);
+
+    start = CpuSeconds();
+    for (size_t i = 0; i < event_count; i++) {
+        char* json;
+        size_t length;
+        if (ZlibStream_Feed(&inflater, compressed[i].data, compressed[i].length, &json, &length) != 1) {
+            printf("inflate failed on payload %zu\n", i);
+            return 1;
+        }
+
+        if (Tokenize(json, length) < 0) {
+            printf("tokenize failed on inflated payload %zu\n", i);
+            return 1;
+        }
+    }
+    double compressed_cpu = CpuSeconds() - start;
+
+    ZlibStream_Destroy(&inflater);
+
+    printf("events:                %zu (%zu distinct payloads)\n", event_count, g_payload_count);
+    printf("json:                  %" PRIu64 " bytes received, %.1f bytes/event, %.3f us cpu/event\n",
+           plain_bytes, (double) plain_bytes / event_count, plain_cpu * 1e6 / event_count);
+    printf("json + zlib-stream:    %" PRIu64 " bytes received, %.1f bytes/event, %.3f us cpu/event\n",
+           compressed_bytes, (double) compressed_bytes / event_count, compressed_cpu * 1e6 / event_count);
+    printf("compression ratio:     %.2fx fewer bytes, %.2fx the cpu\n",
+           (double) plain_bytes / compressed_bytes, compressed_cpu / plain_cpu);
+
+    for (size_t i = 0; i < event_count; i++) HeapFree(compressed[i].data);
+    HeapFree(compressed);
+
+    return 0;
+}
@@ -0,0 +1,686 @@
+// Copyright 2025 JesusTouchMe
+
+// Stand-in for the Discord gateway that streams dispatches as fast as it's told to, for finding how many events per
+// second the library keeps up with. Point a bot at it with Discord_SetGatewayHost (GetGatewayHost/GetGatewayPort in
+// the launchwrapper) and a shard count, then no REST server is needed either.
+// usage: gateway_firehose [port] [start rate/s] [rate step/s] [step seconds] [heartbeat ms] [mix] [content bytes]
+// defaults: 8444 1000 1000 3 1000 90:9:1 64
+// mix is the MESSAGE_CREATE:PRESENCE_UPDATE:GUILD_CREATE weights, the GUILD_CREATEs are about 60 KB each.
+// Every connection gets HELLO, READY after IDENTIFY (RESUMED after RESUME) and then a ramp: the rate goes up by a step
+// until a step fails. A step fails if a heartbeat comes more than HEARTBEAT_SLACK_MS late, if the connection drops
+// (the client gave up on an ACK stuck behind the flood) or if less than 95% of the step's events got out, which means
+// the client stopped reading and tcp pushed back. The last step that didn't fail is the capacity.
+// encoding=json only, compress=zlib-stream is supported
+
+#define _GNU_SOURCE // memmem, strcasestr
+
+#include "mock_tls.h"
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HEARTBEAT_SLACK_MS 100
+#define MIN_SENT_RATIO 0.95
+#define MAX_BATCH_BYTES (256 * 1024) // per write, so heartbeats get read between batches
+#define MAX_CLIENT_FRAME 65536
+#define GUILD_MEMBER_COUNT 300
+#define GUILD_CHANNEL_COUNT 60
+#define CHANNEL_SPREAD 64 // MESSAGE_CREATEs go to this many channels, for EVENT_DISPATCH_BY_CHANNEL
+
+typedef enum EventKind {
+    EVENT_MESSAGE_CREATE = 0,
+    EVENT_PRESENCE_UPDATE,
+    EVENT_GUILD_CREATE,
+    EVENT_KIND_COUNT,
+} EventKind;
+
+typedef struct Buffer {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+typedef struct Step {
+    double target; // events/s
+    uint64_t start_us;
+    uint64_t sent;
+    uint64_t bytes;
+    uint64_t blocked_us; // waiting for the client to make room in the socket
+    int heartbeats;
+    uint64_t worst_gap_us;
+} Step;
+
+typedef struct Connection {
+    int sock;
+    SSL* ssl;
+    int id;
+    unsigned int seed;
+    bool compress;
+    z_stream deflater;
+
+    Buffer in;
+    Buffer out;
+    Buffer text; // the payload being built
+    Buffer deflated;
+
+    uint64_t seq;
+    uint64_t snowflake;
+    uint64_t last_heartbeat_us; // 0 before the first
+    bool identified;
+    bool closed;
+
+    bool ramping;
+    Step step;
+    double best; // highest rate that held, 0 if none did
+    double best_mbps;
+} Connection;
+
+static int g_port = 8444;
+static double g_start_rate = 1000;
+static double g_rate_step = 1000;
+static int g_step_seconds = 3;
+static int g_heartbeat_ms = 1000;
+static int g_weights[EVENT_KIND_COUNT] = {90, 9, 1};
+static int g_weight_total = 100;
+static int g_content_bytes = 64;
+
+static SSL_CTX* g_ssl_ctx = NULL;
+static char* g_content = NULL;
+static char* g_guild_body = NULL; // the d of a GUILD_CREATE, same for every one
+static size_t g_guild_body_length = 0;
+static atomic_int g_next_connection_id = 0;
+
+static uint64_t NowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+static void Reserve(Buffer* buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) return;
+
+    size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+    while (capacity < buffer->length + extra) capacity *= 2;
+
+    buffer->data = realloc(buffer->data, capacity);
+    buffer->capacity = capacity;
+}
+
+static void Append(Buffer* buffer, const void* data, size_t length) {
+    Reserve(buffer, length);
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+static void AppendFormat(Buffer* buffer, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void AppendFormat(Buffer* buffer, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list copy;
+    va_copy(copy, args);
+
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+
+    Reserve(buffer, (size_t) length + 1);
+    vsnprintf((char*) buffer->data + buffer->length, (size_t) length + 1, format, args);
+    buffer->length += (size_t) length;
+    va_end(args);
+}
+
+static void BuildGuildBody(void) {
+    Buffer body = {0};
+
+    AppendFormat(&body, "{\"id\":\"1100000000000000000\",\"name\":\"firehose\",\"owner_id\":\"42\",\"member_count\":%d,"
+                        "\"large\":false,\"unavailable\":false,\"roles\":[],\"emojis\":[],\"features\":[],\"channels\":[",
+                 GUILD_MEMBER_COUNT);
+
+    for (int i = 0; i < GUILD_CHANNEL_COUNT; i++) {
+        AppendFormat(&body, "%s{\"id\":\"%" PRIu64 "\",\"type\":0,\"name\":\"channel-%d\",\"position\":%d,\"topic\":null,"
+                            "\"nsfw\":false,\"rate_limit_per_user\":0,\"permission_overwrites\":[]}",
+                     i > 0 ? "," : "", UINT64_C(1200000000000000000) + (uint64_t) i, i, i);
+    }
+
+    Append(&body, "],\"members\":[", 13);
+
+    for (int i = 0; i < GUILD_MEMBER_COUNT; i++) {
+        AppendFormat(&body, "%s{\"user\":{\"id\":\"%" PRIu64 "\",\"username\":\"member%d\",\"global_name\":\"Member %d\","
+                            "\"avatar\":\"a_0123456789abcdef0123456789abcdef\",\"discriminator\":\"0\"},"
+                            "\"roles\":[],\"joined_at\":\"2024-01-01T00:00:00.000000+00:00\",\"deaf\":false,\"mute\":false}",
+                     i > 0 ? "," : "", UINT64_C(1400000000000000000) + (uint64_t) i, i, i);
+    }
+
+    Append(&body, "]}", 2);
+
+    g_guild_body = (char*) body.data;
+    g_guild_body_length = body.length;
+}
+
+// server frames aren't masked
+static void AppendFrame(Buffer* out, int opcode, const void* payload, size_t length) {
+    unsigned char header[10];
+    size_t header_length;
+
+    header[0] = (unsigned char) (0x80 | opcode);
+    if (length < 126) {
+        header[1] = (unsigned char) length;
+        header_length = 2;
+    } else if (length <= 0xFFFF) {
+        header[1] = 126;
+        header[2] = (unsigned char) (length >> 8);
+        header[3] = (unsigned char) length;
+        header_length = 4;
+    } else {
+        header[1] = 127;
+        for (int i = 0; i < 8; i++) header[2 + i] = (unsigned char) ((uint64_t) length >> (56 - 8 * i));
+        header_length = 10;
+    }
+
+    Append(out, header, header_length);
+    Append(out, payload, length);
+}
+
+// zlib-stream is one deflate stream for the whole connection with a sync flush after every message
+static void QueueMessage(Connection* conn, const void* payload, size_t length) {
+    if (!conn->compress) {
+        AppendFrame(&conn->out, 1, payload, length);
+        return;
+    }
+
+    Buffer* deflated = &conn->deflated;
+    deflated->length = 0;
+    Reserve(deflated, deflateBound(&conn->deflater, length) + 16);
+
+    conn->deflater.next_in = (Bytef*) payload;
+    conn->deflater.avail_in = (uInt) length;
+    conn->deflater.next_out = deflated->data;
+    conn->deflater.avail_out = (uInt) deflated->capacity;
+    deflate(&conn->deflater, Z_SYNC_FLUSH);
+
+    AppendFrame(&conn->out, 2, deflated->data, deflated->capacity - conn->deflater.avail_out);
+}
+
+static void QueueText(Connection* conn, const char* text) {
+    QueueMessage(conn, text, strlen(text));
+}
+
+static EventKind PickKind(Connection* conn) {
+    int roll = (int) (rand_r(&conn->seed) % (unsigned int) g_weight_total);
+    for (int i = 0; i < EVENT_KIND_COUNT; i++) {
+        if (roll < g_weights[i]) return (EventKind) i;
+        roll -= g_weights[i];
+    }
+
+    return EVENT_MESSAGE_CREATE;
+}
+
+static size_t QueueEvent(Connection* conn) {
+    Buffer* payload = &conn->text;
+    payload->length = 0;
+
+    uint64_t seq = ++conn->seq;
+    uint64_t id = conn->snowflake++;
+
+    switch (PickKind(conn)) {
+        case EVENT_MESSAGE_CREATE:
+            AppendFormat(payload, "{\"op\":0,\"s\":%" PRIu64 ",\"t\":\"MESSAGE_CREATE\",\"d\":{\"id\":\"%" PRIu64 "\",\"type\":0,"
+                                  "\"channel_id\":\"%" PRIu64 "\",\"guild_id\":\"1100000000000000000\",\"content\":\"%s\","
+                                  "\"timestamp\":\"2025-01-01T00:00:00.000000+00:00\",\"edited_timestamp\":null,\"tts\":false,"
+                                  "\"mention_everyone\":false,\"mentions\":[],\"mention_roles\":[],\"attachments\":[],\"embeds\":[],"
+                                  "\"pinned\":false,\"author\":{\"id\":\"%" PRIu64 "\",\"username\":\"member\",\"discriminator\":\"0\"},"
+                                  "\"member\":{\"roles\":[],\"joined_at\":\"2024-01-01T00:00:00.000000+00:00\",\"deaf\":false,\"mute\":false}}}",
+                         seq, id, UINT64_C(1200000000000000000) + id % CHANNEL_SPREAD, g_content, UINT64_C(1400000000000000000) + id % GUILD_MEMBER_COUNT);
+            break;
+
+        case EVENT_PRESENCE_UPDATE:
+            AppendFormat(payload, "{\"op\":0,\"s\":%" PRIu64 ",\"t\":\"PRESENCE_UPDATE\",\"d\":{\"user\":{\"id\":\"%" PRIu64 "\"},"
+                                  "\"guild_id\":\"1100000000000000000\",\"status\":\"online\",\"activities\":[{\"name\":\"firehose\",\"type\":0,"
+                                  "\"created_at\":1735689600000}],\"client_status\":{\"desktop\":\"online\"}}}",
+                         seq, UINT64_C(1400000000000000000) + id % GUILD_MEMBER_COUNT);
+            break;
+
+        case EVENT_GUILD_CREATE:
+            AppendFormat(payload, "{\"op\":0,\"s\":%" PRIu64 ",\"t\":\"GUILD_CREATE\",\"d\":", seq);
+            Append(payload, g_guild_body, g_guild_body_length);
+            Append(payload, "}", 1);
+            break;
+
+        default:
+            break;
+    }
+
+    size_t before = conn->out.length;
+    QueueMessage(conn, payload->data, payload->length);
+    return conn->out.length - before;
+}
+
+static int WaitSocket(Connection* conn, short events, int timeout_ms) {
+    struct pollfd pfd = {conn->sock, events, 0};
+    return poll(&pfd, 1, timeout_ms);
+}
+
+// Writes all of out. The socket is non-blocking so the time spent waiting for room is known
+static int Flush(Connection* conn) {
+    size_t offset = 0;
+
+    while (offset < conn->out.length) {
+        size_t chunk = conn->out.length - offset;
+        int w = SSL_write(conn->ssl, conn->out.data + offset, chunk > INT32_MAX ? INT32_MAX : (int) chunk);
+        if (w > 0) {
+            offset += (size_t) w;
+            continue;
+        }
+
+        int error = SSL_get_error(conn->ssl, w);
+        if (error != SSL_ERROR_WANT_WRITE && error != SSL_ERROR_WANT_READ) return -1;
+
+        uint64_t wait_start = NowUs();
+        WaitSocket(conn, error == SSL_ERROR_WANT_WRITE ? POLLOUT : POLLIN, 100);
+        if (conn->ramping) conn->step.blocked_us += NowUs() - wait_start;
+    }
+
+    conn->out.length = 0;
+    return 0;
+}
+
+static void StartStep(Connection* conn, double target) {
+    conn->ramping = true;
+    memset(&conn->step, 0, sizeof(Step));
+    conn->step.target = target;
+    conn->step.start_us = NowUs();
+}
+
+static void PrintReport(Connection* conn, const char* reason) {
+    if (conn->best > 0) {
+        printf("[conn %d] capacity: %.0f events/s (%.1f MB/s), next step failed: %s\n", conn->id, conn->best, conn->best_mbps, reason);
+    } else {
+        printf("[conn %d] capacity: below %.0f events/s, the first step failed: %s\n", conn->id, conn->step.target, reason);
+    }
+
+    fflush(stdout);
+}
+
+// ends the step, true if it held
+static bool FinishStep(Connection* conn, uint64_t now) {
+    Step* step = &conn->step;
+    double seconds = (double) (now - step->start_us) / 1e6;
+    double sent_rate = (double) step->sent / seconds;
+    double mbps = (double) step->bytes / seconds / 1e6;
+
+    // the client is quiet past its deadline right now, that counts even if the heartbeat never arrives
+    uint64_t since_heartbeat = conn->last_heartbeat_us != 0 ? now - conn->last_heartbeat_us : 0;
+    if (since_heartbeat > step->worst_gap_us) step->worst_gap_us = since_heartbeat;
+
+    uint64_t deadline = (uint64_t) (g_heartbeat_ms + HEARTBEAT_SLACK_MS) * 1000;
+    bool late = step->worst_gap_us > deadline;
+    bool short_sent = sent_rate < step->target * MIN_SENT_RATIO;
+
+    printf("[conn %d] %8.0f/s target %8.0f/s sent %7.1f MB/s  blocked %5.1f%%  %d heartbeat(s), worst gap %5" PRIu64 " ms  %s\n",
+           conn->id, step->target, sent_rate, mbps, 100.0 * (double) step->blocked_us / ((double) seconds * 1e6),
+           step->heartbeats, step->worst_gap_us / 1000, late || short_sent ? "FAIL" : "ok");
+    fflush(stdout);
+
+    if (late) {
+        PrintReport(conn, "heartbeat late");
+        return false;
+    }
+
+    if (short_sent) {
+        PrintReport(conn, step->blocked_us > (uint64_t) (seconds * 1e6 / 10) ? "client stopped keeping up" : "server couldn't produce fast enough");
+        return false;
+    }
+
+    conn->best = step->target;
+    conn->best_mbps = mbps;
+    return true;
+}
+
+static void HandleClientMessage(Connection* conn, const char* text) {
+    const char* op_key = strstr(text, "\"op\":");
+    if (op_key == NULL) return;
+
+    int op = atoi(op_key + 5);
+    char payload[512];
+
+    switch (op) {
+        case 1: {
+            uint64_t now = NowUs();
+            if (conn->last_heartbeat_us != 0 && conn->ramping) {
+                uint64_t gap = now - conn->last_heartbeat_us;
+                if (gap > conn->step.worst_gap_us) conn->step.worst_gap_us = gap;
+                conn->step.heartbeats++;
+            }
+
+            conn->last_heartbeat_us = now;
+            QueueText(conn, "{\"op\":11,\"s\":null,\"t\":null,\"d\":null}");
+            break;
+        }
+
+        case 2:
+        case 6: {
+            conn->seq++;
+            if (op == 2) {
+                snprintf(payload, sizeof(payload),
+                         "{\"op\":0,\"s\":%" PRIu64 ",\"t\":\"READY\",\"d\":{\"v\":10,\"session_id\":\"firehose%d\","
+                         "\"resume_gateway_url\":\"wss://localhost:%d\",\"user\":{\"id\":\"1\",\"username\":\"firehose\"},\"guilds\":[]}}",
+                         conn->seq, conn->id, g_port);
+            } else {
+                snprintf(payload, sizeof(payload), "{\"op\":0,\"s\":%" PRIu64 ",\"t\":\"RESUMED\",\"d\":{}}", conn->seq);
+            }
+
+            QueueText(conn, payload);
+
+            if (!conn->identified) {
+                conn->identified = true;
+                StartStep(conn, g_start_rate);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// Pulls whatever the client sent and answers it. Returns -1 once the connection is gone
+static int ReadClient(Connection* conn) {
+    while (true) {
+        Reserve(&conn->in, 16384);
+        int r = SSL_read(conn->ssl, conn->in.data + conn->in.length, (int) (conn->in.capacity - conn->in.length));
+        if (r <= 0) {
+            int error = SSL_get_error(conn->ssl, r);
+            if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) break;
+            return -1;
+        }
+
+        conn->in.length += (size_t) r;
+    }
+
+    size_t offset = 0;
+    while (conn->in.length - offset >= 2) {
+        unsigned char* frame = conn->in.data + offset;
+        size_t available = conn->in.length - offset;
+        int opcode = frame[0] & 0x0F;
+        bool masked = (frame[1] & 0x80) != 0;
+        uint64_t length = frame[1] & 0x7F;
+        size_t header_length = 2;
+
+        if (length == 126) {
+            if (available < 4) break;
+            length = ((uint64_t) frame[2] << 8) | frame[3];
+            header_length = 4;
+        } else if (length == 127) {
+            if (available < 10) break;
+            length = 0;
+            for (int i = 0; i < 8; i++) length = (length << 8) | frame[2 + i];
+            header_length = 10;
+        }
+
+        if (length > MAX_CLIENT_FRAME) return -1;
+
+        size_t mask_offset = header_length;
+        if (masked) header_length += 4;
+        if (available < header_length + length) break;
+
+        char* payload = (char*) frame + header_length;
+        if (masked) {
+            for (uint64_t i = 0; i < length; i++) payload[i] ^= (char) frame[mask_offset + (i & 3)];
+        }
+
+        if (opcode == 8) {
+            conn->closed = true;
+            return -1;
+        }
+
+        if (opcode == 9) {
+            AppendFrame(&conn->out, 10, payload, length);
+        } else if (opcode == 1) {
+            char saved = payload[length];
+            payload[length] = '\0';
+            HandleClientMessage(conn, payload);
+            payload[length] = saved;
+        }
+
+        offset += header_length + length;
+    }
+
+    memmove(conn->in.data, conn->in.data + offset, conn->in.length - offset);
+    conn->in.length -= offset;
+    return 0;
+}
+
+// Blocking HTTP upgrade before the socket goes non-blocking. Returns 0 if it switched protocols
+static int Handshake(Connection* conn) {
+    char request[8192];
+    size_t length = 0;
+
+    while (true) {
+        int r = SSL_read(conn->ssl, request + length, (int) (sizeof(request) - 1 - length));
+        if (r <= 0) return -1;
+
+        length += (size_t) r;
+        request[length] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL) break;
+        if (length == sizeof(request) - 1) return -1;
+    }
+
+    char path[512];
+    if (sscanf(request, "GET %511s", path) != 1) return -1;
+
+    if (strstr(path, "encoding=etf") != NULL) {
+        const char* refusal = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+        SSL_write(conn->ssl, refusal, (int) strlen(refusal));
+        printf("[conn %d] refused %s, the firehose only speaks json\n", conn->id, path);
+        return -1;
+    }
+
+    conn->compress = strstr(path, "compress=zlib-stream") != NULL;
+
+    const char* key_header = strcasestr(request, "\r\nSec-WebSocket-Key:");
+    if (key_header == NULL) return -1;
+
+    char key[128];
+    if (sscanf(key_header + 20, " %100s", key) != 1) return -1;
+    strcat(key, "258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1((const unsigned char*) key, strlen(key), digest);
+
+    char accept[64];
+    EVP_EncodeBlock((unsigned char*) accept, digest, SHA_DIGEST_LENGTH);
+
+    char response[512];
+    int response_length = snprintf(response, sizeof(response),
+                                   "HTTP/1.1 101 Switching Protocols\r\n"
+                                   "Upgrade: websocket\r\n"
+                                   "Connection: Upgrade\r\n"
+                                   "Sec-WebSocket-Accept: %s\r\n\r\n",
+                                   accept);
+
+    if (SSL_write(conn->ssl, response, response_length) != response_length) return -1;
+
+    printf("[conn %d] connected, %s%s\n", conn->id, path, conn->compress ? "" : " (uncompressed)");
+    fflush(stdout);
+    return 0;
+}
+
+static void Stream(Connection* conn) {
+    char hello[128];
+    snprintf(hello, sizeof(hello), "{\"op\":10,\"s\":null,\"t\":null,\"d\":{\"heartbeat_interval\":%d}}", g_heartbeat_ms);
+    QueueText(conn, hello);
+    if (Flush(conn) != 0) return;
+
+    while (true) {
+        uint64_t now = NowUs();
+        Step* step = &conn->step;
+
+        if (conn->ramping && now - step->start_us >= (uint64_t) g_step_seconds * 1000000) {
+            if (FinishStep(conn, now)) {
+                StartStep(conn, step->target + g_rate_step);
+            } else {
+                // done measuring, the connection stays up with heartbeats answered until the client leaves
+                conn->ramping = false;
+            }
+
+            continue;
+        }
+
+        int timeout_ms = 100;
+        if (conn->ramping) {
+            uint64_t due = (uint64_t) ((double) (now - step->start_us) * step->target / 1e6);
+            while (step->sent < due && conn->out.length < MAX_BATCH_BYTES) {
+                step->bytes += QueueEvent(conn);
+                step->sent++;
+            }
+
+            uint64_t next_at = step->start_us + (uint64_t) ((double) (step->sent + 1) * 1e6 / step->target);
+            timeout_ms = next_at > now ? (int) ((next_at - now) / 1000) : 0;
+        }
+
+        if (conn->out.length > 0 && Flush(conn) != 0) break;
+
+        if (SSL_pending(conn->ssl) == 0) WaitSocket(conn, POLLIN, timeout_ms);
+        if (ReadClient(conn) != 0) break;
+        if (conn->out.length > 0 && Flush(conn) != 0) break;
+    }
+
+    if (conn->ramping) {
+        printf("[conn %d] %8.0f/s target: connection lost%s\n", conn->id, conn->step.target, conn->closed ? ", the client closed it" : "");
+        PrintReport(conn, "connection lost, the client gave up on a heartbeat or couldn't keep up");
+    } else {
+        printf("[conn %d] disconnected\n", conn->id);
+        fflush(stdout);
+    }
+}
+
+static void* ConnectionMain(void* arg) {
+    Connection* conn = arg;
+
+    if (SSL_accept(conn->ssl) == 1 && Handshake(conn) == 0) {
+        if (conn->compress) deflateInit(&conn->deflater, Z_DEFAULT_COMPRESSION);
+
+        int flags = fcntl(conn->sock, F_GETFL, 0);
+        fcntl(conn->sock, F_SETFL, flags | O_NONBLOCK);
+
+        Stream(conn);
+
+        if (conn->compress) deflateEnd(&conn->deflater);
+    }
+
+    SSL_free(conn->ssl);
+    close(conn->sock);
+    free(conn->in.data);
+    free(conn->out.data);
+    free(conn->text.data);
+    free(conn->deflated.data);
+    free(conn);
+    return NULL;
+}
+
+static int ParseMix(const char* mix) {
+    if (sscanf(mix, "%d:%d:%d", &g_weights[0], &g_weights[1], &g_weights[2]) != 3) return 1;
+
+    g_weight_total = 0;
+    for (int i = 0; i < EVENT_KIND_COUNT; i++) {
+        if (g_weights[i] < 0) return 1;
+        g_weight_total += g_weights[i];
+    }
+
+    return g_weight_total > 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) g_port = atoi(argv[1]);
+    if (argc > 2) g_start_rate = strtod(argv[2], NULL);
+    if (argc > 3) g_rate_step = strtod(argv[3], NULL);
+    if (argc > 4) g_step_seconds = atoi(argv[4]);
+    if (argc > 5) g_heartbeat_ms = atoi(argv[5]);
+    if (argc > 6 && ParseMix(argv[6]) != 0) {
+        printf("mix is MESSAGE_CREATE:PRESENCE_UPDATE:GUILD_CREATE weights, like 90:9:1\n");
+        return 1;
+    }
+    if (argc > 7) g_content_bytes = atoi(argv[7]);
+
+    if (g_start_rate <= 0 || g_rate_step < 0 || g_step_seconds <= 0 || g_heartbeat_ms <= 0 || g_content_bytes < 0) {
+        printf("rates, step length and heartbeat interval have to be positive\n");
+        return 1;
+    }
+
+    g_ssl_ctx = CreateSelfSignedContext();
+    if (g_ssl_ctx == NULL) {
+        ERR_print_errors_fp(stderr);
+        return 1;
+    }
+
+    g_content = malloc((size_t) g_content_bytes + 1);
+    for (int i = 0; i < g_content_bytes; i++) g_content[i] = (char) ('a' + i % 26);
+    g_content[g_content_bytes] = '\0';
+
+    BuildGuildBody();
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t) g_port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 128) != 0) {
+        perror("bind");
+        return 1;
+    }
+
+    printf("listening on wss://localhost:%d, %.0f events/s +%.0f every %d s, heartbeat %d ms, mix %d:%d:%d, %d byte messages, %zu byte guilds\n",
+           g_port, g_start_rate, g_rate_step, g_step_seconds, g_heartbeat_ms, g_weights[0], g_weights[1], g_weights[2],
+           g_content_bytes, g_guild_body_length);
+    fflush(stdout);
+
+    while (true) {
+        int sock = accept(listener, NULL, NULL);
+        if (sock < 0) continue;
+
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        Connection* conn = calloc(1, sizeof(Connection));
+        conn->sock = sock;
+        conn->id = atomic_fetch_add(&g_next_connection_id, 1);
+        conn->seed = (unsigned int) conn->id * 2654435761u + 1;
+        conn->snowflake = UINT64_C(1300000000000000000) + (uint64_t) conn->id * 100000000000ULL;
+        conn->ssl = SSL_new(g_ssl_ctx);
+        SSL_set_fd(conn->ssl, sock);
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, ConnectionMain, conn) != 0) {
+            SSL_free(conn->ssl);
+            close(sock);
+            free(conn);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+}
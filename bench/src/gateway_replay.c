@@ -0,0 +1,102 @@
+// Copyright 2025 JesusTouchMe
+
+// Plays a gateway recording (Discord_SetRecordFile) through the decode path and the event loop, no network or token needed.
+// usage: gateway_replay [recording] [speed] [event threads]
+// speed 1 is the recorded timing, 10 is 10x as fast, 0 (the default) as fast as possible.
+// without a recording it records the synthetic payload mix first, that one has no gaps to keep so speed doesn't matter
+
+#include "payloads.h"
+
+#include "discord.h"
+
+#include "utils/recording.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SYNTHETIC_MESSAGE_COUNT 50000
+
+static atomic_uint_fast64_t g_messages = 0;
+static atomic_uint_fast64_t g_content_bytes = 0;
+
+// about what a command bot does before deciding to answer
+static void OnMessageCreate(const Message* message) {
+    atomic_fetch_add_explicit(&g_messages, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_content_bytes, strlen(message->content), memory_order_relaxed);
+}
+
+static int RecordSynthetic(char* path) {
+    int fd = mkstemp(path);
+    if (fd < 0) return 1;
+    close(fd);
+
+    if (LoadOrGeneratePayloads(NULL) != 0) return 1;
+
+    RecordingWriter writer;
+    if (Recording_OpenWriter(&writer, path, 0, 1) != 0) return 1;
+
+    for (size_t i = 0; i < SYNTHETIC_MESSAGE_COUNT; i++) {
+        const Payload* payload = &g_payloads[i % g_payload_count];
+        Recording_Write(&writer, 0, payload->data, payload->length);
+    }
+
+    Recording_CloseWriter(&writer);
+    return 0;
+}
+
+static void PrintStage(const char* name, const Histogram* histogram) {
+    printf("%-12s %8llu %8llu %8llu %8llu %8llu\n", name,
+           (unsigned long long) Histogram_Mean(histogram),
+           (unsigned long long) Histogram_Percentile(histogram, 50.0),
+           (unsigned long long) Histogram_Percentile(histogram, 90.0),
+           (unsigned long long) Histogram_Percentile(histogram, 99.0),
+           (unsigned long long) Histogram_Max(histogram));
+}
+
+int main(int argc, char** argv) {
+    char synthetic_path[] = "/tmp/gateway_replay_XXXXXX";
+    const char* path = argc > 1 ? argv[1] : "-";
+    double speed = argc > 2 ? strtod(argv[2], NULL) : 0.0;
+    int thread_count = argc > 3 ? atoi(argv[3]) : 0;
+
+    if (strcmp(path, "-") == 0) {
+        if (RecordSynthetic(synthetic_path) != 0) {
+            printf("couldn't write the synthetic recording\n");
+            return 1;
+        }
+
+        path = synthetic_path;
+    }
+
+    GatewayEvent_InitTable();
+
+    Discord_SetEventThreadCount(thread_count);
+    Discord_SetEventDispatchMode(EVENT_DISPATCH_BY_CHANNEL);
+    Discord_SetOnMessageCreate(OnMessageCreate);
+
+    ReplayStats stats;
+    int err = Discord_Replay(path, speed, &stats);
+    if (path == synthetic_path) unlink(synthetic_path);
+
+    if (err != 0) {
+        printf("couldn't replay %s\n", path);
+        return 1;
+    }
+
+    printf("messages:    %llu, %llu dispatched, %llu skipped by the pre-scan\n",
+           (unsigned long long) stats.frames, (unsigned long long) stats.events, (unsigned long long) stats.events_skipped);
+    printf("wall:        %.3f s, %.0f messages/s, %.0f events/s\n",
+           stats.seconds, stats.frames / stats.seconds, stats.events / stats.seconds);
+    printf("handled:     %llu MESSAGE_CREATE, %llu content bytes\n",
+           (unsigned long long) atomic_load(&g_messages), (unsigned long long) atomic_load(&g_content_bytes));
+
+    printf("\nstage (us)       mean      p50      p90      p99      max\n");
+    PrintStage("decode", &stats.decode);
+    PrintStage("queue wait", &stats.queue_wait);
+    PrintStage("handler", &stats.handler);
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Copyright 2025 JesusTouchMe
+
+// Compares the old count-then-fill jsmn tokenize against jsmn_parse_growable, and both against the op/s/t pre-scan.
+// usage: json_tokenize_bench [payloads.jsonl] [event count]
+// without a payload file it uses synthetic MESSAGE_CREATE/PRESENCE_UPDATE/TYPING_START/GUILD_CREATE dispatches
+
+#include "payloads.h"
+
+#include "internal/memory.h"
+
+#include "utils/jsonutils.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static jsmntok_t* g_tokens = NULL;
+static unsigned int g_token_capacity = 0;
+
+static int TokenizeTwoPass(const char* json, size_t length) {
+    jsmn_parser parser;
+    jsmn_init(&parser);
+
+    int count = jsmn_parse(&parser, json, length, NULL, 0);
+    if (count <= 0) return -1;
+
+    if ((unsigned int) count > g_token_capacity) {
+        g_token_capacity = count;
+        g_tokens = HeapRealloc(g_tokens, count * sizeof(jsmntok_t));
+    }
+
+    jsmn_init(&parser);
+    return jsmn_parse(&parser, json, length, g_tokens, count);
+}
+
+// buffer kept between payloads, like a connection that already saw frames this size
+static int TokenizeOnePass(const char* json, size_t length) {
+    return jsmn_parse_growable(json, length, &g_tokens, &g_token_capacity);
+}
+
+// fresh buffer per payload, so every guess that's too small pays for a resume
+static int TokenizeOnePassCold(const char* json, size_t length) {
+    jsmntok_t* tokens = NULL;
+    unsigned int capacity = 0;
+
+    int count = jsmn_parse_growable(json, length, &tokens, &capacity);
+    HeapFree(tokens);
+
+    return count;
+}
+
+// what the gateway does first to decide whether the frame is worth tokenizing at all
+static int ScanEnvelope(const char* json, size_t length) {
+    static const char* const keys[] = {"op", "s", "t"};
+    jsmntok_t values[3];
+    return jsmn_scan_object(json, length, keys, 3, values);
+}
+
+static double Run(const char* name, int (*tokenize)(const char*, size_t), size_t event_count, uint64_t bytes) {
+    HeapFree(g_tokens);
+    g_tokens = NULL;
+    g_token_capacity = 0;
+
+    // warm up the shared buffer so the two pass and warm one pass runs don't pay for growing it
+    for (size_t i = 0; i < g_payload_count; i++) tokenize(g_payloads[i].data, g_payloads[i].length);
+
+    uint64_t tokens = 0;
+
+    double start = CpuSeconds();
+    for (size_t i = 0; i < event_count; i++) {
+        const Payload* payload = &g_payloads[i % g_payload_count];
+
+        int count = tokenize(payload->data, payload->length);
+        if (count < 0) {
+            printf("%s: tokenize failed on payload %zu\n", name, i % g_payload_count);
+            exit(1);
+        }
+
+        tokens += count;
+    }
+    double cpu = CpuSeconds() - start;
+
+    printf("%-22s %.3f us/event, %.1f MB/s, %" PRIu64 " tokens\n",
+           name, cpu * 1e6 / event_count, bytes / cpu / 1e6, tokens);
+
+    return cpu;
+}
+
+int main(int argc, char** argv) {
+    if (LoadOrGeneratePayloads(argc > 1 ? argv[1] : NULL) != 0) {
+        printf("couldn't load payloads from %s\n", argv[1]);
+        return 1;
+    }
+
+    size_t event_count = argc > 2 ? strtoull(argv[2], NULL, 10) : 20000;
+
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < event_count; i++) bytes += g_payloads[i % g_payload_count].length;
+
+    printf("events:                %zu (%zu distinct payloads), %.1f bytes/event\n",
+           event_count, g_payload_count, (double) bytes / event_count);
+
+    double two_pass = Run("two pass:", TokenizeTwoPass, event_count, bytes);
+    double one_pass = Run("one pass (warm):", TokenizeOnePass, event_count, bytes);
+    double one_pass_cold = Run("one pass (cold):", TokenizeOnePassCold, event_count, bytes);
+
+    double scan = Run("op/s/t pre-scan:", ScanEnvelope, event_count, bytes);
+
+    printf("speedup:               %.2fx warm, %.2fx cold\n", two_pass / one_pass, two_pass / one_pass_cold);
+    printf("pre-scan:              %.1f%% of a warm one pass tokenize\n", scan * 100.0 / one_pass);
+
+    HeapFree(g_tokens);
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+// Copyright 2025 JesusTouchMe
+
+#include "mock_tls.h"
+
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include <time.h>
+
+SSL_CTX* CreateSelfSignedContext(void) {
+    EVP_PKEY* key = NULL;
+    EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    if (key_ctx == NULL || EVP_PKEY_keygen_init(key_ctx) <= 0 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1) <= 0 || EVP_PKEY_keygen(key_ctx, &key) <= 0) {
+        EVP_PKEY_CTX_free(key_ctx);
+        return NULL;
+    }
+    EVP_PKEY_CTX_free(key_ctx);
+
+    X509* cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), (long) time(NULL));
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 60L * 60 * 24 * 30);
+    X509_set_pubkey(cert, key);
+
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*) "localhost", -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (ctx == NULL || X509_sign(cert, key, EVP_sha256()) <= 0 ||
+        SSL_CTX_use_certificate(ctx, cert) != 1 || SSL_CTX_use_PrivateKey(ctx, key) != 1) {
+        SSL_CTX_free(ctx);
+        ctx = NULL;
+    }
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ctx;
+}
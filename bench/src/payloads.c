@@ -0,0 +1,109 @@
+// Copyright 2025 JesusTouchMe
+
+#include "payloads.h"
+
+#include "internal/memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+Payload* g_payloads = NULL;
+size_t g_payload_count = 0;
+static size_t g_payload_capacity = 0;
+
+static void AddPayload(const char* data, size_t length) {
+    if (g_payload_count == g_payload_capacity) {
+        g_payload_capacity = g_payload_capacity == 0 ? 16 : g_payload_capacity * 2;
+        g_payloads = HeapRealloc(g_payloads, g_payload_capacity * sizeof(Payload));
+    }
+
+    char* copy = HeapAlloc(length + 1);
+    memcpy(copy, data, length);
+    g_payloads[g_payload_count].data = copy;
+    g_payloads[g_payload_count].length = length;
+    g_payload_count++;
+}
+
+static int LoadPayloads(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return 1;
+
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &capacity, file)) > 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) length--;
+        if (length > 0) AddPayload(line, length);
+    }
+
+    free(line);
+    fclose(file);
+    return g_payload_count == 0;
+}
+
+static void GeneratePayloads(void) {
+    char buf[4096];
+    int seq = 1;
+
+    for (int i = 0; i < 64; i++) {
+        int n = snprintf(buf, sizeof(buf),
+                         "{\"t\":\"MESSAGE_CREATE\",\"s\":%d,\"op\":0,\"d\":{\"type\":0,\"tts\":false,\"timestamp\":\"2025-03-01T12:00:%02d.000000+00:00\","
+                         "\"pinned\":false,\"nonce\":\"13%016d\",\"mentions\":[],\"mention_roles\":[],\"mention_everyone\":false,"
+                         "\"member\":{\"roles\":[\"1200000000000000%03d\"],\"premium_since\":null,\"pending\":false,\"nick\":null,\"mute\":false,"
+                         "\"joined_at\":\"2024-01-01T00:00:00.000000+00:00\",\"flags\":0,\"deaf\":false,\"communication_disabled_until\":null,\"avatar\":null},"
+                         "\"id\":\"13500000000000%05d\",\"flags\":0,\"embeds\":[],\"edited_timestamp\":null,\"content\":\"hello gambler, bet %d on red\","
+                         "\"components\":[],\"channel_id\":\"11000000000000%05d\",\"author\":{\"username\":\"player%d\",\"public_flags\":0,\"id\":\"9000000000000%05d\","
+                         "\"global_name\":\"Player %d\",\"discriminator\":\"0\",\"avatar_decoration_data\":null,\"avatar\":\"a1b2c3d4e5f6a7b8c9d0e1f2a3b4c5d6\"},"
+                         "\"attachments\":[],\"guild_id\":\"1100000000000000000\"}}",
+                         seq++, i % 60, i, i % 7, i, i * 13, i % 5, i, i * 31, i);
+        AddPayload(buf, n);
+
+        n = snprintf(buf, sizeof(buf),
+                     "{\"t\":\"PRESENCE_UPDATE\",\"s\":%d,\"op\":0,\"d\":{\"user\":{\"id\":\"9000000000000%05d\"},\"status\":\"online\","
+                     "\"guild_id\":\"1100000000000000000\",\"client_status\":{\"desktop\":\"online\"},\"activities\":[{\"type\":0,\"name\":\"Blackjack\","
+                     "\"id\":\"%x\",\"created_at\":17400000000%02d,\"timestamps\":{\"start\":17400000000%02d}}]}}",
+                     seq++, i * 17, i * 7919, i % 100, i % 100);
+        AddPayload(buf, n);
+
+        n = snprintf(buf, sizeof(buf),
+                     "{\"t\":\"TYPING_START\",\"s\":%d,\"op\":0,\"d\":{\"user_id\":\"9000000000000%05d\",\"timestamp\":17400000%02d,"
+                     "\"channel_id\":\"11000000000000%05d\",\"guild_id\":\"1100000000000000000\"}}",
+                     seq++, i * 31, i % 100, i % 5);
+        AddPayload(buf, n);
+    }
+
+    // one big GUILD_CREATE, these are what hurt the most on startup
+    size_t capacity = 4 * 1024 * 1024;
+    char* guild = HeapAlloc(capacity);
+    size_t length = snprintf(guild, capacity, "{\"t\":\"GUILD_CREATE\",\"s\":%d,\"op\":0,\"d\":{\"id\":\"1100000000000000000\",\"name\":\"casino\",\"members\":[", seq++);
+    for (int i = 0; i < 2000; i++) {
+        length += snprintf(guild + length, capacity - length,
+                           "%s{\"user\":{\"username\":\"player%d\",\"id\":\"9000000000000%05d\",\"discriminator\":\"0\",\"avatar\":null,\"global_name\":null},"
+                           "\"roles\":[],\"joined_at\":\"2024-01-01T00:00:00.000000+00:00\",\"deaf\":false,\"mute\":false,\"flags\":0}",
+                           i == 0 ? "" : ",", i, i);
+    }
+    length += snprintf(guild + length, capacity - length, "],\"channels\":[");
+    for (int i = 0; i < 200; i++) {
+        length += snprintf(guild + length, capacity - length,
+                           "%s{\"id\":\"11000000000000%05d\",\"type\":0,\"name\":\"table-%d\",\"position\":%d,\"permission_overwrites\":[],\"nsfw\":false,\"topic\":null}",
+                           i == 0 ? "" : ",", i, i, i);
+    }
+    length += snprintf(guild + length, capacity - length, "]}}");
+    AddPayload(guild, length);
+    HeapFree(guild);
+}
+
+double CpuSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+int LoadOrGeneratePayloads(const char* path) {
+    if (path != NULL && strcmp(path, "-") != 0) return LoadPayloads(path);
+
+    GeneratePayloads();
+    return 0;
+}
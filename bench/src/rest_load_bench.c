@@ -0,0 +1,110 @@
+// Copyright 2025 JesusTouchMe
+
+// Replies to a burst of messages the way a bot does, from event handlers, against rest_mock_server or anything else
+// that speaks the REST API, and reports how fast SendMessageEx gets through and how long each call takes.
+// usage: rest_load_bench [host] [port] [messages] [channels] [event threads]
+// defaults: localhost 8443 2000 50 8. run rest_mock_server first
+
+#include "discord.h"
+
+#include "utils/recording.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHANNEL_ID_BASE UINT64_C(1200000000000000000)
+#define MESSAGE_ID_BASE UINT64_C(1250000000000000000)
+
+static atomic_uint_fast64_t g_sent = 0;
+static atomic_uint_fast64_t g_failed = 0;
+
+static void OnMessageCreate(const Message* message) {
+    if (SendReply(message->channel_id, message->id, "pong") == 0) atomic_fetch_add_explicit(&g_sent, 1, memory_order_relaxed);
+    else atomic_fetch_add_explicit(&g_failed, 1, memory_order_relaxed);
+}
+
+// the messages to answer, as a recording so they go through the same path as real ones
+static int RecordMessages(char* path, int message_count, int channel_count) {
+    int fd = mkstemp(path);
+    if (fd < 0) return 1;
+    close(fd);
+
+    RecordingWriter writer;
+    if (Recording_OpenWriter(&writer, path, 0, 1) != 0) return 1;
+
+    char payload[512];
+    for (int i = 0; i < message_count; i++) {
+        int length = snprintf(payload, sizeof(payload),
+                              "{\"op\":0,\"s\":%d,\"t\":\"MESSAGE_CREATE\",\"d\":{\"id\":\"%" PRIu64 "\",\"channel_id\":\"%" PRIu64 "\","
+                              "\"guild_id\":\"1100000000000000000\",\"content\":\"ping\",\"author\":{\"id\":\"42\",\"username\":\"gambler\"}}}",
+                              i + 1, MESSAGE_ID_BASE + (uint64_t) i, CHANNEL_ID_BASE + (uint64_t) (i % channel_count));
+        Recording_Write(&writer, 0, payload, (size_t) length);
+    }
+
+    Recording_CloseWriter(&writer);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* host = argc > 1 ? argv[1] : "localhost";
+    const char* port = argc > 2 ? argv[2] : "8443";
+    int message_count = argc > 3 ? atoi(argv[3]) : 2000;
+    int channel_count = argc > 4 ? atoi(argv[4]) : 50;
+    int thread_count = argc > 5 ? atoi(argv[5]) : 8;
+
+    if (message_count <= 0 || channel_count <= 0) {
+        printf("need at least one message and one channel\n");
+        return 1;
+    }
+
+    char path[] = "/tmp/rest_load_XXXXXX";
+    if (RecordMessages(path, message_count, channel_count) != 0) {
+        printf("couldn't write the messages to %s\n", path);
+        return 1;
+    }
+
+    Discord_LibInit();
+
+    // every 429 would be an error line otherwise, they're counted instead
+    Log_SetLevel(LOG_CATEGORY_REST, LOG_LEVEL_OFF);
+
+    Discord_SetRestHost(host, port);
+    Discord_SetToken("rest_load_bench");
+    Discord_SetEventThreadCount(thread_count);
+    Discord_SetEventDispatchMode(EVENT_DISPATCH_ANY);
+    Discord_SetOnMessageCreate(OnMessageCreate);
+
+    ReplayStats stats;
+    int err = Discord_Replay(path, 0, &stats);
+    unlink(path);
+
+    if (err == 0) {
+        uint64_t sent = atomic_load(&g_sent);
+        uint64_t failed = atomic_load(&g_failed);
+
+        printf("target:      https://%s:%s, %d messages over %d channels, %d event threads\n", host, port, message_count, channel_count, thread_count);
+        printf("sends:       %" PRIu64 " ok, %" PRIu64 " failed (429 or error)\n", sent, failed);
+        printf("throughput:  %.3f s, %.0f sends/s\n", stats.seconds, (sent + failed) / stats.seconds);
+
+        TlsHandshakeStats tls;
+        Discord_GetTlsHandshakeStats(&tls);
+        printf("tls:         %" PRIu64 " full handshake(s), mean %" PRIu64 " us, %" PRIu64 " resumed, mean %" PRIu64 " us\n",
+               tls.full, tls.full_mean_us, tls.resumed, tls.resumed_mean_us);
+
+        printf("\n(us)             mean      p50      p90      p99      max\n");
+        printf("%-12s %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n", "send", Histogram_Mean(&stats.handler),
+               Histogram_Percentile(&stats.handler, 50.0), Histogram_Percentile(&stats.handler, 90.0),
+               Histogram_Percentile(&stats.handler, 99.0), Histogram_Max(&stats.handler));
+        printf("%-12s %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n", "queue wait", Histogram_Mean(&stats.queue_wait),
+               Histogram_Percentile(&stats.queue_wait, 50.0), Histogram_Percentile(&stats.queue_wait, 90.0),
+               Histogram_Percentile(&stats.queue_wait, 99.0), Histogram_Max(&stats.queue_wait));
+    }
+
+    Discord_LibShutdown();
+
+    return err;
+}
@@ -0,0 +1,455 @@
+// Copyright 2025 JesusTouchMe
+
+// Stand-in for the Discord REST API so request throughput can be measured without going near production.
+// usage: rest_mock_server [port] [latency ms] [jitter ms] [bucket limit] [bucket window ms] [global limit/s] [gateway url]
+// defaults: 8443 0 0 5 5000 50 wss://localhost:8444, so messages are 5 per 5 seconds per channel like the real thing.
+// Serves TLS with a self-signed certificate made at startup (the library doesn't verify certificates).
+// Routes: GET /gateway, GET /gateway/bot, POST/GET /channels/{id}/messages, GET/PATCH/DELETE /channels/{id}/messages/{id}
+// Every route + channel has its own bucket and sends X-RateLimit-* headers. Going over a bucket or the global limit
+// gets a 429 with retry_after like discord's
+
+#define _GNU_SOURCE // memmem, strcasestr
+
+#include "mock_tls.h"
+
+#include <openssl/err.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BUCKET_TABLE_SIZE 65536 // power of two, route + channel pairs
+#define MAX_REQUEST_HEADER 8192
+#define MAX_REQUEST_BODY (1 << 20)
+
+typedef enum Route {
+    ROUTE_UNKNOWN = 0,
+    ROUTE_GATEWAY,
+    ROUTE_GATEWAY_BOT,
+    ROUTE_CREATE_MESSAGE,
+    ROUTE_GET_MESSAGES,
+    ROUTE_GET_MESSAGE,
+    ROUTE_EDIT_MESSAGE,
+    ROUTE_DELETE_MESSAGE,
+} Route;
+
+static const char* const g_bucket_ids[] = {
+        [ROUTE_CREATE_MESSAGE] = "80c17d2f203122d936070c88c8d10f33",
+        [ROUTE_GET_MESSAGES] = "e7a9c5fb3c1f5d0b7c9e1a6f2a3d4b5c",
+        [ROUTE_GET_MESSAGE] = "1c2d3e4f5a6b7c8d9e0f1a2b3c4d5e6f",
+        [ROUTE_EDIT_MESSAGE] = "5f4e3d2c1b0a9f8e7d6c5b4a3f2e1d0c",
+        [ROUTE_DELETE_MESSAGE] = "9a8b7c6d5e4f3a2b1c0d9e8f7a6b5c4d",
+};
+
+typedef struct Bucket {
+    uint64_t key; // route in the top byte, channel id below. 0 is an empty slot
+    int remaining;
+    uint64_t reset_at; // ms, monotonic
+} Bucket;
+
+typedef struct Connection {
+    int sock;
+    SSL* ssl;
+    unsigned int seed;
+
+    char buffer[MAX_REQUEST_HEADER];
+    size_t length;
+} Connection;
+
+static int g_latency_ms = 0;
+static int g_jitter_ms = 0;
+static int g_bucket_limit = 5;
+static int g_bucket_window_ms = 5000;
+static int g_global_limit = 50;
+static const char* g_gateway_url = "wss://localhost:8444";
+
+static SSL_CTX* g_ssl_ctx = NULL;
+
+static pthread_mutex_t g_bucket_lock = PTHREAD_MUTEX_INITIALIZER;
+static Bucket* g_buckets = NULL;
+static uint64_t g_global_window_start = 0;
+static int g_global_count = 0;
+
+static atomic_uint_fast64_t g_snowflake = 1300000000000000000ULL;
+static atomic_uint_fast64_t g_requests = 0;
+static atomic_uint_fast64_t g_bucket_limited = 0;
+static atomic_uint_fast64_t g_global_limited = 0;
+static atomic_int g_connections = 0;
+
+static uint64_t MonotonicMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static double EpochSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static Route MatchRoute(const char* method, const char* path, uint64_t* channel_id) {
+    if (strncmp(path, "/api/v10", 8) == 0) path += 8;
+
+    if (strcmp(method, "GET") == 0 && strcmp(path, "/gateway") == 0) return ROUTE_GATEWAY;
+    if (strcmp(method, "GET") == 0 && strcmp(path, "/gateway/bot") == 0) return ROUTE_GATEWAY_BOT;
+
+    unsigned long long channel;
+    int offset = 0;
+    if (sscanf(path, "/channels/%llu/messages%n", &channel, &offset) != 1 || offset == 0) return ROUTE_UNKNOWN;
+    *channel_id = channel;
+
+    const char* rest = path + offset;
+    if (*rest == '\0' || *rest == '?') {
+        if (strcmp(method, "POST") == 0) return ROUTE_CREATE_MESSAGE;
+        if (strcmp(method, "GET") == 0) return ROUTE_GET_MESSAGES;
+        return ROUTE_UNKNOWN;
+    }
+
+    unsigned long long message;
+    if (sscanf(rest, "/%llu", &message) != 1) return ROUTE_UNKNOWN;
+
+    if (strcmp(method, "GET") == 0) return ROUTE_GET_MESSAGE;
+    if (strcmp(method, "PATCH") == 0) return ROUTE_EDIT_MESSAGE;
+    if (strcmp(method, "DELETE") == 0) return ROUTE_DELETE_MESSAGE;
+    return ROUTE_UNKNOWN;
+}
+
+// Takes a request out of the route's bucket. Returns false if it's empty, retry_after_ms says for how long.
+// remaining and reset_after_ms are what goes in the X-RateLimit headers either way
+static bool TakeFromBucket(Route route, uint64_t channel_id, int* remaining, uint64_t* reset_after_ms, bool* global) {
+    uint64_t key = ((uint64_t) route << 56) | (channel_id & 0x00FFFFFFFFFFFFFFULL);
+    uint64_t now = MonotonicMs();
+
+    pthread_mutex_lock(&g_bucket_lock);
+
+    // the global limit is requests per second over every route
+    if (now - g_global_window_start >= 1000) {
+        g_global_window_start = now;
+        g_global_count = 0;
+    }
+
+    if (g_global_count >= g_global_limit) {
+        *global = true;
+        *remaining = 0;
+        *reset_after_ms = g_global_window_start + 1000 - now;
+        pthread_mutex_unlock(&g_bucket_lock);
+        return false;
+    }
+
+    size_t home = (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> 48) & (BUCKET_TABLE_SIZE - 1);
+    size_t slot = home;
+    while (g_buckets[slot].key != 0 && g_buckets[slot].key != key) {
+        slot = (slot + 1) & (BUCKET_TABLE_SIZE - 1);
+        if (slot == home) break; // full, the home slot's bucket gets thrown out
+    }
+
+    Bucket* bucket = &g_buckets[slot];
+    if (bucket->key != key || now >= bucket->reset_at) {
+        bucket->key = key;
+        bucket->remaining = g_bucket_limit;
+        bucket->reset_at = now + g_bucket_window_ms;
+    }
+
+    *global = false;
+    *reset_after_ms = bucket->reset_at - now;
+
+    if (bucket->remaining == 0) {
+        *remaining = 0;
+        pthread_mutex_unlock(&g_bucket_lock);
+        return false;
+    }
+
+    bucket->remaining--;
+    g_global_count++;
+    *remaining = bucket->remaining;
+
+    pthread_mutex_unlock(&g_bucket_lock);
+    return true;
+}
+
+static int WriteAll(SSL* ssl, const char* data, size_t length) {
+    while (length > 0) {
+        int w = SSL_write(ssl, data, (int) length);
+        if (w <= 0) return -1;
+
+        data += w;
+        length -= (size_t) w;
+    }
+
+    return 0;
+}
+
+static int SendResponse(Connection* conn, int status, const char* reason, const char* extra_headers, const char* body) {
+    char head[1024];
+    size_t body_length = strlen(body);
+
+    int length = snprintf(head, sizeof(head),
+                          "HTTP/1.1 %d %s\r\n"
+                          "Content-Type: application/json\r\n"
+                          "Content-Length: %zu\r\n"
+                          "Connection: keep-alive\r\n"
+                          "%s\r\n",
+                          status, reason, body_length, extra_headers);
+
+    if (WriteAll(conn->ssl, head, (size_t) length) != 0) return -1;
+    return body_length > 0 ? WriteAll(conn->ssl, body, body_length) : 0;
+}
+
+static int HandleRequest(Connection* conn, const char* method, const char* path) {
+    atomic_fetch_add_explicit(&g_requests, 1, memory_order_relaxed);
+
+    if (g_latency_ms > 0 || g_jitter_ms > 0) {
+        int delay = g_latency_ms + (g_jitter_ms > 0 ? (int) (rand_r(&conn->seed) % (unsigned int) (g_jitter_ms + 1)) : 0);
+        usleep((useconds_t) delay * 1000);
+    }
+
+    uint64_t channel_id = 0;
+    Route route = MatchRoute(method, path, &channel_id);
+
+    char body[1024];
+
+    if (route == ROUTE_UNKNOWN) {
+        return SendResponse(conn, 404, "Not Found", "", "{\"message\": \"404: Not Found\", \"code\": 0}");
+    }
+
+    if (route == ROUTE_GATEWAY) {
+        snprintf(body, sizeof(body), "{\"url\": \"%s\"}", g_gateway_url);
+        return SendResponse(conn, 200, "OK", "", body);
+    }
+
+    if (route == ROUTE_GATEWAY_BOT) {
+        snprintf(body, sizeof(body),
+                 "{\"url\": \"%s\", \"shards\": 1, \"session_start_limit\": {\"total\": 1000, \"remaining\": 1000, \"reset_after\": 86400000, \"max_concurrency\": 1}}",
+                 g_gateway_url);
+        return SendResponse(conn, 200, "OK", "", body);
+    }
+
+    int remaining;
+    uint64_t reset_after_ms;
+    bool global;
+    bool allowed = TakeFromBucket(route, channel_id, &remaining, &reset_after_ms, &global);
+
+    char headers[512];
+    double reset_after = (double) reset_after_ms / 1000.0;
+
+    if (!allowed && global) {
+        atomic_fetch_add_explicit(&g_global_limited, 1, memory_order_relaxed);
+
+        snprintf(headers, sizeof(headers), "Retry-After: %d\r\nX-RateLimit-Global: true\r\nX-RateLimit-Scope: global\r\n", (int) reset_after + 1);
+        snprintf(body, sizeof(body), "{\"message\": \"You are being rate limited.\", \"retry_after\": %.3f, \"global\": true}", reset_after);
+        return SendResponse(conn, 429, "Too Many Requests", headers, body);
+    }
+
+    snprintf(headers, sizeof(headers),
+             "X-RateLimit-Limit: %d\r\n"
+             "X-RateLimit-Remaining: %d\r\n"
+             "X-RateLimit-Reset: %.3f\r\n"
+             "X-RateLimit-Reset-After: %.3f\r\n"
+             "X-RateLimit-Bucket: %s\r\n",
+             g_bucket_limit, remaining, EpochSeconds() + reset_after, reset_after, g_bucket_ids[route]);
+
+    if (!allowed) {
+        atomic_fetch_add_explicit(&g_bucket_limited, 1, memory_order_relaxed);
+
+        size_t length = strlen(headers);
+        snprintf(headers + length, sizeof(headers) - length, "Retry-After: %d\r\nX-RateLimit-Scope: user\r\n", (int) reset_after + 1);
+        snprintf(body, sizeof(body), "{\"message\": \"You are being rate limited.\", \"retry_after\": %.3f, \"global\": false}", reset_after);
+        return SendResponse(conn, 429, "Too Many Requests", headers, body);
+    }
+
+    switch (route) {
+        case ROUTE_CREATE_MESSAGE:
+        case ROUTE_GET_MESSAGE:
+        case ROUTE_EDIT_MESSAGE: {
+            uint64_t id = atomic_fetch_add_explicit(&g_snowflake, 1, memory_order_relaxed);
+            snprintf(body, sizeof(body),
+                     "{\"id\": \"%" PRIu64 "\", \"type\": 0, \"channel_id\": \"%" PRIu64 "\", \"content\": \"\", \"tts\": false, "
+                     "\"timestamp\": \"2025-03-01T12:00:00.000000+00:00\", \"edited_timestamp\": null, \"mentions\": [], "
+                     "\"attachments\": [], \"embeds\": [], \"pinned\": false, \"author\": {\"id\": \"1\", \"username\": \"gambler\", \"bot\": true}}",
+                     id, channel_id);
+            return SendResponse(conn, 200, "OK", headers, body);
+        }
+
+        case ROUTE_GET_MESSAGES:
+            return SendResponse(conn, 200, "OK", headers, "[]");
+
+        case ROUTE_DELETE_MESSAGE:
+            return SendResponse(conn, 204, "No Content", headers, "");
+
+        default:
+            return SendResponse(conn, 404, "Not Found", "", "{\"message\": \"404: Not Found\", \"code\": 0}");
+    }
+}
+
+// Reads until the buffer holds a whole header block. Returns its length including the blank line, or -1
+static int ReadHeaders(Connection* conn) {
+    while (true) {
+        char* end = conn->length >= 4 ? memmem(conn->buffer, conn->length, "\r\n\r\n", 4) : NULL;
+        if (end != NULL) return (int) (end + 4 - conn->buffer);
+
+        if (conn->length == sizeof(conn->buffer)) return -1;
+
+        int r = SSL_read(conn->ssl, conn->buffer + conn->length, (int) (sizeof(conn->buffer) - conn->length));
+        if (r <= 0) return -1;
+        conn->length += (size_t) r;
+    }
+}
+
+// drops the request body, this server doesn't look at it
+static int SkipBody(Connection* conn, size_t header_length, size_t body_length) {
+    size_t buffered = conn->length - header_length;
+
+    if (buffered >= body_length) {
+        size_t consumed = header_length + body_length;
+        memmove(conn->buffer, conn->buffer + consumed, conn->length - consumed);
+        conn->length -= consumed;
+        return 0;
+    }
+
+    body_length -= buffered;
+    conn->length = 0;
+
+    char scratch[4096];
+    while (body_length > 0) {
+        int r = SSL_read(conn->ssl, scratch, body_length < sizeof(scratch) ? (int) body_length : (int) sizeof(scratch));
+        if (r <= 0) return -1;
+        body_length -= (size_t) r;
+    }
+
+    return 0;
+}
+
+static void* ConnectionMain(void* arg) {
+    Connection* conn = arg;
+    atomic_fetch_add(&g_connections, 1);
+
+    if (SSL_accept(conn->ssl) == 1) {
+        while (true) {
+            int header_length = ReadHeaders(conn);
+            if (header_length < 0) break;
+
+            char method[16];
+            char path[512];
+            if (sscanf(conn->buffer, "%15s %511s", method, path) != 2) break;
+
+            size_t body_length = 0;
+            conn->buffer[header_length - 1] = '\0'; // was the last \n of the blank line
+            const char* content_length = strcasestr(conn->buffer, "\r\nContent-Length:");
+            if (content_length != NULL) body_length = strtoul(content_length + 17, NULL, 10);
+            if (body_length > MAX_REQUEST_BODY) break;
+
+            if (SkipBody(conn, (size_t) header_length, body_length) != 0) break;
+            if (HandleRequest(conn, method, path) != 0) break;
+        }
+    }
+
+    SSL_shutdown(conn->ssl);
+    SSL_free(conn->ssl);
+    close(conn->sock);
+    free(conn);
+
+    atomic_fetch_sub(&g_connections, 1);
+    return NULL;
+}
+
+static void* StatsMain(void* arg) {
+    (void) arg;
+    uint64_t last_requests = 0;
+    uint64_t last_bucket = 0;
+    uint64_t last_global = 0;
+
+    while (true) {
+        sleep(1);
+
+        uint64_t requests = atomic_load(&g_requests);
+        uint64_t bucket = atomic_load(&g_bucket_limited);
+        uint64_t global = atomic_load(&g_global_limited);
+        if (requests == last_requests) continue;
+
+        printf("%" PRIu64 " req/s, 429s: %" PRIu64 " bucket %" PRIu64 " global, %d connection(s)\n",
+               requests - last_requests, bucket - last_bucket, global - last_global, atomic_load(&g_connections));
+        fflush(stdout);
+
+        last_requests = requests;
+        last_bucket = bucket;
+        last_global = global;
+    }
+
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int port = argc > 1 ? atoi(argv[1]) : 8443;
+    if (argc > 2) g_latency_ms = atoi(argv[2]);
+    if (argc > 3) g_jitter_ms = atoi(argv[3]);
+    if (argc > 4) g_bucket_limit = atoi(argv[4]);
+    if (argc > 5) g_bucket_window_ms = atoi(argv[5]);
+    if (argc > 6) g_global_limit = atoi(argv[6]);
+    if (argc > 7) g_gateway_url = argv[7];
+
+    g_ssl_ctx = CreateSelfSignedContext();
+    if (g_ssl_ctx == NULL) {
+        ERR_print_errors_fp(stderr);
+        return 1;
+    }
+
+    g_buckets = calloc(BUCKET_TABLE_SIZE, sizeof(Bucket));
+    g_global_window_start = MonotonicMs();
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t) port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 128) != 0) {
+        perror("bind");
+        return 1;
+    }
+
+    printf("listening on https://localhost:%d, latency %d+-%d ms, buckets %d per %d ms, global %d/s\n",
+           port, g_latency_ms, g_jitter_ms, g_bucket_limit, g_bucket_window_ms, g_global_limit);
+    fflush(stdout);
+
+    pthread_t stats_thread;
+    pthread_create(&stats_thread, NULL, StatsMain, NULL);
+    pthread_detach(stats_thread);
+
+    while (true) {
+        int sock = accept(listener, NULL, NULL);
+        if (sock < 0) continue;
+
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        Connection* conn = calloc(1, sizeof(Connection));
+        conn->sock = sock;
+        conn->seed = (unsigned int) sock * 2654435761u;
+        conn->ssl = SSL_new(g_ssl_ctx);
+        SSL_set_fd(conn->ssl, sock);
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, ConnectionMain, conn) != 0) {
+            SSL_free(conn->ssl);
+            close(sock);
+            free(conn);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+}
@@ -0,0 +1,119 @@
+// Copyright 2025 JesusTouchMe
+
+// UTF-8 validation and websocket masking, every kernel level the cpu has against the scalar one.
+// usage: ws_kernels_bench [payloads.jsonl] [event count]
+// without a payload file it uses the synthetic dispatch mix. The mixed text run is mostly multibyte, which is where
+// sse2 falls back to checking sequence by sequence
+
+#include "payloads.h"
+
+#include "utils/simd.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIXED_TEXT_SIZE (64 * 1024)
+
+static unsigned char* g_scratch = NULL;
+
+static double RunValidate(const Payload* payloads, size_t payload_count, size_t event_count) {
+    size_t valid = 0;
+
+    double start = CpuSeconds();
+    for (size_t i = 0; i < event_count; i++) {
+        const Payload* payload = &payloads[i % payload_count];
+        valid += Simd_ValidateUtf8(payload->data, payload->length);
+    }
+    double cpu = CpuSeconds() - start;
+
+    if (valid != event_count) {
+        printf("%s: %zu of %zu payloads failed validation\n", Simd_LevelName(Simd_GetLevel()), event_count - valid, event_count);
+        exit(1);
+    }
+
+    return cpu;
+}
+
+static double RunMask(const Payload* payloads, size_t payload_count, size_t event_count) {
+    static const unsigned char mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+
+    double start = CpuSeconds();
+    for (size_t i = 0; i < event_count; i++) {
+        const Payload* payload = &payloads[i % payload_count];
+        Simd_MaskCopy(g_scratch, payload->data, payload->length, mask);
+    }
+    double cpu = CpuSeconds() - start;
+
+    return cpu;
+}
+
+static void Compare(const char* name, double (*run)(const Payload*, size_t, size_t), const Payload* payloads, size_t payload_count,
+                    size_t event_count, uint64_t bytes) {
+    double scalar = 0;
+
+    for (int level = 0; level < SIMD_LEVEL_COUNT; level++) {
+        if (Simd_SetLevel((SimdLevel) level) != 0) continue;
+
+        run(payloads, payload_count, payload_count); // warm up
+        double cpu = run(payloads, payload_count, event_count);
+        if (level == SIMD_LEVEL_SCALAR) scalar = cpu;
+
+        printf("%-14s %-7s %8.1f MB/s  %.2fx\n", name, Simd_LevelName((SimdLevel) level), bytes / cpu / 1e6, scalar / cpu);
+    }
+}
+
+// latin, cjk and emoji with a little ascii in between, like a busy non-english server
+static Payload MakeMixedText(void) {
+    static const char* const pieces[] = {"h\xc3\xa9llo ", "\xe4\xb8\xad\xe6\x96\x87", "\xf0\x9f\x98\x80", " \xd0\xbf\xd1\x80\xd0\xb8"};
+
+    Payload payload;
+    payload.data = malloc(MIXED_TEXT_SIZE + 16);
+    payload.length = 0;
+
+    for (size_t i = 0; payload.length < MIXED_TEXT_SIZE; i++) {
+        const char* piece = pieces[i % 4];
+        size_t length = strlen(piece);
+        memcpy(payload.data + payload.length, piece, length);
+        payload.length += length;
+    }
+
+    return payload;
+}
+
+int main(int argc, char** argv) {
+    if (LoadOrGeneratePayloads(argc > 1 ? argv[1] : NULL) != 0) {
+        printf("couldn't load payloads from %s\n", argv[1]);
+        return 1;
+    }
+
+    size_t event_count = argc > 2 ? strtoull(argv[2], NULL, 10) : 200000;
+
+    uint64_t bytes = 0;
+    size_t largest = MIXED_TEXT_SIZE + 16;
+    for (size_t i = 0; i < g_payload_count; i++) {
+        if (g_payloads[i].length > largest) largest = g_payloads[i].length;
+    }
+    for (size_t i = 0; i < event_count; i++) bytes += g_payloads[i % g_payload_count].length;
+
+    g_scratch = malloc(largest);
+
+    printf("events:        %zu (%zu distinct payloads), %.1f bytes/event\n",
+           event_count, g_payload_count, (double) bytes / event_count);
+
+    Compare("utf-8 check:", RunValidate, g_payloads, g_payload_count, event_count, bytes);
+    Compare("mask:", RunMask, g_payloads, g_payload_count, event_count, bytes);
+
+    Payload mixed = MakeMixedText();
+    size_t mixed_count = event_count / 100 + 1;
+    uint64_t mixed_bytes = (uint64_t) mixed.length * mixed_count;
+
+    printf("\nmixed text:    %zu x %zu bytes, mostly multibyte\n", mixed_count, mixed.length);
+    Compare("utf-8 check:", RunValidate, &mixed, 1, mixed_count, mixed_bytes);
+
+    free(mixed.data);
+    free(g_scratch);
+
+    return 0;
+}
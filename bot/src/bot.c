@@ -11,6 +11,20 @@ intents_t GetIntents(void) {
     return GUILD_MESSAGES | MESSAGE_CONTENT;
 }
 
+bool GetGatewayCompression(void) {
+    return true;
+}
+
+// restarts pick up where the last process left off instead of identifying again
+const char* GetSessionFile(void) {
+    return "gambler.session";
+}
+
+// replies in a channel go out in the order the messages came in
+EventDispatchMode GetEventDispatchMode(void) {
+    return EVENT_DISPATCH_BY_CHANNEL;
+}
+
 void OnReady(void) {
     printf("we ready cuh\n");
     fflush(stdout);
@@ -10,12 +10,67 @@
 #include "discord/message.h"
 #include "discord/types.h"
 
+#include "utils/histogram.h"
 #include "utils/jsonutils.h"
+#include "utils/log.h"
+
+#include <stdint.h>
+
+// heartbeat round trips, microseconds
+typedef struct GatewayLatency {
+    uint64_t samples;
+    uint64_t mean_us;
+    uint64_t p50_us;
+    uint64_t p90_us;
+    uint64_t p99_us;
+    uint64_t max_us;
+} GatewayLatency;
+
+// TLS handshakes for REST and the gateway since Discord_LibInit, resumed ones reused a cached session for the host
+typedef struct TlsHandshakeStats {
+    uint64_t full;
+    uint64_t resumed;
+    uint64_t full_mean_us;
+    uint64_t full_p99_us;
+    uint64_t resumed_mean_us;
+    uint64_t resumed_p99_us;
+    uint64_t ktls_send; // connections where kTLS took over sending, with Discord_SetKernelTls
+    uint64_t ktls_recv;
+} TlsHandshakeStats;
+
+// what Discord_Replay measured. latencies are microseconds
+typedef struct ReplayStats {
+    uint64_t frames; // websocket messages fed in
+    uint64_t events; // dispatches that made it to the event loop
+    uint64_t events_skipped; // dispatches the pre-scan dropped because nothing wanted them
+    double seconds; // from the first message until the event loop drained
+
+    Histogram decode; // one message through the gateway: inflate, pre-scan, tokenize, enqueue
+    Histogram queue_wait; // enqueued until a worker picked it up
+    Histogram handler; // parsing for the callback and the callback itself
+} ReplayStats;
 
 void Discord_LibInit(void);
 void Discord_LibShutdown(void);
 
 void Discord_SetToken(const char* token);
+void Discord_SetRestHost(const char* host, const char* port); // where REST requests go, default discord.com 443. for mock servers
+void Discord_SetGatewayHost(const char* host, const char* port); // overrides the url from /gateway/bot, NULL host undoes it. with a shard count set too, /gateway/bot isn't asked at all
+// kTLS: after the handshake the kernel encrypts and decrypts the records, where the tls module is there to do it. Off
+// by default, after Discord_LibInit and only for connections opened after the call. Without the module nothing changes
+void Discord_SetKernelTls(bool enable);
+void Discord_SetConnectTimeout(int timeout_ms); // how long a REST or gateway connect can take over all of a host's addresses, <= 0 is the default 10 s
+void Discord_SetDnsTtl(int ttl_ms); // how long lookups are reused for reconnects, default 60 s, 0 resolves every time
+void Discord_SetEventThreadCount(int thread_count); // if thread_count <= 0, the event loop uses all cores
+void Discord_SetEventDispatchMode(EventDispatchMode mode); // default EVENT_DISPATCH_ANY, read when Discord_Run starts the event loop
+void Discord_SetGatewayThreadCount(int thread_count); // shards are spread over this many reactor threads, default 1
+void Discord_SetShardCount(int shard_count); // if shard_count <= 0, Discord_Run uses the count recommended by /gateway/bot
+int Discord_GetShardCount(void);
+void Discord_SetGatewayCompression(bool compress); // transport compression (compress=zlib-stream), read when Discord_Run connects. Without it the websocket offers permessage-deflate
+void Discord_SetGatewayEncoding(GatewayEncoding encoding); // json or etf, read when Discord_Run connects
+void Discord_SetGatewayMaxMessageSize(size_t size); // bigger websocket messages close the connection with 1009, 0 (the default) is 64 MiB
+void Discord_SetSessionFile(const char* path); // where sessions are kept so a restart can RESUME, NULL (the default) turns it off
+void Discord_SetRecordFile(const char* path); // Discord_Run writes every gateway message it receives here for Discord_Replay, NULL (the default) turns it off
 void Discord_SetIntents(intents_t intents);
 void Discord_AddIntent(intents_t intent);
 void Discord_RemoveIntent(intents_t intent);
@@ -23,11 +78,36 @@ void Discord_RemoveIntent(intents_t intent);
 OnReadyFn Discord_OnReady(void);
 OnMessageCreateFn Discord_OnmessageCreate(void);
 
+EventCallbackFn Discord_GetCallback(GatewayEventType type);
+void Discord_SetCallback(GatewayEventType type, EventCallbackFn callback); // callback has to be the right type for the event
+
 void Discord_SetOnReady(OnReadyFn callback);
 void Discord_SetOnMessageCreate(OnMessageCreateFn callback); // TODO: message struct
 
-Arena* Discord_GetEventArena(void);
+// bytes_received is what came off the websocket, bytes_decoded is what the json parser got after zlib-stream (same thing without compression)
+void Discord_GetGatewayTrafficStats(uint64_t* bytes_received, uint64_t* bytes_decoded);
+
+// dispatches that were dropped before tokenizing because no callback wanted them, bytes are after zlib-stream
+void Discord_GetSkippedEventStats(uint64_t* events_skipped, uint64_t* bytes_skipped);
+
+// identifies left in today's session_start_limit (-1 if unknown), identifies sent so far and how long shards waited
+// on the max_concurrency buckets in total. only meaningful while Discord_Run is running
+void Discord_GetIdentifyStats(int* remaining, uint64_t* identifies, uint64_t* waited_ms);
+
+void Discord_GetGatewayLatency(GatewayLatency* latency); // all shards since Discord_LibInit
+void Discord_GetTlsHandshakeStats(TlsHandshakeStats* stats);
+// lookups that went to the resolver and ones the cache answered, connects that worked and ones where no address did
+void Discord_GetConnectStats(uint64_t* dns_lookups, uint64_t* dns_cache_hits, uint64_t* connects, uint64_t* failures);
+int64_t Discord_GetShardLatency(int shard_id); // last heartbeat round trip in microseconds, -1 before the first ACK
+
+Arena* Discord_GetEventArena(void); // inside an event handler this is the worker's arena
 
 void Discord_Run(void);
 
+// Feeds a recording from Discord_SetRecordFile through the gateway decode path and the event loop, with the callbacks
+// and event loop settings that are set right now. Nothing goes over the network, it doesn't need Discord_LibInit or a token
+// (just GatewayEvent_InitTable). speed 1 keeps the recorded timing, 10 plays it 10x as fast, 0 as fast as possible.
+// Returns nonzero if the recording can't be opened
+int Discord_Replay(const char* path, double speed, ReplayStats* stats);
+
 #endif // DISCORD_H
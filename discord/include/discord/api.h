@@ -8,8 +8,12 @@
 int DiscordAPI_Init(void);
 void DiscordAPI_Shutdown(void);
 
+void DiscordAPI_SetHost(const char* host, const char* port); // default discord.com 443, port NULL means 443
+
 void DiscordAPI_SetAuth(const char* auth);
 
 HTTPResponse* DiscordAPI_SendRequest(Arena* arena, const char* method, const char* path, const char* body);
+HTTPResponse* DiscordAPI_SendFile(Arena* arena, const char* method, const char* path, const char* content_type,
+                                  const HTTPFileBody* body); // see HTTP_RequestFile
 
 #endif //DISCORD_API_H
\ No newline at end of file
@@ -3,20 +3,78 @@
 #ifndef DISCORD_EVENTS_H
 #define DISCORD_EVENTS_H 1
 
+#include "discord/gateway_events.h"
+
+#include "internal/memory.h"
+
+#include "utils/etf.h"
+#include "utils/framebuffer.h"
+#include "utils/histogram.h"
 #include "utils/jsonutils.h"
 
+#include <stdint.h>
+
+typedef enum GatewayEncoding {
+    GATEWAY_ENCODING_JSON = 0,
+    GATEWAY_ENCODING_ETF = 1,
+} GatewayEncoding;
+
+// How events are spread over the event workers
+typedef enum EventDispatchMode {
+    EVENT_DISPATCH_ANY = 0, // whichever worker is free, no ordering between workers
+    // events with the same id always go to the same worker and run in the order they arrived.
+    // events without the id (READY, or a message without an author in BY_USER) go to any worker
+    EVENT_DISPATCH_BY_CHANNEL = 1,
+    EVENT_DISPATCH_BY_GUILD = 2,
+    EVENT_DISPATCH_BY_USER = 3,
+} EventDispatchMode;
+
+// One allocation with the tokens right after the struct. The payload stays in the frame buffer it was received into
 typedef struct Event {
-    const char* json;
-    const jsmntok_t* tokens;
+    GatewayEncoding encoding;
+
+    FrameBuffer* frame; // the event holds one reference
+    const char* json; // frame->data, ETF bytes when encoding is GATEWAY_ENCODING_ETF
+    size_t length;
+    const jsmntok_t* tokens; // json only
+    const EtfTerm* terms; // etf only
+
+    GatewayEventType type; // from t, set by the gateway before the event is queued
+
+    // indices into tokens or terms, depending on the encoding
     JsonObject t;
     JsonObject d;
+    int shard_id;
 
+    uint64_t seq; // event loop only
+    uint64_t queued_at; // NowUs when it was enqueued, only set while stage histograms are on
     struct Event* next;
 } Event;
 
-void EventLoop_Init(int thread_count); // if thread_count <= 0, it will use all
+Event* Event_Create(FrameBuffer* frame, GatewayEncoding encoding, int token_count); // takes the frame reference
+Event* Event_Grow(Event* event, int token_count); // more room for tokens, the event can move
+void Event_Free(Event* event); // releases the frame too
+
+GatewayEventType Event_LookupType(const Event* event); // hashes the t bytes in place
+
+// These work on both encodings. Values are indices like the ones in t and d, JSON_NULL if missing
+JsonObject Event_FindKey(const Event* event, JsonObject object, const char* key);
+bool Event_IsObject(const Event* event, JsonObject value);
+int Event_GetString(const Event* event, JsonObject value, char* dest, size_t dest_size);
+int Event_GetInteger(const Event* event, JsonObject value, int64_t* out);
+int Event_GetBoolean(const Event* event, JsonObject value, bool* out);
+
+void EventLoop_Init(int thread_count, EventDispatchMode mode); // if thread_count <= 0, it will use all
 void EventLoop_Shutdown(bool join);
 
+// Microseconds from enqueue until a worker takes the event, and how long dispatching it took (parsing plus the callback).
+// Both NULL (the default) turns it off. Only change it while the loop isn't running
+void EventLoop_SetStageHistograms(Histogram* queue_wait, Histogram* handler);
+
 void EventLoop_Enqueue(Event* event); // takes ownership of event
+bool EventLoop_WantsEvent(GatewayEventType type); // false if nothing would be called for it, so it doesn't have to be queued
+
+// Arena of the worker running on the calling thread, or NULL if this isn't an event worker
+Arena* EventLoop_GetWorkerArena(void);
 
-#endif //DISCORD_EVENTS_H
\ No newline at end of file
+#endif //DISCORD_EVENTS_H
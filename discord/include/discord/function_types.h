@@ -3,15 +3,36 @@
 #ifndef DISCORD_FUNCTION_TYPES_H
 #define DISCORD_FUNCTION_TYPES_H 1
 
+#include "discord/events.h"
 #include "discord/intents.h"
 #include "discord/types.h"
 
+#include "utils/log.h"
+
+#include <stdbool.h>
+
 typedef int (*ProgramMainFn)(int argc, const char** argv);
 typedef void (*ProgramExitFn)(void);
 
 typedef const char* (*GetTokenFn)(void);
+typedef const char* (*GetRestHostFn)(void);
+typedef const char* (*GetRestPortFn)(void);
+typedef const char* (*GetGatewayHostFn)(void);
+typedef const char* (*GetGatewayPortFn)(void);
+typedef int (*GetShardCountFn)(void);
+typedef bool (*GetKernelTlsFn)(void);
+typedef int (*GetConnectTimeoutFn)(void);
 typedef intents_t (*GetIntentsFn)(void);
+typedef int (*GetEventThreadCountFn)(void);
+typedef EventDispatchMode (*GetEventDispatchModeFn)(void);
+typedef int (*GetGatewayThreadCountFn)(void);
+typedef bool (*GetGatewayCompressionFn)(void);
+typedef GatewayEncoding (*GetGatewayEncodingFn)(void);
+typedef const char* (*GetSessionFileFn)(void);
+typedef const char* (*GetRecordFileFn)(void);
+typedef LogLevel (*GetLogLevelFn)(LogCategory category); // asked once for every category, payload logging is off by default
 
+typedef void (*EventCallbackFn)(void); // what callbacks are stored as, cast to the real type for the event before calling
 typedef void (*OnReadyFn)(void);
 typedef void (*OnMessageCreateFn)(const Message* message);
 
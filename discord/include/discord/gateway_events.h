@@ -0,0 +1,96 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_GATEWAY_EVENTS_H
+#define DISCORD_GATEWAY_EVENTS_H 1
+
+#include <stddef.h>
+
+// Every dispatch (op 0) the gateway sends, by its t field
+typedef enum GatewayEventType {
+    GATEWAY_EVENT_UNKNOWN = 0, // a name that isn't in the table
+    GATEWAY_EVENT_READY,
+    GATEWAY_EVENT_RESUMED,
+    GATEWAY_EVENT_APPLICATION_COMMAND_PERMISSIONS_UPDATE,
+    GATEWAY_EVENT_AUTO_MODERATION_RULE_CREATE,
+    GATEWAY_EVENT_AUTO_MODERATION_RULE_UPDATE,
+    GATEWAY_EVENT_AUTO_MODERATION_RULE_DELETE,
+    GATEWAY_EVENT_AUTO_MODERATION_ACTION_EXECUTION,
+    GATEWAY_EVENT_CHANNEL_CREATE,
+    GATEWAY_EVENT_CHANNEL_UPDATE,
+    GATEWAY_EVENT_CHANNEL_DELETE,
+    GATEWAY_EVENT_CHANNEL_PINS_UPDATE,
+    GATEWAY_EVENT_THREAD_CREATE,
+    GATEWAY_EVENT_THREAD_UPDATE,
+    GATEWAY_EVENT_THREAD_DELETE,
+    GATEWAY_EVENT_THREAD_LIST_SYNC,
+    GATEWAY_EVENT_THREAD_MEMBER_UPDATE,
+    GATEWAY_EVENT_THREAD_MEMBERS_UPDATE,
+    GATEWAY_EVENT_ENTITLEMENT_CREATE,
+    GATEWAY_EVENT_ENTITLEMENT_UPDATE,
+    GATEWAY_EVENT_ENTITLEMENT_DELETE,
+    GATEWAY_EVENT_GUILD_CREATE,
+    GATEWAY_EVENT_GUILD_UPDATE,
+    GATEWAY_EVENT_GUILD_DELETE,
+    GATEWAY_EVENT_GUILD_AUDIT_LOG_ENTRY_CREATE,
+    GATEWAY_EVENT_GUILD_BAN_ADD,
+    GATEWAY_EVENT_GUILD_BAN_REMOVE,
+    GATEWAY_EVENT_GUILD_EMOJIS_UPDATE,
+    GATEWAY_EVENT_GUILD_STICKERS_UPDATE,
+    GATEWAY_EVENT_GUILD_INTEGRATIONS_UPDATE,
+    GATEWAY_EVENT_GUILD_MEMBER_ADD,
+    GATEWAY_EVENT_GUILD_MEMBER_REMOVE,
+    GATEWAY_EVENT_GUILD_MEMBER_UPDATE,
+    GATEWAY_EVENT_GUILD_MEMBERS_CHUNK,
+    GATEWAY_EVENT_GUILD_ROLE_CREATE,
+    GATEWAY_EVENT_GUILD_ROLE_UPDATE,
+    GATEWAY_EVENT_GUILD_ROLE_DELETE,
+    GATEWAY_EVENT_GUILD_SCHEDULED_EVENT_CREATE,
+    GATEWAY_EVENT_GUILD_SCHEDULED_EVENT_UPDATE,
+    GATEWAY_EVENT_GUILD_SCHEDULED_EVENT_DELETE,
+    GATEWAY_EVENT_GUILD_SCHEDULED_EVENT_USER_ADD,
+    GATEWAY_EVENT_GUILD_SCHEDULED_EVENT_USER_REMOVE,
+    GATEWAY_EVENT_GUILD_SOUNDBOARD_SOUND_CREATE,
+    GATEWAY_EVENT_GUILD_SOUNDBOARD_SOUND_UPDATE,
+    GATEWAY_EVENT_GUILD_SOUNDBOARD_SOUND_DELETE,
+    GATEWAY_EVENT_GUILD_SOUNDBOARD_SOUNDS_UPDATE,
+    GATEWAY_EVENT_SOUNDBOARD_SOUNDS,
+    GATEWAY_EVENT_INTEGRATION_CREATE,
+    GATEWAY_EVENT_INTEGRATION_UPDATE,
+    GATEWAY_EVENT_INTEGRATION_DELETE,
+    GATEWAY_EVENT_INTERACTION_CREATE,
+    GATEWAY_EVENT_INVITE_CREATE,
+    GATEWAY_EVENT_INVITE_DELETE,
+    GATEWAY_EVENT_MESSAGE_CREATE,
+    GATEWAY_EVENT_MESSAGE_UPDATE,
+    GATEWAY_EVENT_MESSAGE_DELETE,
+    GATEWAY_EVENT_MESSAGE_DELETE_BULK,
+    GATEWAY_EVENT_MESSAGE_REACTION_ADD,
+    GATEWAY_EVENT_MESSAGE_REACTION_REMOVE,
+    GATEWAY_EVENT_MESSAGE_REACTION_REMOVE_ALL,
+    GATEWAY_EVENT_MESSAGE_REACTION_REMOVE_EMOJI,
+    GATEWAY_EVENT_MESSAGE_POLL_VOTE_ADD,
+    GATEWAY_EVENT_MESSAGE_POLL_VOTE_REMOVE,
+    GATEWAY_EVENT_PRESENCE_UPDATE,
+    GATEWAY_EVENT_STAGE_INSTANCE_CREATE,
+    GATEWAY_EVENT_STAGE_INSTANCE_UPDATE,
+    GATEWAY_EVENT_STAGE_INSTANCE_DELETE,
+    GATEWAY_EVENT_SUBSCRIPTION_CREATE,
+    GATEWAY_EVENT_SUBSCRIPTION_UPDATE,
+    GATEWAY_EVENT_SUBSCRIPTION_DELETE,
+    GATEWAY_EVENT_TYPING_START,
+    GATEWAY_EVENT_USER_UPDATE,
+    GATEWAY_EVENT_VOICE_CHANNEL_EFFECT_SEND,
+    GATEWAY_EVENT_VOICE_STATE_UPDATE,
+    GATEWAY_EVENT_VOICE_SERVER_UPDATE,
+    GATEWAY_EVENT_WEBHOOKS_UPDATE,
+
+    GATEWAY_EVENT_COUNT,
+} GatewayEventType;
+
+void GatewayEvent_InitTable(void); // Discord_LibInit calls this, lookups before it return GATEWAY_EVENT_UNKNOWN
+
+// The raw bytes of the t field, doesn't have to be null terminated
+GatewayEventType GatewayEvent_FromName(const char* name, size_t length);
+const char* GatewayEvent_GetName(GatewayEventType type); // NULL for GATEWAY_EVENT_UNKNOWN
+
+#endif //DISCORD_GATEWAY_EVENTS_H
@@ -20,4 +20,8 @@ int SendMessageEx(snowflake_t channel_id, const MessageContent* message);
 int SendMessage(snowflake_t channel_id, const char* message);
 int SendReply(snowflake_t channel_id, snowflake_t message_id, const char* message);
 
+// message with the whole of fd attached as filename, uploaded as multipart/form-data (payload_json and files[0]). The
+// file's bytes are sent straight from it, with kTLS on they never come through userspace
+int SendMessageWithFile(snowflake_t channel_id, const MessageContent* message, const char* filename, int fd);
+
 #endif //DISCORD_MESSAGE_H
\ No newline at end of file
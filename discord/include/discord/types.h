@@ -5,6 +5,7 @@
 
 #include "internal/memory.h"
 
+#include "utils/etf.h"
 #include "utils/jsonutils.h"
 
 #include <stdint.h>
@@ -909,6 +910,11 @@ typedef struct Message {
     OPTIONAL(MessageCall) call;
 } Message;
 
+int ParseUser(User* user, Arena* arena, const char* json, const jsmntok_t* tokens, JsonObject user_obj);
 int ParseMessage(Message* message, Arena* arena, const char* json, const jsmntok_t* tokens, JsonObject message_obj);
 
+// same structs from encoding=etf payloads
+int ParseUserEtf(User* user, Arena* arena, const unsigned char* data, const EtfTerm* terms, int user_obj);
+int ParseMessageEtf(Message* message, Arena* arena, const unsigned char* data, const EtfTerm* terms, int message_obj);
+
 #endif // DISCORD_TYPES_H
@@ -0,0 +1,83 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_ETF_H
+#define DISCORD_UTILS_ETF_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Erlang External Term Format, the other encoding the gateway speaks (encoding=etf).
+// The decoder works like jsmn: it fills a flat array of terms in document order and never copies anything out of the buffer.
+
+#define ETF_VERSION 131
+
+typedef enum EtfType {
+    ETF_UNDEFINED = 0,
+    ETF_INTEGER = 1, // small/int/big ints, anything that fits in 64 bits
+    ETF_FLOAT = 2,
+    ETF_ATOM = 3, // nil, true and false are atoms too
+    ETF_BINARY = 4, // binaries and the STRING_EXT byte lists
+    ETF_LIST = 5,
+    ETF_MAP = 6,
+    ETF_TUPLE = 7,
+} EtfType;
+
+typedef enum EtfError {
+    ETF_ERROR_NOMEM = -1, // not enough terms
+    ETF_ERROR_INVAL = -2, // unsupported or broken term
+    ETF_ERROR_PART = -3, // buffer ends in the middle of a term
+} EtfError;
+
+typedef struct EtfTerm {
+    EtfType type;
+    int size; // elements for lists and tuples, key/value pairs for maps
+    int span; // how many terms are nested below this one
+    unsigned int start; // atom/binary bytes, [start, end) in the buffer
+    unsigned int end;
+    bool negative;
+
+    union {
+        uint64_t integer; // magnitude, check negative
+        double number;
+    };
+} EtfTerm;
+
+typedef struct EtfWriter {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+} EtfWriter;
+
+// Returns the number of terms, or an EtfError. Pass NULL terms to just count them
+int etf_parse(const unsigned char* data, size_t length, EtfTerm* terms, unsigned int num_terms);
+
+// Same idea as jsmn_scan_object: reads the top level map and fills values[i] with the value of keys[i] (ETF_UNDEFINED when
+// missing) while the other values are only walked over. Wanted values have to be scalars, their children aren't kept.
+// Returns how many keys were found or an EtfError
+int etf_scan_map(const unsigned char* data, size_t length, const char* const* keys, int key_count, EtfTerm* values);
+
+bool etf_eq(const unsigned char* data, const EtfTerm* term, const char* s); // atom or binary equals s
+bool etf_is_nil(const unsigned char* data, const EtfTerm* term);
+
+// Same as jsmn_find_key, map keys can be atoms or binaries. Returns -1 if it isn't there
+int etf_find_key(const unsigned char* data, const EtfTerm* terms, int map, const char* key);
+
+void etf_copy_string(const unsigned char* data, const EtfTerm* terms, int term, char* dest, size_t dest_size);
+
+void EtfWriter_Init(EtfWriter* writer);
+void EtfWriter_Destroy(EtfWriter* writer);
+void EtfWriter_Reset(EtfWriter* writer); // also writes the version byte
+
+void etf_write_map_header(EtfWriter* writer, uint32_t pairs);
+void etf_write_list_header(EtfWriter* writer, uint32_t count); // write count elements and then etf_write_nil for the tail
+void etf_write_nil(EtfWriter* writer); // empty list
+void etf_write_atom(EtfWriter* writer, const char* atom);
+void etf_write_null(EtfWriter* writer); // the nil atom, what the gateway uses for null
+void etf_write_bool(EtfWriter* writer, bool value);
+void etf_write_binary(EtfWriter* writer, const char* data, size_t length);
+void etf_write_string(EtfWriter* writer, const char* s);
+void etf_write_integer(EtfWriter* writer, int64_t value);
+void etf_write_unsigned(EtfWriter* writer, uint64_t value);
+
+#endif //DISCORD_UTILS_ETF_H
@@ -0,0 +1,33 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_FRAMEBUFFER_H
+#define DISCORD_UTILS_FRAMEBUFFER_H 1
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Refcounted buffers for received websocket messages. The receive path fills one, the Event that gets built from it
+// takes the reference, and the worker releases it when the handler is done. Buffers come from a pool of power of two
+// size classes so a steady stream of dispatches doesn't hit malloc.
+
+typedef struct FrameBuffer {
+    atomic_int refs;
+    int size_class; // -1 if it's too big for the pool
+    size_t capacity;
+    size_t length;
+    struct FrameBuffer* next; // pool free list
+
+    char data[];
+} FrameBuffer;
+
+FrameBuffer* FrameBuffer_Acquire(size_t capacity); // refs starts at 1, length at 0
+void FrameBuffer_Retain(FrameBuffer* buffer);
+void FrameBuffer_Release(FrameBuffer* buffer); // back to the pool on the last release
+
+// Only for buffers nobody else holds yet. Returns a buffer with at least capacity bytes and the same contents
+FrameBuffer* FrameBuffer_Grow(FrameBuffer* buffer, size_t capacity);
+
+void FrameBuffer_GetPoolStats(uint64_t* acquired, uint64_t* reused);
+
+#endif //DISCORD_UTILS_FRAMEBUFFER_H
@@ -0,0 +1,29 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_HISTOGRAM_H
+#define DISCORD_UTILS_HISTOGRAM_H 1
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Power of two buckets, bucket i counts values in [2^(i-1), 2^i). Recording is lock free so any thread can do it.
+// Percentiles come out as the upper edge of the bucket they land in, so they're within 2x of the real value
+
+#define HISTOGRAM_BUCKETS 40
+
+typedef struct Histogram {
+    atomic_uint_fast64_t buckets[HISTOGRAM_BUCKETS];
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t max;
+} Histogram;
+
+void Histogram_Init(Histogram* histogram);
+void Histogram_Record(Histogram* histogram, uint64_t value);
+
+uint64_t Histogram_Count(const Histogram* histogram);
+uint64_t Histogram_Mean(const Histogram* histogram);
+uint64_t Histogram_Max(const Histogram* histogram);
+uint64_t Histogram_Percentile(const Histogram* histogram, double percentile); // percentile is 0-100
+
+#endif //DISCORD_UTILS_HISTOGRAM_H
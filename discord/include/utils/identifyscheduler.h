@@ -0,0 +1,39 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_IDENTIFYSCHEDULER_H
+#define DISCORD_UTILS_IDENTIFYSCHEDULER_H 1
+
+#include <pthread.h>
+#include <stdint.h>
+
+// Hands out IDENTIFY slots. The gateway takes max_concurrency identifies per 5 seconds, shard_id % max_concurrency picks
+// the bucket and every bucket takes one at a time. On top of that there's a daily budget from session_start_limit.
+// Shards on every gateway thread share one scheduler, a shard asks for a slot when HELLO comes in and sends IDENTIFY
+// after the delay it gets back, so a mass (re)connect goes out as fast as the limits allow and no faster.
+
+typedef struct IdentifyScheduler {
+    pthread_mutex_t lock;
+
+    int bucket_count;
+    uint64_t* bucket_free_at; // NowUs when the bucket can take its next identify
+
+    int total; // daily identifies, -1 if /gateway/bot didn't say
+    int remaining;
+    uint64_t reset_at; // NowUs when remaining goes back to total
+
+    uint64_t granted;
+    uint64_t waited_ms; // total delay handed out, how much the limits cost us
+} IdentifyScheduler;
+
+// reset_after_ms is session_start_limit.reset_after, total < 0 turns off the daily budget
+int IdentifyScheduler_Init(IdentifyScheduler* scheduler, int max_concurrency, int total, int remaining, uint64_t reset_after_ms);
+void IdentifyScheduler_Destroy(IdentifyScheduler* scheduler);
+
+// Takes the next slot in the shard's bucket and returns how many ms to wait before sending IDENTIFY.
+// The slot is used up even if the connection dies before then
+uint64_t IdentifyScheduler_Reserve(IdentifyScheduler* scheduler, int shard_id);
+
+// remaining is -1 if there's no daily budget
+void IdentifyScheduler_GetStats(IdentifyScheduler* scheduler, int* remaining, uint64_t* granted, uint64_t* waited_ms);
+
+#endif //DISCORD_UTILS_IDENTIFYSCHEDULER_H
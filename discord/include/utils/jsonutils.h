@@ -14,6 +14,16 @@ typedef int JsonObject;
 
 bool jsoneq(const char* json, jsmntok_t tok, const char* s);
 
+// One pass jsmn_parse into a heap buffer (HeapRealloc) that grows whenever jsmn runs out of tokens. jsmn keeps its position
+// on JSMN_ERROR_NOMEM, so it picks up where it stopped instead of starting over. Reuse *tokens and *capacity between calls
+// to skip the growing, or start from NULL and 0. Returns the token count or a jsmnerr
+int jsmn_parse_growable(const char* json, size_t length, jsmntok_t** tokens, unsigned int* capacity);
+
+// Reads only the top level of an object and fills values[i] with the value of keys[i], JSMN_UNDEFINED if it isn't there.
+// Nested values under other keys are skipped over without making tokens, and it stops once every key was found, so keys that
+// come before a big "d" cost next to nothing. Returns how many keys were found or -1 if json isn't an object
+int jsmn_scan_object(const char* json, size_t length, const char* const* keys, int key_count, jsmntok_t* values);
+
 // jsmn extensions
 
 // Given the index of an object, find a property inside it and return the index of the value. tokens[obj_index].type MUST be JSMN_OBJECT
@@ -27,4 +37,7 @@ int jsmn_subtree_size(const jsmntok_t* tokens, JsonObject object);
 
 void jsmn_copy_string(const char* json, const jsmntok_t* tokens, JsonObject object, char* dest, size_t dest_size);
 
+// Like jsmn_copy_string but resolves escapes (\n, \", \uXXXX, ...) to utf-8. Returns the length written. dest_size == token length + 1 is always enough
+size_t jsmn_copy_unescaped(const char* json, const jsmntok_t* tokens, JsonObject object, char* dest, size_t dest_size);
+
 #endif // DISCORD_UTILS_JSONUTILS_H
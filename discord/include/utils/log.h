@@ -0,0 +1,55 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_LOG_H
+#define DISCORD_UTILS_LOG_H 1
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Logging that never blocks the caller. Messages are formatted into a fixed size slot of a lock-free ring and a background
+// thread writes them out. A full ring drops the message and counts it instead of waiting. Levels are per category and can
+// change at any time, a disabled LOG() is one relaxed load and a compare, the arguments aren't even evaluated
+
+typedef enum LogLevel {
+    LOG_LEVEL_TRACE = 0, // every gateway payload
+    LOG_LEVEL_DEBUG = 1,
+    LOG_LEVEL_INFO = 2,
+    LOG_LEVEL_WARN = 3,
+    LOG_LEVEL_ERROR = 4,
+    LOG_LEVEL_OFF = 5,
+} LogLevel;
+
+typedef enum LogCategory {
+    LOG_CATEGORY_CORE = 0,
+    LOG_CATEGORY_GATEWAY = 1, // connections, heartbeats, sessions
+    LOG_CATEGORY_PAYLOAD = 2, // raw gateway frames, only useful at LOG_LEVEL_TRACE
+    LOG_CATEGORY_REST = 3,
+    LOG_CATEGORY_EVENTS = 4,
+
+    LOG_CATEGORY_COUNT,
+} LogCategory;
+
+#define LOG_MESSAGE_SIZE 480 // longer messages get cut off
+
+extern _Atomic uint8_t g_log_levels[LOG_CATEGORY_COUNT];
+
+#define LOG(category, level, ...) \
+    do { \
+        if ((level) >= atomic_load_explicit(&g_log_levels[(category)], memory_order_relaxed)) Log_Write((category), (level), __VA_ARGS__); \
+    } while (0)
+
+// slot_count is rounded up to a power of two, 0 picks the default. Before Log_Init and after Log_Shutdown messages are
+// written straight to stdout
+void Log_Init(unsigned int slot_count);
+void Log_Shutdown(void); // writes out whatever is still queued
+
+void Log_SetLevel(LogCategory category, LogLevel level);
+void Log_SetAllLevels(LogLevel level);
+LogLevel Log_GetLevel(LogCategory category);
+
+void Log_Write(LogCategory category, LogLevel level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+uint64_t Log_GetDropped(void); // messages lost to a full ring since Log_Init
+
+#endif //DISCORD_UTILS_LOG_H
@@ -0,0 +1,42 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_NET_H
+#define DISCORD_UTILS_NET_H 1
+
+#include <stdint.h>
+
+// Where REST and gateway sockets come from. Lookups are cached for a while so reconnects don't wait on the resolver,
+// and the addresses are raced Happy Eyeballs style (RFC 8305): ipv6 and ipv4 take turns, a new attempt starts every
+// attempt delay or as soon as one fails, and the first to connect wins. The connect timeout starts once the addresses are
+// known and covers the race and the handshakes after it: until Net_ClearTimeout every read or write on the socket waits
+// at most what was left of the timeout when it connected. Everything here is thread safe.
+
+#define NET_MAX_ADDRESSES 8 // per host, more than this is never worth trying
+#define NET_DNS_CACHE_SIZE 32
+
+#define NET_DEFAULT_CONNECT_TIMEOUT_MS 10000
+#define NET_DEFAULT_ATTEMPT_DELAY_MS 250 // what RFC 8305 recommends
+#define NET_DEFAULT_DNS_TTL_MS 60000 // getaddrinfo doesn't say what the record's ttl was, so this is all there is
+
+typedef struct NetStats {
+    uint64_t lookups; // getaddrinfo calls
+    uint64_t cache_hits;
+    uint64_t connects;
+    uint64_t failures; // Net_Connect calls where no address worked
+    uint64_t fallbacks; // connects that were won by an address other than the first one
+} NetStats;
+
+void Net_SetConnectTimeout(int timeout_ms); // <= 0 means the default
+void Net_SetAttemptDelay(int delay_ms); // how long one attempt gets before the next address is tried alongside it
+void Net_SetDnsTtl(int ttl_ms); // 0 turns the cache off
+void Net_FlushDns(void);
+
+// A connected blocking TCP socket with TCP_NODELAY and keepalive on, or -1. Reads and writes on it time out at the
+// connect deadline until Net_ClearTimeout. A host where nothing connects is dropped from the cache so the next try
+// resolves it again
+int Net_Connect(const char* host, const char* port);
+void Net_ClearTimeout(int fd); // once the handshakes are done, the connection can sit idle as long as it likes after that
+
+void Net_GetStats(NetStats* stats);
+
+#endif //DISCORD_UTILS_NET_H
@@ -0,0 +1,64 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_REACTOR_H
+#define DISCORD_UTILS_REACTOR_H 1
+
+#include <sys/epoll.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// A small epoll loop. One thread runs Reactor_Run and every callback happens on that thread,
+// so whatever owns a handle doesn't need locks as long as it only touches it from callbacks.
+
+typedef struct Reactor Reactor;
+typedef struct ReactorHandle ReactorHandle;
+
+// events is the epoll mask (EPOLLIN, EPOLLOUT, EPOLLERR...), timers just get EPOLLIN.
+// Callbacks can be called spuriously, a socket callback should treat EAGAIN/WANT_READ as "nothing to do"
+typedef void (*ReactorCallback)(Reactor* reactor, ReactorHandle* handle, uint32_t events);
+
+struct ReactorHandle {
+    int fd; // -1 when not registered
+    bool timer; // the reactor owns timer fds and drains them before calling back
+    bool deferred;
+    uint32_t events;
+
+    ReactorCallback callback;
+    void* userdata;
+
+    ReactorHandle* next_deferred;
+};
+
+struct Reactor {
+    int epoll_fd;
+    int wake_fd; // eventfd for Reactor_Stop from other threads
+    atomic_bool running;
+
+    ReactorHandle* deferred; // handles that still have buffered input, dispatched again without waiting
+};
+
+int Reactor_Init(Reactor* reactor);
+void Reactor_Destroy(Reactor* reactor);
+
+// The handle memory has to stay valid until it is removed
+int Reactor_Add(Reactor* reactor, ReactorHandle* handle, int fd, uint32_t events, ReactorCallback callback, void* userdata);
+int Reactor_Modify(Reactor* reactor, ReactorHandle* handle, uint32_t events); // does nothing if events didn't change
+void Reactor_Remove(Reactor* reactor, ReactorHandle* handle); // doesn't close fd
+
+// Call the handle again with EPOLLIN on the next iteration even if the fd isn't readable.
+// For sockets where openssl already has decrypted bytes that epoll can't know about
+void Reactor_Defer(Reactor* reactor, ReactorHandle* handle);
+
+int Reactor_AddTimer(Reactor* reactor, ReactorHandle* handle, ReactorCallback callback, void* userdata);
+void Reactor_RemoveTimer(Reactor* reactor, ReactorHandle* handle); // closes the timerfd
+
+// Fires once after delay_ms, then every interval_ms if it isn't 0. A delay of 0 fires on the next iteration
+int Reactor_ArmTimer(ReactorHandle* handle, uint64_t delay_ms, uint64_t interval_ms);
+void Reactor_DisarmTimer(ReactorHandle* handle);
+
+void Reactor_Run(Reactor* reactor); // returns after Reactor_Stop
+void Reactor_Stop(Reactor* reactor); // safe from any thread
+
+#endif //DISCORD_UTILS_REACTOR_H
@@ -0,0 +1,74 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_RECORDING_H
+#define DISCORD_UTILS_RECORDING_H 1
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Gateway recordings: every websocket message a shard received, as it came off the wire (still zlib-stream compressed
+// if the connection was), so a replay goes through the exact same decode path.
+// The file is a 16 byte header and then one record per message, written front to back and never rewritten:
+//   varint microseconds since the previous record, varint shard id << 1 | opened, varint length, length bytes
+// the first record's time is since the recording started. Varints are LEB128. opened marks an empty record for a
+// new connection on the shard, a zlib-stream starts over there. Version 1 files have the plain shard id and no such records
+//
+// Writing only copies the record into memory, a thread of the writer's own does the file I/O every
+// RECORDING_FLUSH_INTERVAL_MS (or sooner if a lot piled up) so the gateway threads never wait on the disk. A process
+// that dies without Recording_CloseWriter loses at most that interval's worth
+
+#define RECORDING_COMPRESSED 0x1 // compress=zlib-stream
+#define RECORDING_ETF 0x2 // encoding=etf
+
+#define RECORDING_FLUSH_INTERVAL_MS 100
+#define RECORDING_MAX_PENDING (64u << 20) // bytes waiting for the disk, past that the recording gives up instead of eating memory
+
+typedef struct RecordingWriter {
+    FILE* file; // NULL if not recording
+    pthread_mutex_t lock; // shards on every gateway thread write to the same file
+    pthread_cond_t wake;
+    pthread_t thread;
+    bool stopping;
+
+    char* pending; // records not handed to the writer thread yet
+    size_t pending_length;
+    size_t pending_capacity;
+    char* writing; // the batch the writer thread has, swapped with pending every round
+    size_t writing_capacity;
+
+    uint64_t last_us;
+    uint64_t frames;
+    bool failed; // a write didn't make it, nothing more gets written
+} RecordingWriter;
+
+typedef struct RecordingReader {
+    FILE* file;
+    uint32_t version;
+    uint32_t flags;
+    int shard_count;
+    uint64_t time_us; // of the last record read
+
+    char* data; // the last record's bytes, valid until the next call to Recording_Next
+    size_t capacity;
+} RecordingReader;
+
+typedef struct RecordedFrame {
+    uint64_t time_us; // since the recording started
+    int shard_id;
+    bool opened; // the shard connected again here, there's no data
+    const char* data;
+    size_t length;
+} RecordedFrame;
+
+int Recording_OpenWriter(RecordingWriter* writer, const char* path, uint32_t flags, int shard_count);
+void Recording_CloseWriter(RecordingWriter* writer);
+void Recording_Write(RecordingWriter* writer, int shard_id, const void* data, size_t length);
+void Recording_WriteOpened(RecordingWriter* writer, int shard_id); // after every successful connect
+
+int Recording_OpenReader(RecordingReader* reader, const char* path);
+void Recording_CloseReader(RecordingReader* reader);
+int Recording_Next(RecordingReader* reader, RecordedFrame* frame); // 1 for a frame, 0 at the end, -1 if the file is cut off or broken
+
+#endif //DISCORD_UTILS_RECORDING_H
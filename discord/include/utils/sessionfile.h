@@ -0,0 +1,41 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_SESSIONFILE_H
+#define DISCORD_UTILS_SESSIONFILE_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Gateway sessions saved in a memory mapped file so a restarted process can RESUME instead of identifying again.
+// Every shard has its own record and only its gateway thread writes it. The sequence number is one atomic store into the
+// mapping, session changes are written to a spare copy which then gets flipped in with another atomic store, so a process
+// that dies at any point leaves either the old or the new session behind and never half of each.
+// The kernel writes the pages back on its own, this survives crashes and kills but not a power cut.
+
+typedef struct SessionFileHeader SessionFileHeader;
+
+typedef struct SessionFile {
+    int fd;
+    SessionFileHeader* header; // the whole mapping, NULL if the file isn't open
+    size_t size;
+    int shard_count;
+} SessionFile;
+
+typedef struct SessionState {
+    char session_id[64];
+    char resume_host[128];
+    char resume_port[8];
+    long long last_seq;
+} SessionState;
+
+// Opens or creates the file. It gets wiped if it was made for a different shard count, those sessions can't be resumed anyway
+int SessionFile_Open(SessionFile* file, const char* path, int shard_count);
+void SessionFile_Close(SessionFile* file);
+
+bool SessionFile_Load(const SessionFile* file, int shard_id, SessionState* state); // false if there's no session for the shard
+
+void SessionFile_SaveSession(SessionFile* file, int shard_id, const char* session_id, const char* resume_host, const char* resume_port, long long last_seq);
+void SessionFile_SaveSeq(SessionFile* file, int shard_id, long long last_seq);
+void SessionFile_Clear(SessionFile* file, int shard_id); // the session is gone, next start has to identify
+
+#endif //DISCORD_UTILS_SESSIONFILE_H
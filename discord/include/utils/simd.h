@@ -0,0 +1,31 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_SIMD_H
+#define DISCORD_UTILS_SIMD_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Byte kernels for the websocket layer with SSE2 and AVX2 versions picked at runtime. Until Simd_Init runs (it does
+// in Discord_LibInit) the scalar versions are used, so calling these early is only slower, never wrong.
+
+typedef enum SimdLevel {
+    SIMD_LEVEL_SCALAR = 0,
+    SIMD_LEVEL_SSE2,
+    SIMD_LEVEL_AVX2,
+    SIMD_LEVEL_COUNT,
+} SimdLevel;
+
+void Simd_Init(void); // the best level the cpu has
+int Simd_SetLevel(SimdLevel level); // nonzero if the cpu can't do it, for benchmarks and for ruling out a kernel
+SimdLevel Simd_GetLevel(void);
+bool Simd_IsSupported(SimdLevel level);
+const char* Simd_LevelName(SimdLevel level);
+
+// RFC 3629: no overlongs, no surrogates, nothing past U+10FFFF, no sequence cut off at the end
+bool Simd_ValidateUtf8(const void* data, size_t length);
+
+// dst = src ^ mask repeated, dst and src can be the same. The mask starts at mask[0] at dst[0]
+void Simd_MaskCopy(void* dst, const void* src, size_t length, const unsigned char mask[4]);
+
+#endif //DISCORD_UTILS_SIMD_H
@@ -6,5 +6,6 @@
 #include <stdint.h>
 
 uint64_t NowMs(void);
+uint64_t NowUs(void);
 
 #endif //DISCORD_UTILS_TIME_H
\ No newline at end of file
@@ -0,0 +1,34 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_TLSCACHE_H
+#define DISCORD_UTILS_TLSCACHE_H 1
+
+#include "utils/histogram.h"
+
+#include <openssl/ssl.h>
+
+// Client side TLS session resumption. The last session (a TLS 1.2 ticket or a TLS 1.3 PSK ticket, whichever the server
+// sent) is kept per host:port and offered on the next connection there, so reconnects skip the full handshake.
+// Everything here is thread safe, REST and every gateway thread share one cache.
+
+#define TLS_CACHE_MAX_HOSTS 32 // past this the oldest host is forgotten. resume_gateway_url can name a new one every session
+
+// which directions the kernel does the record crypto for, with SSL_OP_ENABLE_KTLS on the context and the tls module
+// loaded. Without the module openssl just keeps doing it in userspace
+#define TLS_KTLS_SEND 0x1
+#define TLS_KTLS_RECV 0x2
+
+int TlsCache_Init(SSL_CTX* ctx); // turns on client session caching for ctx, nonzero if openssl won't
+void TlsCache_Destroy(void); // frees the cached sessions, before the SSL_CTX goes
+
+// SNI, the cached session for host:port and SSL_connect on a blocking socket. Returns what SSL_connect did
+int TlsCache_Connect(SSL* ssl, const char* host, const char* port);
+
+unsigned int TlsCache_GetKernelTls(SSL* ssl); // TLS_KTLS_ bits, only meaningful after the handshake
+void TlsCache_GetKernelTlsCounts(uint64_t* send, uint64_t* recv); // connections where kTLS took over each direction
+
+// handshake times in microseconds since TlsCache_Init, the counts are the number of full and resumed handshakes
+const Histogram* TlsCache_FullHandshakes(void);
+const Histogram* TlsCache_ResumedHandshakes(void);
+
+#endif //DISCORD_UTILS_TLSCACHE_H
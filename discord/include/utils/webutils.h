@@ -5,10 +5,15 @@
 
 #include "internal/memory.h"
 
+#include "utils/framebuffer.h"
+
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
+#include <zlib.h>
+
 #include <stdbool.h>
+#include <sys/types.h>
 
 #define DONT_SEND_CODE -1
 #define NORMAL_CLOSURE 1000
@@ -27,6 +32,14 @@
 #define BAD_GATEWAY 1014
 #define TLS_HANDSHAKE 1015
 
+// WS_Connect flags
+#define WS_PERMESSAGE_DEFLATE 0x1 // offer RFC 7692 permessage-deflate, messages the server compresses get inflated in WS_TryRecv
+#define WS_DEFLATE_SENDS 0x2 // compress what we send too if the server agreed to it, otherwise only receiving is compressed
+
+// a message past this, as sent or once inflated, closes the connection with MESSAGE_TOO_BIG before it's all allocated.
+// discord's biggest GUILD_CREATEs are a few MiB
+#define WS_DEFAULT_MAX_MESSAGE_SIZE (64u << 20)
+
 typedef struct HTTPClient {
     int sock;
     SSL_CTX* ctx;
@@ -34,6 +47,7 @@ typedef struct HTTPClient {
     char host[128];
     char port[8];
     bool connected;
+    unsigned int ktls; // TLS_KTLS_ bits, which directions the kernel took over for this connection
     char authorization[256];
 } HTTPClient;
 
@@ -42,10 +56,70 @@ typedef struct HTTPResponse {
     char* body;
 } HTTPResponse;
 
+// An upload body: head, then length bytes of fd from offset, then tail. The buffers are for whatever wraps the file,
+// like the multipart parts around it, and can be empty
+typedef struct HTTPFileBody {
+    const char* head;
+    size_t head_length;
+    int fd;
+    off_t offset;
+    size_t length;
+    const char* tail;
+    size_t tail_length;
+} HTTPFileBody;
+
 typedef struct WSClient {
     int sock;
     SSL* ssl;
-    int last_close_code;
+    int last_close_code; // what the server closed with, or 1007 if it sent text that wasn't utf-8 or didn't inflate
+    bool close_sent;
+    unsigned int ktls; // TLS_KTLS_ bits
+
+    bool nonblocking;
+    bool read_wants_write; // openssl has to write something before the read can go on
+    bool write_wants_read;
+
+    // received bytes not parsed yet. reads go through this in big chunks so a burst of small frames costs one
+    // SSL_read instead of a few per frame, whatever is left of a partial frame stays for the next WS_TryRecv
+    unsigned char* in;
+    size_t in_offset;
+    size_t in_length;
+
+    // the message being read. fragments are appended to it as they arrive and control frames can come in between them
+    FrameBuffer* message; // NULL between messages
+    unsigned char message_opcode; // text or binary, what the first fragment said
+    size_t max_message_size;
+
+    // the frame being read, its payload can come over several WS_TryRecv calls if the socket runs dry in the middle of it
+    bool in_frame;
+    unsigned char opcode;
+    bool fin;
+    bool masked;
+    unsigned char mask[4];
+    uint64_t payload_remaining;
+    size_t payload_start; // where this frame's payload begins in message, or in control
+    unsigned char control[125]; // control frames are never fragmented and never longer than this
+    size_t control_length;
+
+    // permessage-deflate, only set up when the server agreed to it in the handshake
+    bool deflate;
+    bool deflate_sends;
+    bool server_no_context_takeover; // every compressed message from the server starts with an empty window
+    bool client_no_context_takeover;
+    bool message_compressed; // rsv1 was set on the first frame of the message being read
+    z_stream inflater;
+    z_stream deflater;
+    unsigned char* deflated; // outgoing payloads get compressed into here before they're framed
+    size_t deflated_capacity;
+
+    unsigned char mask_pool[64]; // random bytes for the next outgoing masks
+    size_t mask_pool_offset;
+
+    // frames waiting to go out, nonblocking sockets queue everything here until WS_Flush
+    unsigned char* out;
+    size_t out_length;
+    size_t out_offset;
+    size_t out_capacity;
 } WSClient;
 
 int SSL_read_all(SSL* ssl, char* buf, int max);
@@ -57,10 +131,30 @@ void HTTP_SetAuthorization(HTTPClient* client, const char* authorization);
 
 HTTPResponse* HTTP_Request(HTTPClient* client, Arena* arena, const char* method, const char* path, const char* body);
 
-int WS_Connect(WSClient* client, SSL_CTX* ctx, const char* host, const char* port, const char* path);
+// Same with an HTTPFileBody as the body, for uploads. When kTLS does the sending the file part goes out with
+// SSL_sendfile and never comes through userspace, otherwise it's read and written a chunk at a time
+HTTPResponse* HTTP_RequestFile(HTTPClient* client, Arena* arena, const char* method, const char* path, const char* content_type,
+                               const HTTPFileBody* body);
+
+// Checks Sec-WebSocket-Accept and refuses extensions that weren't offered. flags are the WS_ ones above
+int WS_Connect(WSClient* client, SSL_CTX* ctx, const char* host, const char* port, const char* path, unsigned int flags);
 void WS_Disconnect(WSClient client, int code);
+void WS_SetMaxMessageSize(WSClient* client, size_t size); // 0 means WS_DEFAULT_MAX_MESSAGE_SIZE, never more than INT_MAX
+
+// After the handshake. Sends only get queued from then on, WS_Flush writes everything queued so far in one go and has
+// to be called again when the socket is writable if it couldn't
+int WS_SetNonBlocking(WSClient* client);
+int WS_Flush(WSClient* client); // 1 if something is still queued, 0 if everything went out, -1 on error
+bool WS_WantsWrite(const WSClient* client); // wait for the socket to be writable before calling WS_Flush or WS_TryRecv again
 
-int WS_SendText(WSClient* client, const char* text);
+int WS_SendText(WSClient* client, const char* text, size_t length); // -1 without sending anything if text isn't utf-8
+int WS_SendBinary(WSClient* client, const void* data, size_t length);
 int WS_RecvText(WSClient* client, char** out_payload, Arena* arena);
 
+// 1 when a whole message was read, 0 if the socket would block, -1 on close or error. Partial messages stay in the
+// client. Fragments are put back together, compressed messages are inflated and pings are answered in here, only text
+// and binary messages come out. Text that isn't valid utf-8 or a message that doesn't inflate closes the connection with 1007.
+// *out is null terminated and the caller owns the reference
+int WS_TryRecv(WSClient* client, FrameBuffer** out);
+
 #endif // DISCORD_UTILS_WEBUTILS_H
@@ -0,0 +1,42 @@
+// Copyright 2025 JesusTouchMe
+
+#ifndef DISCORD_UTILS_ZLIBSTREAM_H
+#define DISCORD_UTILS_ZLIBSTREAM_H 1
+
+#include "utils/framebuffer.h"
+
+#include <zlib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// One inflate context shared by every message on a connection, like the gateway's compress=zlib-stream wants.
+// Messages can be split over several websocket frames, only the last one ends with the 00 00 ff ff flush suffix.
+typedef struct ZlibStream {
+    z_stream stream;
+    bool initialized;
+
+    unsigned char* in; // compressed bytes of a message that hasn't seen its suffix yet
+    size_t in_length;
+    size_t in_capacity;
+
+    FrameBuffer* out; // reused for every message unless someone takes it, always null terminated
+
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} ZlibStream;
+
+int ZlibStream_Init(ZlibStream* z);
+void ZlibStream_Destroy(ZlibStream* z);
+
+// Call this for every new connection, the context can't carry over
+void ZlibStream_Reset(ZlibStream* z);
+
+// Returns 1 when a full message was inflated into *out (valid until the next call), 0 if it needs more frames and -1 on a zlib error
+int ZlibStream_Feed(ZlibStream* z, const void* data, size_t length, char** out, size_t* out_length);
+
+// Hands the buffer of the last inflated message to the caller so it can outlive the next Feed
+FrameBuffer* ZlibStream_TakeOutput(ZlibStream* z);
+
+#endif //DISCORD_UTILS_ZLIBSTREAM_H
@@ -2,39 +2,157 @@
 
 #include "internal/memory.h"
 
+#include "utils/etf.h"
+#include "utils/histogram.h"
+#include "utils/identifyscheduler.h"
+#include "utils/log.h"
+#include "utils/net.h"
+#include "utils/reactor.h"
+#include "utils/recording.h"
+#include "utils/sessionfile.h"
+#include "utils/simd.h"
 #include "utils/time.h"
+#include "utils/tlscache.h"
 #include "utils/webutils.h"
+#include "utils/zlibstream.h"
 
 #include "discord.h"
 
+#include <openssl/rand.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <unistd.h>
 
+#define IDENTIFY_WINDOW_MS 5000
+#define IDENTIFY_CONNECT_LEAD_MS 1000 // cold start connects this much before the shard's identify slot so HELLO is already there
+#define MAX_FRAMES_PER_WAKEUP 64 // then the other connections on the reactor get a turn
+#define INITIAL_TOKENS_PER_KIB 128
+#define INVALID_SESSION_MIN_DELAY_MS 1000 // discord wants a random 1-5 second wait before identifying again
+#define INVALID_SESSION_MAX_DELAY_MS 5000
+#define RECONNECT_MIN_DELAY_MS 1000 // after the first failed connect, it doubles with every one after that
+#define RECONNECT_MAX_DELAY_MS 60000
+#define RESUME_MAX_FAILURES 3 // failed connects to the resume host in a row before the session is given up
+
+// one reactor thread, it owns every shard assigned to it
+typedef struct GatewayThread {
+    Reactor reactor;
+    pthread_t thread;
+    int live_shards;
+} GatewayThread;
+
+typedef struct Shard {
+    int id;
+    GatewayThread* thread;
+
+    ReactorHandle socket_handle;
+    ReactorHandle heartbeat_timer;
+    ReactorHandle connect_timer;
+    ReactorHandle identify_timer; // armed between HELLO and the shard's identify slot
+    ReactorHandle handshake_timer; // the handshake thread fires it when it's done, so the rest happens on the reactor
+
+    WSClient ws_client;
+    bool running;
+    bool finished;
+    bool connect_pending; // connect_timer is armed, so not running doesn't mean the shard is done
+    bool connecting; // handshake_thread owns ws_client until handshake_timer fires
+    pthread_t handshake_thread;
+    const char* connect_host;
+    const char* connect_port;
+    int handshake_result; // what WS_Connect returned, written by handshake_thread
+    bool resuming; // answer HELLO with RESUME instead of IDENTIFY
+    bool replaying; // fed from a recording by Discord_Replay, there's no connection behind it
+    int connect_failures; // in a row, sizes the wait before the next try
+
+    char session_id[64];
+    char resume_host[128];
+    char resume_port[8];
+
+    int heartbeat_interval;
+    long long last_seq;
+
+    uint64_t heartbeat_sent_at; // NowUs of the last heartbeat, 0 if none went out on this connection yet
+    bool heartbeat_acked;
+    atomic_int_fast64_t latency; // last round trip in microseconds, -1 until the first ACK
+
+    ZlibStream inflater;
+    EtfWriter writer;
+    uint64_t bytes_received;
+    uint64_t bytes_decoded;
+    uint64_t events_skipped; // dispatches dropped by the pre-scan, nothing wanted them
+    uint64_t bytes_skipped;
+
+    unsigned int tokens_per_kib; // density of the last frame, sizes the token array of the next one
+} Shard;
+
 SSL_CTX* g_ssl_ctx = NULL;
 static char g_gateway_host[128];
 static char g_gateway_port[8] = "443";
-static WSClient g_ws_client;
+static bool g_gateway_overridden = false; // Discord_SetGatewayHost was called, /gateway/bot's url is ignored
 
 static char g_token[256];
 static intents_t g_intents = 0;
+static int g_event_thread_count = 0;
+static char g_session_file_path[512];
+static SessionFile g_session_file = {.fd = -1};
+static char g_record_file_path[512];
+static RecordingWriter g_recorder;
+static EventDispatchMode g_event_dispatch_mode = EVENT_DISPATCH_ANY;
+static bool g_compress = false;
+static GatewayEncoding g_encoding = GATEWAY_ENCODING_JSON;
+static size_t g_max_message_size = 0;
+static char g_gateway_path[64];
+
+static Shard* g_shards = NULL;
+static int g_shard_count = 0; // 0 means use whatever /gateway/bot recommends
+static int g_max_concurrency = 1;
+static int g_session_start_total = -1; // session_start_limit from /gateway/bot, -1 if it wasn't there
+static int g_session_start_remaining = -1;
+static uint64_t g_session_start_reset_after = 0;
+static IdentifyScheduler g_identify_scheduler;
+
+static Histogram g_heartbeat_latency;
+
+static GatewayThread* g_gateway_threads = NULL;
+static int g_gateway_thread_count = 1;
+
+static Arena g_event_arena;
 
-static char g_session_id[64];
-static char g_gateway_resume_host[128];
-static char g_gateway_resume_port[8] = "443";
+// event handlers, indexed by GatewayEventType
+static EventCallbackFn g_callbacks[GATEWAY_EVENT_COUNT];
 
-static bool g_send_heartbeats = false;
-static int g_heartbeat_interval = 0;
-static long long g_last_seq = 0;
-static volatile bool g_running = false;
+static void DisconnectGateway(Shard* shard, int code);
 
-static Arena g_event_arena;
+static int ParseGatewayUrl(const char* url, char* host, size_t host_size, char* port, size_t port_size) {
+    if (strncmp(url, "wss://", 6) == 0) {
+        url += 6;
+        snprintf(port, port_size, "443");
+    } else {
+        url += 5;
+        snprintf(port, port_size, "80");
+    }
 
-// event handlers
-static OnReadyFn g_on_ready = NULL;
-static OnMessageCreateFn g_on_message_create = NULL;
+    const char* slash = strchr(url, '/');
+    size_t host_len = slash != NULL ? (size_t) (slash - url) : strlen(url);
+    if (host_len >= host_size) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "host_len is bigger than the host buffer. this should IMMEDIATELY be reported and fixed!");
+        return 1;
+    }
 
-static void DisconnectGateway(int code);
+    memcpy(host, url, host_len);
+    host[host_len] = '\0';
+
+    char* colon = strchr(host, ':');
+    if (colon) {
+        *colon = '\0';
+        strncpy(port, colon + 1, port_size - 1);
+        port[port_size - 1] = '\0';
+    }
+
+    return 0;
+}
 
 void Discord_LibInit(void) {
     SSL_library_init();
@@ -43,89 +161,100 @@ void Discord_LibInit(void) {
 
     g_ssl_ctx = SSL_CTX_new(TLS_client_method());
     g_event_arena = ArenaCreate(0);
+    Log_Init(0);
+    if (TlsCache_Init(g_ssl_ctx) != 0) LOG(LOG_CATEGORY_CORE, LOG_LEVEL_WARN, "no tls session cache, every connect does a full handshake");
+    Simd_Init();
+    LOG(LOG_CATEGORY_CORE, LOG_LEVEL_DEBUG, "using %s websocket kernels", Simd_LevelName(Simd_GetLevel()));
+    Histogram_Init(&g_heartbeat_latency);
+    GatewayEvent_InitTable();
 
     if (DiscordAPI_Init() != 0) {
         exit(1);
     }
+}
 
-    HTTPResponse* res = DiscordAPI_SendRequest(&g_event_arena, "GET", "/api/v10/gateway", "");
-    if (res == NULL) {
-        printf("Cannot get gateway url from API\n");
-        exit(1);
-    }
-
-    const char* json = res->body;
-
-    jsmn_parser parser;
-    jsmn_init(&parser);
-
-    int token_count = jsmn_parse(&parser, json, strlen(json), NULL, 0);
-    jsmntok_t* tokens = ArenaAlloc(&g_event_arena, token_count * sizeof(jsmntok_t));
-    jsmn_init(&parser);
-    int err = jsmn_parse(&parser, json, strlen(json), tokens, token_count);
-
-    if (err < 0) {
-        printf("json error: %d\n", err);
-        exit(1);
-    } else if (err != token_count) {
-        printf("json token count mismatch: %d != %d\n", err, token_count);
-        exit(1);
-    }
-
+static int ReadGatewayInfo(const char* json, const jsmntok_t* tokens) {
     if (tokens[0].type != JSMN_OBJECT) {
-        printf("bad response from /gateway (response is not object)\n");
-        exit(1);
+        LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "bad response from /gateway/bot (response is not object)");
+        return 1;
     }
 
     JsonObject url_obj = jsmn_find_key(json, tokens, 0, "url");
     if (url_obj == JSON_NULL || tokens[url_obj].type != JSMN_STRING) {
-        printf("bad response from /gateway (url is not string)\n");
-        exit(1);
+        LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "bad response from /gateway/bot (url is not string)");
+        return 1;
     }
 
     char url_container[2048];
     jsmn_copy_string(json, tokens, url_obj, url_container, sizeof(url_container));
 
-    const char* url = url_container;
-
-    if (strncmp(url, "wss://", 6) == 0) {
-        url += 6;
-        strcpy(g_gateway_port, "443");
-    } else {
-        url += 5;
-        strcpy(g_gateway_port, "80");
+    if (!g_gateway_overridden && ParseGatewayUrl(url_container, g_gateway_host, sizeof(g_gateway_host), g_gateway_port, sizeof(g_gateway_port)) != 0) {
+        return 1;
     }
 
-    const char* slash = strchr(url, '/');
-    if (slash != NULL) {
-        size_t host_len = slash - url;
-        if (host_len >= sizeof(g_gateway_host)) {
-            printf("host_len is bigger than g_gateway_host. this should IMMEDIATELY be reported and fixed!\n");
-            exit(1);
+    JsonObject shards = jsmn_find_key(json, tokens, 0, "shards");
+    if (g_shard_count <= 0) {
+        g_shard_count = 1;
+        if (shards != JSON_NULL && tokens[shards].type == JSMN_PRIMITIVE) {
+            int recommended = atoi(json + tokens[shards].start);
+            if (recommended > 0) g_shard_count = recommended;
         }
+    }
 
-        strncpy(g_gateway_host, url, host_len);
-        g_gateway_host[host_len] = '\0';
-    } else {
-        strncpy(g_gateway_host, url, sizeof(g_gateway_host) - 1);
-        g_gateway_host[strlen(url)] = '\0';
+    JsonObject max_concurrency = jsmn_find_path(json, tokens, 0, "session_start_limit.max_concurrency");
+    if (max_concurrency != JSON_NULL && tokens[max_concurrency].type == JSMN_PRIMITIVE) {
+        g_max_concurrency = atoi(json + tokens[max_concurrency].start);
+        if (g_max_concurrency <= 0) g_max_concurrency = 1;
     }
 
-    char* colon = strchr(g_gateway_host, ':');
-    if (colon) {
-        *colon = '\0';
-        strncpy(g_gateway_port, colon + 1, sizeof(g_gateway_port) - 1);
-        g_gateway_port[sizeof(g_gateway_port) - 1] = '\0';
+    JsonObject total = jsmn_find_path(json, tokens, 0, "session_start_limit.total");
+    JsonObject remaining = jsmn_find_path(json, tokens, 0, "session_start_limit.remaining");
+    JsonObject reset_after = jsmn_find_path(json, tokens, 0, "session_start_limit.reset_after");
+    if (total != JSON_NULL && remaining != JSON_NULL && tokens[total].type == JSMN_PRIMITIVE && tokens[remaining].type == JSMN_PRIMITIVE) {
+        g_session_start_total = atoi(json + tokens[total].start);
+        g_session_start_remaining = atoi(json + tokens[remaining].start);
+        if (reset_after != JSON_NULL && tokens[reset_after].type == JSMN_PRIMITIVE) {
+            g_session_start_reset_after = strtoull(json + tokens[reset_after].start, NULL, 10);
+        }
     }
+
+    return 0;
 }
 
-void Discord_LibShutdown(void) {
-    if (g_running) {
-        DisconnectGateway(GOING_AWAY);
+// /gateway/bot needs the token, so this runs from Discord_Run instead of Discord_LibInit
+static int FetchGatewayInfo(void) {
+    HTTPResponse* res = DiscordAPI_SendRequest(&g_event_arena, "GET", "/api/v10/gateway/bot", "");
+    if (res == NULL) {
+        LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "Cannot get gateway url from API");
+        return 1;
+    }
+
+    if (res->code != 200) {
+        LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "bad response from /gateway/bot: code=%d, body:\n%s", res->code, res->body);
+        return 1;
     }
 
+    const char* json = res->body;
+
+    jsmntok_t* tokens = NULL;
+    unsigned int capacity = 0;
+
+    int token_count = jsmn_parse_growable(json, strlen(json), &tokens, &capacity);
+    if (token_count <= 0) {
+        LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "json error: %d", token_count);
+        HeapFree(tokens);
+        return 1;
+    }
+
+    int err = ReadGatewayInfo(json, tokens);
+    HeapFree(tokens);
+    return err;
+}
+
+void Discord_LibShutdown(void) {
     DiscordAPI_Shutdown();
 
+    TlsCache_Destroy();
     SSL_CTX_free(g_ssl_ctx);
     ArenaDestroy(g_event_arena);
 
@@ -133,6 +262,8 @@ void Discord_LibShutdown(void) {
     ERR_free_strings();
     CRYPTO_cleanup_all_ex_data();
     CONF_modules_unload(1);
+
+    Log_Shutdown();
 }
 
 void Discord_SetToken(const char* token) {
@@ -145,6 +276,77 @@ void Discord_SetToken(const char* token) {
     DiscordAPI_SetAuth(auth);
 }
 
+void Discord_SetEventThreadCount(int thread_count) {
+    g_event_thread_count = thread_count;
+}
+
+void Discord_SetEventDispatchMode(EventDispatchMode mode) {
+    g_event_dispatch_mode = mode;
+}
+
+void Discord_SetSessionFile(const char* path) {
+    if (path == NULL) g_session_file_path[0] = '\0';
+    else snprintf(g_session_file_path, sizeof(g_session_file_path), "%s", path);
+}
+
+void Discord_SetRestHost(const char* host, const char* port) {
+    DiscordAPI_SetHost(host, port);
+}
+
+void Discord_SetGatewayHost(const char* host, const char* port) {
+    g_gateway_overridden = host != NULL;
+    if (host == NULL) return;
+
+    snprintf(g_gateway_host, sizeof(g_gateway_host), "%s", host);
+    snprintf(g_gateway_port, sizeof(g_gateway_port), "%s", port != NULL ? port : "443");
+}
+
+void Discord_SetKernelTls(bool enable) {
+#ifdef SSL_OP_ENABLE_KTLS
+    if (enable) SSL_CTX_set_options(g_ssl_ctx, SSL_OP_ENABLE_KTLS);
+    else SSL_CTX_clear_options(g_ssl_ctx, SSL_OP_ENABLE_KTLS);
+#else
+    if (enable) LOG(LOG_CATEGORY_CORE, LOG_LEVEL_WARN, "this openssl can't do kTLS, staying in userspace");
+#endif
+}
+
+void Discord_SetConnectTimeout(int timeout_ms) {
+    Net_SetConnectTimeout(timeout_ms);
+}
+
+void Discord_SetDnsTtl(int ttl_ms) {
+    Net_SetDnsTtl(ttl_ms);
+}
+
+void Discord_SetRecordFile(const char* path) {
+    if (path == NULL) g_record_file_path[0] = '\0';
+    else snprintf(g_record_file_path, sizeof(g_record_file_path), "%s", path);
+}
+
+void Discord_SetGatewayCompression(bool compress) {
+    g_compress = compress;
+}
+
+void Discord_SetGatewayEncoding(GatewayEncoding encoding) {
+    g_encoding = encoding;
+}
+
+void Discord_SetGatewayMaxMessageSize(size_t size) {
+    g_max_message_size = size;
+}
+
+void Discord_SetGatewayThreadCount(int thread_count) {
+    g_gateway_thread_count = thread_count;
+}
+
+void Discord_SetShardCount(int shard_count) {
+    g_shard_count = shard_count;
+}
+
+int Discord_GetShardCount(void) {
+    return g_shard_count;
+}
+
 void Discord_SetIntents(intents_t intents) {
     g_intents = intents;
 }
@@ -157,147 +359,357 @@ void Discord_RemoveIntent(intents_t intent) {
     g_intents &= ~intent;
 }
 
+EventCallbackFn Discord_GetCallback(GatewayEventType type) {
+    if ((unsigned int) type >= GATEWAY_EVENT_COUNT) return NULL;
+    return g_callbacks[type];
+}
+
+void Discord_SetCallback(GatewayEventType type, EventCallbackFn callback) {
+    if (type == GATEWAY_EVENT_UNKNOWN || (unsigned int) type >= GATEWAY_EVENT_COUNT) return;
+    g_callbacks[type] = callback;
+}
+
 OnReadyFn Discord_OnReady(void) {
-    return g_on_ready;
+    return (OnReadyFn) g_callbacks[GATEWAY_EVENT_READY];
 }
 
 OnMessageCreateFn Discord_OnmessageCreate(void) {
-    return g_on_message_create;
+    return (OnMessageCreateFn) g_callbacks[GATEWAY_EVENT_MESSAGE_CREATE];
 }
 
 void Discord_SetOnReady(OnReadyFn callback) {
-    g_on_ready = callback;
+    g_callbacks[GATEWAY_EVENT_READY] = (EventCallbackFn) callback;
 }
 
 void Discord_SetOnMessageCreate(OnMessageCreateFn callback) {
-    g_on_message_create = callback;
+    g_callbacks[GATEWAY_EVENT_MESSAGE_CREATE] = (EventCallbackFn) callback;
+}
+
+static void BuildGatewayPath(void) {
+    snprintf(g_gateway_path, sizeof(g_gateway_path), "/?v=10&encoding=%s%s",
+             g_encoding == GATEWAY_ENCODING_ETF ? "etf" : "json",
+             g_compress ? "&compress=zlib-stream" : "");
+}
+
+static void OnGatewaySocket(Reactor* reactor, ReactorHandle* handle, uint32_t events);
+static void UpdateShard(Shard* shard);
+
+// the next connect identifies, now and after a restart
+static void ForgetSession(Shard* shard) {
+    shard->session_id[0] = '\0';
+    shard->last_seq = 0;
+    SessionFile_Clear(&g_session_file, shard->id);
 }
 
-static void ConnectGateway() {
-    if (WS_Connect(&g_ws_client, g_ssl_ctx, g_gateway_host, g_gateway_port, "/?v=10&encoding=json") != 0) {
-        g_running = false;
+// the connect didn't work out, so try again later instead of giving the shard up. Only the upper half of the wait is
+// random so shards that lost the same network don't all come back at once
+static void RetryGateway(Shard* shard) {
+    shard->running = false;
+
+    // resume_gateway_url can stop working, one from an old session file especially. The main gateway is always there
+    if (shard->resuming && shard->connect_failures + 1 >= RESUME_MAX_FAILURES) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_WARN, "[WS %d] couldn't reach %s:%s to resume %d times, identifying on %s:%s instead",
+            shard->id, shard->resume_host, shard->resume_port, RESUME_MAX_FAILURES, g_gateway_host, g_gateway_port);
+        ForgetSession(shard);
+        shard->connect_failures = 0;
+
+        // OnConnectTimer identifies now that there's no session
+        shard->connect_pending = true;
+        Reactor_ArmTimer(&shard->connect_timer, 0, 0);
         return;
     }
-    g_running = true;
+
+    int doublings = shard->connect_failures < 16 ? shard->connect_failures : 16;
+    uint64_t base = (uint64_t) RECONNECT_MIN_DELAY_MS << doublings;
+    if (base > RECONNECT_MAX_DELAY_MS) base = RECONNECT_MAX_DELAY_MS;
+    shard->connect_failures++;
+
+    uint32_t random = 0;
+    RAND_bytes((unsigned char*) &random, sizeof(random));
+    uint64_t delay = base / 2 + random % (base / 2 + 1);
+
+    LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_WARN, "[WS %d] couldn't connect (%d in a row), trying again in %llu ms", shard->id,
+        shard->connect_failures, (unsigned long long) delay);
+
+    // OnConnectTimer resumes if there's a session to resume
+    shard->connect_pending = true;
+    Reactor_ArmTimer(&shard->connect_timer, delay, 0);
+}
+
+// DNS, the connect race, TLS and the upgrade all block, up to the connect timeout, so they get a thread of their own
+// instead of stalling every other shard on the reactor. Nothing else touches ws_client until handshake_timer fires
+static void* HandshakeThreadMain(void* arg) {
+    Shard* shard = arg;
+
+    // without zlib-stream permessage-deflate is offered instead, a gateway that doesn't do it just answers without it
+    shard->handshake_result = WS_Connect(&shard->ws_client, g_ssl_ctx, shard->connect_host, shard->connect_port, g_gateway_path,
+                                         g_compress ? 0 : WS_PERMESSAGE_DEFLATE);
+
+    // timerfd_settime is a syscall, everything above is visible to the reactor thread once it sees the timer
+    Reactor_ArmTimer(&shard->handshake_timer, 0, 0);
+    return NULL;
+}
+
+// the connect finishes in OnHandshakeTimer, running stays false until then
+static bool OpenGateway(Shard* shard, const char* host, const char* port) {
+    if (shard->replaying || shard->connecting) return false;
+
+    ZlibStream_Reset(&shard->inflater);
+    Reactor_DisarmTimer(&shard->heartbeat_timer);
+    shard->heartbeat_sent_at = 0;
+    shard->heartbeat_acked = true;
+
+    shard->running = false;
+    shard->connect_host = host;
+    shard->connect_port = port;
+    shard->connecting = true;
+
+    if (pthread_create(&shard->handshake_thread, NULL, HandshakeThreadMain, shard) != 0) {
+        shard->connecting = false;
+        RetryGateway(shard);
+        return false;
+    }
+
+    return true;
 }
 
-static void ResumeGateway() {
-    if (WS_Connect(&g_ws_client, g_ssl_ctx, g_gateway_resume_host, g_gateway_resume_port, "/?v=10&encoding=json") != 0) {
-        g_running = false;
+static void OnHandshakeTimer(Reactor* reactor, ReactorHandle* handle, uint32_t events) {
+    Shard* shard = handle->userdata;
+    if (!shard->connecting) return;
+
+    pthread_join(shard->handshake_thread, NULL); // it's done apart from returning
+    shard->connecting = false;
+
+    if (shard->handshake_result != 0) {
+        RetryGateway(shard);
+        UpdateShard(shard);
+        return;
+    }
+
+    WS_SetMaxMessageSize(&shard->ws_client, g_max_message_size);
+
+    if (WS_SetNonBlocking(&shard->ws_client) != 0 ||
+        Reactor_Add(&shard->thread->reactor, &shard->socket_handle, shard->ws_client.sock, EPOLLIN, OnGatewaySocket, shard) != 0) {
+        WS_Disconnect(shard->ws_client, GOING_AWAY);
+        RetryGateway(shard);
+        UpdateShard(shard);
         return;
     }
 
-    char payload[1024];
-    snprintf(payload, sizeof(payload), "{\"op\":6,\"d\":{\"token\":\"%s\",\"session_id\":\"%s\",\"seq\":%lld}}", g_token, g_session_id, g_last_seq);
+    shard->connect_failures = 0;
+
+    // a replay needs to know where the zlib-stream starts over
+    if (g_recorder.file != NULL) Recording_WriteOpened(&g_recorder, shard->id);
 
-    WS_SendText(&g_ws_client, payload);
+    shard->running = true;
+    UpdateShard(shard);
+}
 
-    g_running = true;
+static void ConnectGateway(Shard* shard) {
+    shard->resuming = false;
+    OpenGateway(shard, g_gateway_host, g_gateway_port);
 }
 
-static void DisconnectGateway(int code) {
-    WS_Disconnect(g_ws_client, code);
-    g_running = false;
+// RESUME goes out when HELLO arrives
+static void ResumeGateway(Shard* shard) {
+    shard->resuming = true;
+    OpenGateway(shard, shard->resume_host, shard->resume_port);
 }
 
-static void SendHeartbeat() {
+static void SendResume(Shard* shard) {
+    if (g_encoding == GATEWAY_ENCODING_ETF) {
+        EtfWriter* w = &shard->writer;
+        EtfWriter_Reset(w);
+        etf_write_map_header(w, 2);
+        etf_write_string(w, "op");
+        etf_write_integer(w, 6);
+        etf_write_string(w, "d");
+        etf_write_map_header(w, 3);
+        etf_write_string(w, "token");
+        etf_write_string(w, g_token);
+        etf_write_string(w, "session_id");
+        etf_write_string(w, shard->session_id);
+        etf_write_string(w, "seq");
+        etf_write_integer(w, shard->last_seq);
+        WS_SendBinary(&shard->ws_client, w->data, w->length);
+    } else {
+        char payload[1024];
+        int length = snprintf(payload, sizeof(payload), "{\"op\":6,\"d\":{\"token\":\"%s\",\"session_id\":\"%s\",\"seq\":%lld}}", g_token, shard->session_id, shard->last_seq);
+
+        WS_SendText(&shard->ws_client, payload, (size_t) length);
+    }
+}
+
+static void DisconnectGateway(Shard* shard, int code) {
+    if (shard->replaying) {
+        // there's no reconnect to reset it, and after an inflate error it would stay dead for the rest of the replay
+        ZlibStream_Reset(&shard->inflater);
+        shard->running = false;
+        return;
+    }
+
+    Reactor_Remove(&shard->thread->reactor, &shard->socket_handle);
+    Reactor_DisarmTimer(&shard->heartbeat_timer);
+    Reactor_DisarmTimer(&shard->identify_timer);
+
+    WS_Disconnect(shard->ws_client, code);
+    shard->running = false;
+}
+
+static void SendHeartbeat(Shard* shard) {
+    shard->heartbeat_sent_at = NowUs();
+    shard->heartbeat_acked = false;
+
+    if (g_encoding == GATEWAY_ENCODING_ETF) {
+        EtfWriter* w = &shard->writer;
+        EtfWriter_Reset(w);
+        etf_write_map_header(w, 2);
+        etf_write_string(w, "op");
+        etf_write_integer(w, 1);
+        etf_write_string(w, "d");
+        etf_write_integer(w, shard->last_seq);
+        WS_SendBinary(&shard->ws_client, w->data, w->length);
+        return;
+    }
+
     char payload[128];
-    snprintf(payload, sizeof(payload), "{\"op\":1,\"d\":%lld} ", g_last_seq);
-    WS_SendText(&g_ws_client, payload);
+    int length = snprintf(payload, sizeof(payload), "{\"op\":1,\"d\":%lld}", shard->last_seq);
+    WS_SendText(&shard->ws_client, payload, (size_t) length);
 }
 
-static void HandleEvent(Event* event) {
-    const char* json = event->json;
-    const jsmntok_t* tokens = event->tokens;
-    JsonObject t = event->t;
+static void SendIdentify(Shard* shard) {
+    if (g_encoding == GATEWAY_ENCODING_ETF) {
+        EtfWriter* w = &shard->writer;
+        EtfWriter_Reset(w);
+        etf_write_map_header(w, 2);
+        etf_write_string(w, "op");
+        etf_write_integer(w, 2);
+        etf_write_string(w, "d");
+        etf_write_map_header(w, 6);
+        etf_write_string(w, "token");
+        etf_write_string(w, g_token);
+        etf_write_string(w, "intents");
+        etf_write_unsigned(w, g_intents);
+        etf_write_string(w, "properties");
+        etf_write_map_header(w, 3);
+        etf_write_string(w, "os");
+        etf_write_string(w, "linux");
+        etf_write_string(w, "browser");
+        etf_write_string(w, "gambler");
+        etf_write_string(w, "device");
+        etf_write_string(w, "gambler");
+        etf_write_string(w, "compress");
+        etf_write_bool(w, false);
+        etf_write_string(w, "shard");
+        etf_write_list_header(w, 2);
+        etf_write_integer(w, shard->id);
+        etf_write_integer(w, g_shard_count);
+        etf_write_nil(w);
+        etf_write_string(w, "presence");
+        etf_write_map_header(w, 1);
+        etf_write_string(w, "status");
+        etf_write_string(w, "online");
+        WS_SendBinary(&shard->ws_client, w->data, w->length);
+        return;
+    }
+
+    char identify[1024];
+    int length = snprintf(identify, sizeof(identify),
+             "{\"op\":2,\"d\":{\"token\":\"%s\",\"intents\":%lu,\"properties\":{\"os\":\"linux\",\"browser\":\"gambler\",\"device\":\"gambler\"},\"compress\":false,\"shard\":[%d,%d],\"presence\":{\"status\":\"online\"}}}",
+             g_token, g_intents, shard->id, g_shard_count);
+
+    WS_SendText(&shard->ws_client, identify, (size_t) length);
+}
+
+static void HandleEvent(Shard* shard, Event* event) {
     JsonObject d = event->d;
 
-    if (t == JSON_NULL || d == JSON_NULL || tokens[t].type != JSMN_STRING) {
-        DisconnectGateway(UNSUPPORTED_DATA);
+    if (event->t == JSON_NULL || d == JSON_NULL) {
+        Event_Free(event);
+        DisconnectGateway(shard, UNSUPPORTED_DATA);
         return;
     }
 
-    if (jsoneq(json, tokens[t], "READY")) {
-        if (tokens[d].type != JSMN_OBJECT) {
-            DisconnectGateway(UNSUPPORTED_DATA);
+    event->type = Event_LookupType(event);
+
+    if (event->type == GATEWAY_EVENT_READY) {
+        if (!Event_IsObject(event, d)) {
+            Event_Free(event);
+            DisconnectGateway(shard, UNSUPPORTED_DATA);
             return;
         }
 
-        JsonObject session_id = jsmn_find_key(json, tokens, d, "session_id");
-        JsonObject resume_gateway_url = jsmn_find_key(json, tokens, d, "resume_gateway_url");
+        JsonObject session_id = Event_FindKey(event, d, "session_id");
+        JsonObject resume_gateway_url = Event_FindKey(event, d, "resume_gateway_url");
 
-        if (session_id == JSON_NULL || resume_gateway_url == JSON_NULL) {
-            DisconnectGateway(UNSUPPORTED_DATA);
+        char url_container[2048];
+        if (Event_GetString(event, session_id, shard->session_id, sizeof(shard->session_id)) != 0 ||
+            Event_GetString(event, resume_gateway_url, url_container, sizeof(url_container)) != 0) {
+            Event_Free(event);
+            DisconnectGateway(shard, UNSUPPORTED_DATA);
             return;
         }
 
-        if (tokens[session_id].type != JSMN_STRING || tokens[resume_gateway_url].type != JSMN_STRING) {
-            DisconnectGateway(UNSUPPORTED_DATA);
+        if (ParseGatewayUrl(url_container, shard->resume_host, sizeof(shard->resume_host), shard->resume_port, sizeof(shard->resume_port)) != 0) {
+            Event_Free(event);
+            DisconnectGateway(shard, INTERNAL_ERROR);
             return;
         }
 
-        jsmn_copy_string(json, tokens, session_id, g_session_id, sizeof(g_session_id));
-
-        char url_container[2048];
-        jsmn_copy_string(json, tokens, resume_gateway_url, url_container, sizeof(url_container));
+        SessionFile_SaveSession(&g_session_file, shard->id, shard->session_id, shard->resume_host, shard->resume_port, shard->last_seq);
+    }
 
-        const char* url = url_container;
+    if (!EventLoop_WantsEvent(event->type)) {
+        Event_Free(event);
+        return;
+    }
 
-        if (strncmp(url, "wss://", 6) == 0) {
-            url += 6;
-            strcpy(g_gateway_resume_port, "433");
-        } else {
-            url += 5;
-            strcpy(g_gateway_resume_port, "80");
-        }
+    EventLoop_Enqueue(event);
+}
 
-        const char* slash = strchr(url, '/');
-        if (slash != NULL) {
-            size_t host_len = slash - url;
-            if (host_len >= sizeof(g_gateway_resume_host)) {
-                printf("host_len is bigger than g_gateway_resume_host. this should IMMEDIATELY be reported and fixed!\n");
-                DisconnectGateway(INTERNAL_ERROR);
-                return;
-            }
+// Guesses how many tokens a frame has from the ones before it. Too few only costs a realloc
+static int EstimateTokens(const Shard* shard, size_t length) {
+    uint64_t estimate = (uint64_t) length * shard->tokens_per_kib / 1024;
+    return (int) (estimate + estimate / 4 + 16);
+}
 
-            strncpy(g_gateway_resume_host, url, host_len);
-            g_gateway_resume_host[host_len] = '\0';
-        } else {
-            strncpy(g_gateway_resume_host, url, sizeof(g_gateway_resume_host) - 1);
-            g_gateway_resume_host[sizeof(g_gateway_resume_host) - 1] = '\0';
-        }
+static void UpdateTokenDensity(Shard* shard, int token_count, size_t length) {
+    if (length < 256) return; // heartbeat acks and such say nothing about the dispatches
+    shard->tokens_per_kib = (unsigned int) ((uint64_t) token_count * 1024 / length) + 1;
+}
 
-        char *colon = strchr(g_gateway_resume_host, ':');
-        if (colon) {
-            *colon = '\0';
-            strncpy(g_gateway_resume_port, colon + 1, sizeof(g_gateway_resume_port) - 1);
-            g_gateway_resume_port[sizeof(g_gateway_resume_port) - 1] = '\0';
-        }
-    }
+// Tokenizes a json frame straight into a new event and fills in its t/d. The event takes the frame, NULL on error.
+// One pass: when jsmn runs out of tokens the event grows and jsmn continues from where it stopped
+static Event* DecodeJson(Shard* shard, FrameBuffer* frame, int* op) {
+    const char* json = frame->data;
+    size_t length = frame->length;
 
-    EventLoop_Enqueue(event);
-}
+    int capacity = EstimateTokens(shard, length);
+    Event* event = Event_Create(frame, GATEWAY_ENCODING_JSON, capacity);
 
-static void HandleGatewayEvent(const char* json) {
     jsmn_parser parser;
     jsmn_init(&parser);
 
-    int token_count = jsmn_parse(&parser, json, strlen(json), NULL, 0);
-    jsmntok_t* tokens = ArenaAlloc(&g_event_arena, token_count * sizeof(jsmntok_t));
-    jsmn_init(&parser);
-    int err = jsmn_parse(&parser, json, strlen(json), tokens, token_count);
+    int token_count;
+    while ((token_count = jsmn_parse(&parser, json, length, (jsmntok_t*) event->tokens, capacity)) == JSMN_ERROR_NOMEM) {
+        capacity *= 2;
+        event = Event_Grow(event, capacity);
+    }
 
-    if (err < 0) {
-        printf("json error: %d\n", err);
-        return;
-    } else if (err != token_count) {
-        printf("json token count mismatch: %d != %d\n", err, token_count);
-        return;
+    if (token_count <= 0) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "json error: %d", token_count);
+        Event_Free(event);
+        return NULL;
     }
 
-    int op = -1;
-    JsonObject t = JSON_NULL;
-    JsonObject d = JSON_NULL;
+    UpdateTokenDensity(shard, token_count, length);
+
+    const jsmntok_t* tokens = event->tokens;
+
+    if (tokens[0].type != JSMN_OBJECT) {
+        Event_Free(event);
+        return NULL;
+    }
 
     // don't use the jsmn extensions from jsonutils because this is faster
     int i = 1;
@@ -308,14 +720,14 @@ static void HandleGatewayEvent(const char* json) {
 
             if (len == 2 && strncmp(key, "op", 2) == 0) {
                 jsmntok_t v = tokens[i + 1];
-                op = atoi(json + v.start);
+                *op = atoi(json + v.start);
             } else if (len == 1 && *key == 't') {
-                t = i + 1;
+                event->t = i + 1;
             } else if (len == 1 && *key == 'd') {
-                d = i + 1;
+                event->d = i + 1;
             } else if (len == 1 && *key == 's') {
                 jsmntok_t v = tokens[i + 1];
-                g_last_seq = atoi(json + v.start);
+                if (json[v.start] != 'n') shard->last_seq = atoll(json + v.start); // s is null for everything but dispatches
             }
         }
 
@@ -324,127 +736,682 @@ static void HandleGatewayEvent(const char* json) {
         i = val + 1 + skip;
     }
 
-    if (op == 0) {
-        size_t json_len = strlen(json);
+    return event;
+}
+
+// Same as DecodeJson for encoding=etf. snowflakes are already integers so there's nothing to convert later either
+static Event* DecodeEtf(Shard* shard, FrameBuffer* frame, int* op) {
+    const unsigned char* data = (const unsigned char*) frame->data;
+    size_t length = frame->length;
+
+    int capacity = EstimateTokens(shard, length);
+    Event* event = Event_Create(frame, GATEWAY_ENCODING_ETF, capacity);
+
+    // etf_parse can't resume like jsmn, but with a good estimate the second try is rare
+    int term_count;
+    while ((term_count = etf_parse(data, length, (EtfTerm*) event->terms, capacity)) == ETF_ERROR_NOMEM) {
+        capacity *= 2;
+        event = Event_Grow(event, capacity);
+    }
+
+    if (term_count <= 0) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "etf error: %d", term_count);
+        Event_Free(event);
+        return NULL;
+    }
+
+    UpdateTokenDensity(shard, term_count, length);
+
+    const EtfTerm* terms = event->terms;
+
+    if (terms[0].type != ETF_MAP) {
+        Event_Free(event);
+        return NULL;
+    }
+
+    int i = 1;
+    for (int k = 0; k < terms[0].size; k++) {
+        int val = i + 1 + terms[i].span;
+
+        if (etf_eq(data, &terms[i], "op")) {
+            if (terms[val].type == ETF_INTEGER) *op = (int) terms[val].integer;
+        } else if (etf_eq(data, &terms[i], "t")) {
+            if (!etf_is_nil(data, &terms[val])) event->t = val;
+        } else if (etf_eq(data, &terms[i], "d")) {
+            event->d = val;
+        } else if (etf_eq(data, &terms[i], "s")) {
+            if (terms[val].type == ETF_INTEGER) shard->last_seq = (long long) terms[val].integer;
+        }
+
+        i = val + 1 + terms[val].span;
+    }
+
+    return event;
+}
+
+static const char* const g_envelope_keys[] = {"op", "s", "t"};
+
+// Reads op, s and t off the top of the payload without tokenizing it, and drops dispatches that no callback or anything
+// in here would look at. Returns true if the frame was dropped (and released). Anything odd goes the normal way
+static bool SkipUnwantedDispatch(Shard* shard, FrameBuffer* frame) {
+    long long op;
+    long long seq;
+    GatewayEventType type;
+
+    if (g_encoding == GATEWAY_ENCODING_ETF) {
+        EtfTerm values[3];
+        if (etf_scan_map((const unsigned char*) frame->data, frame->length, g_envelope_keys, 3, values) != 3) return false;
+        if (values[0].type != ETF_INTEGER || values[1].type != ETF_INTEGER) return false;
+        if (values[2].type != ETF_ATOM && values[2].type != ETF_BINARY) return false;
+
+        op = (long long) values[0].integer;
+        seq = (long long) values[1].integer;
+        type = GatewayEvent_FromName(frame->data + values[2].start, values[2].end - values[2].start);
+    } else {
+        jsmntok_t values[3];
+        if (jsmn_scan_object(frame->data, frame->length, g_envelope_keys, 3, values) != 3) return false;
+        if (values[0].type != JSMN_PRIMITIVE || values[1].type != JSMN_PRIMITIVE || values[2].type != JSMN_STRING) return false;
+
+        // s is null for everything that isn't a dispatch
+        char c = frame->data[values[1].start];
+        if (c < '0' || c > '9') return false;
+
+        op = atoll(frame->data + values[0].start);
+        seq = atoll(frame->data + values[1].start);
+        type = GatewayEvent_FromName(frame->data + values[2].start, values[2].end - values[2].start);
+    }
+
+    // READY is the only dispatch the gateway code itself needs
+    if (op != 0 || type == GATEWAY_EVENT_READY || EventLoop_WantsEvent(type)) return false;
+
+    shard->last_seq = seq;
+    SessionFile_SaveSeq(&g_session_file, shard->id, seq);
+
+    shard->events_skipped++;
+    shard->bytes_skipped += frame->length;
+    FrameBuffer_Release(frame);
+    return true;
+}
+
+// takes the frame. dispatches go to the event loop as they are, nothing gets copied
+static void HandleGatewayEvent(Shard* shard, FrameBuffer* frame) {
+    if (SkipUnwantedDispatch(shard, frame)) return;
+
+    int op = -1;
+    Event* event;
 
-        char* raw = HeapAlloc(sizeof(Event) + token_count * sizeof(jsmntok_t) + json_len + 1);
+    if (g_encoding == GATEWAY_ENCODING_ETF) event = DecodeEtf(shard, frame, &op);
+    else event = DecodeJson(shard, frame, &op);
 
-        Event* event = (Event*) raw;
-        jsmntok_t* event_tokens = (jsmntok_t*) (raw + sizeof(Event));
-        char* event_json = raw + sizeof(Event) + (token_count * sizeof(jsmntok_t));
+    if (event == NULL) return;
+    event->shard_id = shard->id;
 
-        memcpy(event_tokens, tokens, token_count * sizeof(jsmntok_t));
-        memcpy(event_json, json, json_len);
-        event_json[json_len] = '\0';
+    if (op == 0) {
+        SessionFile_SaveSeq(&g_session_file, shard->id, shard->last_seq);
+        HandleEvent(shard, event);
+        return;
+    }
 
-        event->json = event_json;
-        event->tokens = event_tokens;
-        event->t = t;
-        event->d = d;
+    // a replay has nobody to answer HELLO or heartbeat requests to
+    if (shard->replaying) {
+        Event_Free(event);
+        return;
+    }
 
-        HandleEvent(event);
-    } else if (op == 1) {
-        SendHeartbeat();
+    if (op == 1) {
+        SendHeartbeat(shard);
     } else if (op == 7) {
-        DisconnectGateway(DONT_SEND_CODE);
-        ConnectGateway();
+        // reconnect requests keep the session
+        DisconnectGateway(shard, SERVICE_RESTART);
+        if (shard->session_id[0] != '\0') ResumeGateway(shard);
+        else ConnectGateway(shard);
     } else if (op == 9) {
-        if (d == JSON_NULL || tokens[d].type != JSMN_PRIMITIVE || json[tokens[d].start] != 't' || json[tokens[d].start] != 'f') {
-            DisconnectGateway(UNSUPPORTED_DATA);
+        bool resumable;
+        if (Event_GetBoolean(event, event->d, &resumable) != 0) {
+            Event_Free(event);
+            DisconnectGateway(shard, UNSUPPORTED_DATA);
             return;
         }
 
-        if (json[tokens[d].start] == 't') { // true, we can resume
-            DisconnectGateway(DONT_SEND_CODE);
-            ResumeGateway();
+        if (resumable && shard->session_id[0] != '\0') {
+            DisconnectGateway(shard, DONT_SEND_CODE);
+            ResumeGateway(shard);
         } else {
-            DisconnectGateway(GOING_AWAY);
+            // the session is gone (or the saved one was too old), start a new one after a little while
+            LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_WARN, "[WS %d] invalid session, identifying again", shard->id);
+            DisconnectGateway(shard, GOING_AWAY);
+            ForgetSession(shard);
+
+            uint32_t random = 0;
+            RAND_bytes((unsigned char*) &random, sizeof(random));
+            uint64_t delay = INVALID_SESSION_MIN_DELAY_MS + random % (INVALID_SESSION_MAX_DELAY_MS - INVALID_SESSION_MIN_DELAY_MS + 1);
+
+            shard->connect_pending = true;
+            Reactor_ArmTimer(&shard->connect_timer, delay, 0);
         }
     } else if (op == 10) {
-        JsonObject heartbeat_interval = jsmn_find_key(json, tokens, d, "heartbeat_interval");
-        g_heartbeat_interval = atoi(json + tokens[heartbeat_interval].start);
-        g_send_heartbeats = true;
+        int64_t heartbeat_interval;
+        if (Event_GetInteger(event, Event_FindKey(event, event->d, "heartbeat_interval"), &heartbeat_interval) != 0) {
+            Event_Free(event);
+            DisconnectGateway(shard, UNSUPPORTED_DATA);
+            return;
+        }
+
+        shard->heartbeat_interval = (int) heartbeat_interval;
+
+        if (shard->resuming) {
+            SendResume(shard);
+        } else {
+            uint64_t delay = IdentifyScheduler_Reserve(&g_identify_scheduler, shard->id);
+            if (delay == 0) SendIdentify(shard);
+            else Reactor_ArmTimer(&shard->identify_timer, delay, 0);
+        }
 
-        char identify[1024];
-        snprintf(identify, sizeof(identify),
-                 "{\"op\":2,\"d\":{\"token\":\"%s\",\"intents\":%lu,\"properties\":{\"os\":\"linux\",\"browser\":\"gambler\",\"device\":\"gambler\"},\"compress\":false,\"presence\":{\"status\":\"online\"}}}",
-                 g_token, g_intents);
+        // the first heartbeat goes out after heartbeat_interval * jitter so a mass reconnect doesn't beat in sync
+        uint32_t random = 0;
+        RAND_bytes((unsigned char*) &random, sizeof(random));
+        uint64_t jitter = (uint64_t) shard->heartbeat_interval * random / ((uint64_t) UINT32_MAX + 1);
+
+        Reactor_ArmTimer(&shard->heartbeat_timer, jitter, shard->heartbeat_interval);
+    } else if (op == 11) {
+        if (!shard->heartbeat_acked && shard->heartbeat_sent_at != 0) {
+            uint64_t rtt = NowUs() - shard->heartbeat_sent_at;
+            atomic_store(&shard->latency, (int_fast64_t) rtt);
+            Histogram_Record(&g_heartbeat_latency, rtt);
+        }
 
-        WS_SendText(&g_ws_client, identify);
+        shard->heartbeat_acked = true;
     }
+
+    Event_Free(event);
+}
+
+static void HandleGatewayFrame(Shard* shard, FrameBuffer* frame) {
+    shard->bytes_received += frame->length;
+    if (g_recorder.file != NULL) Recording_Write(&g_recorder, shard->id, frame->data, frame->length);
+
+    if (g_compress) {
+        char* payload;
+        size_t length;
+
+        int res = ZlibStream_Feed(&shard->inflater, frame->data, frame->length, &payload, &length);
+        FrameBuffer_Release(frame);
+        if (res == 0) return; // rest of the message is in the next frame
+
+        if (res < 0) {
+            LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "[WS %d] zlib-stream inflate error, reconnecting", shard->id);
+            DisconnectGateway(shard, INVALID_FRAME_PAYLOAD_DATA);
+            if (shard->session_id[0] != '\0') ResumeGateway(shard);
+            else ConnectGateway(shard);
+            return;
+        }
+
+        // the inflated message moves on in the stream's buffer, the stream gets a new one for the next message
+        frame = ZlibStream_TakeOutput(&shard->inflater);
+
+        // uncompressed text frames were checked by the websocket layer, these arrive as binary
+        if (g_encoding == GATEWAY_ENCODING_JSON && !Simd_ValidateUtf8(frame->data, frame->length)) {
+            LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "[WS %d] inflated message isn't utf-8, reconnecting", shard->id);
+            FrameBuffer_Release(frame);
+            DisconnectGateway(shard, INVALID_FRAME_PAYLOAD_DATA);
+            if (shard->session_id[0] != '\0') ResumeGateway(shard);
+            else ConnectGateway(shard);
+            return;
+        }
+    }
+
+    shard->bytes_decoded += frame->length;
+
+    if (g_encoding == GATEWAY_ENCODING_ETF) LOG(LOG_CATEGORY_PAYLOAD, LOG_LEVEL_TRACE, "[WS %d] <etf, %zu bytes>", shard->id, frame->length);
+    else LOG(LOG_CATEGORY_PAYLOAD, LOG_LEVEL_TRACE, "[WS %d] %s", shard->id, frame->data);
+
+    HandleGatewayEvent(shard, frame);
+}
+
+void Discord_GetGatewayTrafficStats(uint64_t* bytes_received, uint64_t* bytes_decoded) {
+    uint64_t received = 0;
+    uint64_t decoded = 0;
+
+    for (int i = 0; i < g_shard_count && g_shards != NULL; i++) {
+        received += g_shards[i].bytes_received;
+        decoded += g_shards[i].bytes_decoded;
+    }
+
+    if (bytes_received != NULL) *bytes_received = received;
+    if (bytes_decoded != NULL) *bytes_decoded = decoded;
+}
+
+void Discord_GetSkippedEventStats(uint64_t* events_skipped, uint64_t* bytes_skipped) {
+    uint64_t events = 0;
+    uint64_t bytes = 0;
+
+    for (int i = 0; i < g_shard_count && g_shards != NULL; i++) {
+        events += g_shards[i].events_skipped;
+        bytes += g_shards[i].bytes_skipped;
+    }
+
+    if (events_skipped != NULL) *events_skipped = events;
+    if (bytes_skipped != NULL) *bytes_skipped = bytes;
+}
+
+void Discord_GetIdentifyStats(int* remaining, uint64_t* identifies, uint64_t* waited_ms) {
+    if (g_identify_scheduler.bucket_free_at == NULL) {
+        if (remaining != NULL) *remaining = g_session_start_remaining;
+        if (identifies != NULL) *identifies = 0;
+        if (waited_ms != NULL) *waited_ms = 0;
+        return;
+    }
+
+    IdentifyScheduler_GetStats(&g_identify_scheduler, remaining, identifies, waited_ms);
+}
+
+void Discord_GetGatewayLatency(GatewayLatency* latency) {
+    latency->samples = Histogram_Count(&g_heartbeat_latency);
+    latency->mean_us = Histogram_Mean(&g_heartbeat_latency);
+    latency->p50_us = Histogram_Percentile(&g_heartbeat_latency, 50.0);
+    latency->p90_us = Histogram_Percentile(&g_heartbeat_latency, 90.0);
+    latency->p99_us = Histogram_Percentile(&g_heartbeat_latency, 99.0);
+    latency->max_us = Histogram_Max(&g_heartbeat_latency);
+}
+
+void Discord_GetTlsHandshakeStats(TlsHandshakeStats* stats) {
+    const Histogram* full = TlsCache_FullHandshakes();
+    const Histogram* resumed = TlsCache_ResumedHandshakes();
+
+    stats->full = Histogram_Count(full);
+    stats->resumed = Histogram_Count(resumed);
+    stats->full_mean_us = Histogram_Mean(full);
+    stats->full_p99_us = Histogram_Percentile(full, 99.0);
+    stats->resumed_mean_us = Histogram_Mean(resumed);
+    stats->resumed_p99_us = Histogram_Percentile(resumed, 99.0);
+    TlsCache_GetKernelTlsCounts(&stats->ktls_send, &stats->ktls_recv);
+}
+
+void Discord_GetConnectStats(uint64_t* dns_lookups, uint64_t* dns_cache_hits, uint64_t* connects, uint64_t* failures) {
+    NetStats stats;
+    Net_GetStats(&stats);
+
+    *dns_lookups = stats.lookups;
+    *dns_cache_hits = stats.cache_hits;
+    *connects = stats.connects;
+    *failures = stats.failures;
+}
+
+int64_t Discord_GetShardLatency(int shard_id) {
+    if (g_shards == NULL || shard_id < 0 || shard_id >= g_shard_count) return -1;
+    return atomic_load(&g_shards[shard_id].latency);
 }
 
 Arena* Discord_GetEventArena(void) {
+    Arena* worker_arena = EventLoop_GetWorkerArena();
+    if (worker_arena != NULL) return worker_arena;
+
     return &g_event_arena;
 }
 
+static void HandleConnectionLost(Shard* shard) {
+    LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_WARN, "[WS %d] Error. last_close_code=%d", shard->id, shard->ws_client.last_close_code);
+
+    switch (shard->ws_client.last_close_code) {
+        // can we resume?
+        case 4000:
+        case 4001:
+        case 4002:
+        case 4003:
+        case 4005:
+        case 4008:
+        case INVALID_FRAME_PAYLOAD_DATA: { // we closed it over bad text, the session itself is fine
+            DisconnectGateway(shard, DONT_SEND_CODE);
+            if (shard->session_id[0] != '\0') ResumeGateway(shard);
+            else ConnectGateway(shard);
+            break;
+        }
+
+        // invalid seq and session timed out, the session is gone
+        case 4007:
+        case 4009: {
+            DisconnectGateway(shard, DONT_SEND_CODE);
+            ForgetSession(shard);
+            ConnectGateway(shard);
+            break;
+        }
+
+        // bad token, bad shard, sharding required, bad api version, bad or disallowed intents. Identifying again can't
+        // fix any of these and would only use up the day's identifies
+        case 4004:
+        case 4010:
+        case 4011:
+        case 4012:
+        case 4013:
+        case 4014: {
+            LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "[WS %d] gateway closed with %d, giving up on this shard", shard->id,
+                shard->ws_client.last_close_code);
+            DisconnectGateway(shard, DONT_SEND_CODE);
+            break;
+        }
+
+        default: {
+            DisconnectGateway(shard, DONT_SEND_CODE);
+            ConnectGateway(shard);
+            break;
+        }
+    }
+}
+
+// runs at the end of every callback that touched the shard
+static void UpdateShard(Shard* shard) {
+    // everything the callback sent goes out together
+    if (shard->running && shard->ws_client.out_length > 0 && WS_Flush(&shard->ws_client) < 0) HandleConnectionLost(shard);
+
+    if (!shard->running) {
+        if (shard->finished || shard->connect_pending || shard->connecting) return;
+        shard->finished = true;
+
+        Reactor_DisarmTimer(&shard->heartbeat_timer);
+        if (--shard->thread->live_shards == 0) Reactor_Stop(&shard->thread->reactor);
+        return;
+    }
+
+    uint32_t events = EPOLLIN;
+    if (WS_WantsWrite(&shard->ws_client)) events |= EPOLLOUT;
+    Reactor_Modify(&shard->thread->reactor, &shard->socket_handle, events);
+}
+
+static void OnGatewaySocket(Reactor* reactor, ReactorHandle* handle, uint32_t events) {
+    Shard* shard = handle->userdata;
+
+    if (shard->ws_client.out_length > 0 && WS_Flush(&shard->ws_client) < 0) {
+        HandleConnectionLost(shard);
+        UpdateShard(shard);
+        return;
+    }
+
+    int frames = 0;
+    while (shard->running && frames < MAX_FRAMES_PER_WAKEUP) {
+        FrameBuffer* frame;
+
+        int res = WS_TryRecv(&shard->ws_client, &frame);
+        if (res == 0) break;
+
+        if (res < 0) {
+            HandleConnectionLost(shard);
+            break;
+        }
+
+        HandleGatewayFrame(shard, frame);
+        frames++;
+    }
+
+    // openssl can still have decrypted frames that epoll won't tell us about
+    if (frames == MAX_FRAMES_PER_WAKEUP && shard->running) Reactor_Defer(reactor, &shard->socket_handle);
+
+    UpdateShard(shard);
+}
+
+static void OnHeartbeatTimer(Reactor* reactor, ReactorHandle* handle, uint32_t events) {
+    Shard* shard = handle->userdata;
+
+    if (shard->running && !shard->heartbeat_acked) {
+        // nothing came back for a whole interval, the connection is dead even if tcp doesn't know it yet.
+        // anything but 1000/1001 keeps the session resumable
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_WARN, "[WS %d] no heartbeat ACK in %d ms, resuming", shard->id, shard->heartbeat_interval);
+        DisconnectGateway(shard, SERVICE_RESTART);
+
+        if (shard->session_id[0] != '\0') ResumeGateway(shard);
+        else ConnectGateway(shard);
+    } else if (shard->running) {
+        SendHeartbeat(shard);
+    }
+
+    UpdateShard(shard);
+}
+
+static void OnIdentifyTimer(Reactor* reactor, ReactorHandle* handle, uint32_t events) {
+    Shard* shard = handle->userdata;
+
+    if (shard->running) SendIdentify(shard);
+
+    UpdateShard(shard);
+}
+
+static void OnConnectTimer(Reactor* reactor, ReactorHandle* handle, uint32_t events) {
+    Shard* shard = handle->userdata;
+
+    shard->connect_pending = false;
+    if (shard->session_id[0] != '\0') ResumeGateway(shard);
+    else ConnectGateway(shard);
+
+    UpdateShard(shard);
+}
+
+static void* GatewayThreadMain(void* arg) {
+    GatewayThread* thread = arg;
+    Reactor_Run(&thread->reactor);
+    return NULL;
+}
+
 void Discord_Run(void) {
-    ConnectGateway();
+    // with the gateway and the shard count both given there's nothing /gateway/bot would tell us, so a mock gateway
+    // doesn't need a REST server next to it. the identify limits stay at their defaults then
+    if (!g_gateway_overridden || g_shard_count <= 0) {
+        if (FetchGatewayInfo() != 0) return;
+    } else {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_INFO, "using gateway %s:%s without asking /gateway/bot", g_gateway_host, g_gateway_port);
+    }
+
+    int thread_count = g_gateway_thread_count > 0 ? g_gateway_thread_count : 1;
+    if (thread_count > g_shard_count) thread_count = g_shard_count;
+
+    LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_INFO, "starting %d shard(s) on %d gateway thread(s), max_concurrency=%d, identifies left today=%d",
+        g_shard_count, thread_count, g_max_concurrency, g_session_start_remaining);
 
-    uint64_t next_heartbeat = 0;
+    if (IdentifyScheduler_Init(&g_identify_scheduler, g_max_concurrency, g_session_start_total, g_session_start_remaining, g_session_start_reset_after) != 0) return;
 
-    while (g_running) {
-        ArenaReset(&g_event_arena);
+    BuildGatewayPath();
 
-        int timeout_ms = 100;
-        if (g_send_heartbeats) {
-            uint64_t now = NowMs();
-            if (next_heartbeat > now) timeout_ms = next_heartbeat - now;
-            else timeout_ms = 0;
+    g_gateway_threads = HeapAlloc(thread_count * sizeof(GatewayThread));
+    for (int i = 0; i < thread_count; i++) {
+        if (Reactor_Init(&g_gateway_threads[i].reactor) != 0) {
+            for (int j = 0; j < i; j++) Reactor_Destroy(&g_gateway_threads[j].reactor);
+            HeapFree(g_gateway_threads);
+            g_gateway_threads = NULL;
+            IdentifyScheduler_Destroy(&g_identify_scheduler);
+            return;
         }
+    }
 
-        struct timeval tv = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(g_ws_client.sock, &fds);
-
-        int ret = select(g_ws_client.sock + 1, &fds, NULL, NULL, &tv);
-        if (ret > 0 && FD_ISSET(g_ws_client.sock, &fds)) {
-            char* payload;
-            int n = WS_RecvText(&g_ws_client, &payload, &g_event_arena);
-            if (n > 0) {
-                printf("[WS] %s\n", payload);
-                fflush(stdout);
-                HandleGatewayEvent(payload);
-            } else if (n == -1) {
-                printf("[WS] Error. last_close_code=%d\n", g_ws_client.last_close_code);
-
-                switch (g_ws_client.last_close_code) {
-                    // can we resume?
-                    case 4000:
-                    case 4001:
-                    case 4002:
-                    case 4003:
-                    case 4005:
-                    case 4007:
-                    case 4008:
-                    case 4009: {
-                        DisconnectGateway(DONT_SEND_CODE);
-                        ResumeGateway();
-                        break;
-                    }
-
-                    default: {
-                        DisconnectGateway(DONT_SEND_CODE);
-                        ConnectGateway();
-                        break;
-                    }
-                }
-            }
+    EventLoop_Init(g_event_thread_count, g_event_dispatch_mode);
+
+    if (g_session_file_path[0] != '\0' && SessionFile_Open(&g_session_file, g_session_file_path, g_shard_count) != 0) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_WARN, "can't use session file %s, every shard will identify", g_session_file_path);
+    }
+
+    uint32_t record_flags = (g_compress ? RECORDING_COMPRESSED : 0) | (g_encoding == GATEWAY_ENCODING_ETF ? RECORDING_ETF : 0);
+    if (g_record_file_path[0] != '\0' && Recording_OpenWriter(&g_recorder, g_record_file_path, record_flags, g_shard_count) != 0) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_WARN, "can't record the gateway to %s", g_record_file_path);
+    }
+
+    g_shards = HeapAlloc(g_shard_count * sizeof(Shard));
+    for (int i = 0; i < g_shard_count; i++) {
+        Shard* shard = &g_shards[i];
+        shard->id = i;
+        shard->thread = &g_gateway_threads[i % thread_count];
+        shard->socket_handle.fd = -1;
+        shard->tokens_per_kib = INITIAL_TOKENS_PER_KIB;
+        atomic_init(&shard->latency, -1);
+        strcpy(shard->resume_port, "443");
+        if (g_compress) ZlibStream_Init(&shard->inflater);
+        if (g_encoding == GATEWAY_ENCODING_ETF) EtfWriter_Init(&shard->writer);
+
+        Reactor* reactor = &shard->thread->reactor;
+        if (Reactor_AddTimer(reactor, &shard->heartbeat_timer, OnHeartbeatTimer, shard) != 0 ||
+            Reactor_AddTimer(reactor, &shard->connect_timer, OnConnectTimer, shard) != 0 ||
+            Reactor_AddTimer(reactor, &shard->identify_timer, OnIdentifyTimer, shard) != 0 ||
+            Reactor_AddTimer(reactor, &shard->handshake_timer, OnHandshakeTimer, shard) != 0) {
+            shard->finished = true;
+            continue;
         }
 
-        if (g_send_heartbeats) {
-            uint64_t now = NowMs();
-            if (now >= next_heartbeat) {
-                SendHeartbeat();
-                do {
-                    next_heartbeat += g_heartbeat_interval;
-                } while (next_heartbeat <= now);
-            }
+        // a saved session resumes right away, resuming doesn't count against the identify limits
+        SessionState saved;
+        uint64_t start_delay = 0;
+        if (SessionFile_Load(&g_session_file, shard->id, &saved)) {
+            LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_INFO, "[WS %d] resuming saved session at seq %lld", shard->id, saved.last_seq);
+            strcpy(shard->session_id, saved.session_id);
+            strcpy(shard->resume_host, saved.resume_host);
+            strcpy(shard->resume_port, saved.resume_port);
+            shard->last_seq = saved.last_seq;
+        } else {
+            // the scheduler hands out identify slots at HELLO, this only spreads the connects out so a shard isn't
+            // sitting on an open connection for minutes waiting for its turn in the bucket
+            start_delay = (uint64_t) (shard->id / g_max_concurrency) * IDENTIFY_WINDOW_MS;
+            start_delay = start_delay > IDENTIFY_CONNECT_LEAD_MS ? start_delay - IDENTIFY_CONNECT_LEAD_MS : 0;
         }
+
+        shard->connect_pending = true;
+        Reactor_ArmTimer(&shard->connect_timer, start_delay, 0);
+
+        shard->thread->live_shards++;
+    }
+
+    for (int i = 0; i < thread_count; i++) {
+        GatewayThread* thread = &g_gateway_threads[i];
+        if (thread->live_shards == 0) Reactor_Stop(&thread->reactor);
+        pthread_create(&thread->thread, NULL, GatewayThreadMain, thread);
     }
 
-    outtahere:
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(g_gateway_threads[i].thread, NULL);
+    }
+
+    for (int i = 0; i < g_shard_count; i++) {
+        Shard* shard = &g_shards[i];
+        Reactor* reactor = &shard->thread->reactor;
+
+        // a handshake still going arms handshake_timer when it's done, so it has to be waited out before that goes
+        if (shard->connecting) {
+            pthread_join(shard->handshake_thread, NULL);
+            if (shard->handshake_result == 0) WS_Disconnect(shard->ws_client, GOING_AWAY);
+            shard->connecting = false;
+        }
+
+        if (shard->running) DisconnectGateway(shard, GOING_AWAY);
+        Reactor_RemoveTimer(reactor, &shard->heartbeat_timer);
+        Reactor_RemoveTimer(reactor, &shard->connect_timer);
+        Reactor_RemoveTimer(reactor, &shard->identify_timer);
+        Reactor_RemoveTimer(reactor, &shard->handshake_timer);
+
+        ZlibStream_Destroy(&shard->inflater);
+        EtfWriter_Destroy(&shard->writer);
+    }
+
+    for (int i = 0; i < thread_count; i++) {
+        Reactor_Destroy(&g_gateway_threads[i].reactor);
+    }
+
+    HeapFree(g_shards);
+    g_shards = NULL;
+    HeapFree(g_gateway_threads);
+    g_gateway_threads = NULL;
+
+    EventLoop_Shutdown(true);
+
+    SessionFile_Close(&g_session_file);
+    IdentifyScheduler_Destroy(&g_identify_scheduler);
+
+    if (g_recorder.file != NULL) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_INFO, "recorded %llu gateway message(s) to %s", (unsigned long long) g_recorder.frames, g_record_file_path);
+        Recording_CloseWriter(&g_recorder);
+    }
+}
+
+int Discord_Replay(const char* path, double speed, ReplayStats* stats) {
+    RecordingReader reader;
+    if (Recording_OpenReader(&reader, path) != 0) {
+        LOG(LOG_CATEGORY_CORE, LOG_LEVEL_ERROR, "can't read recording %s", path);
+        return 1;
+    }
+
+    // the recording decides how the frames have to be decoded
+    bool compress = g_compress;
+    GatewayEncoding encoding = g_encoding;
+    int shard_count = g_shard_count;
+    g_compress = (reader.flags & RECORDING_COMPRESSED) != 0;
+    g_encoding = (reader.flags & RECORDING_ETF) != 0 ? GATEWAY_ENCODING_ETF : GATEWAY_ENCODING_JSON;
+    g_shard_count = reader.shard_count > 0 ? reader.shard_count : 1;
+
+    memset(stats, 0, sizeof(ReplayStats));
+    Histogram_Init(&stats->decode);
+    Histogram_Init(&stats->queue_wait);
+    Histogram_Init(&stats->handler);
+
+    EventLoop_SetStageHistograms(&stats->queue_wait, &stats->handler);
+    EventLoop_Init(g_event_thread_count, g_event_dispatch_mode);
+
+    g_shards = HeapAlloc(g_shard_count * sizeof(Shard));
+    for (int i = 0; i < g_shard_count; i++) {
+        Shard* shard = &g_shards[i];
+        shard->id = i;
+        shard->replaying = true;
+        shard->running = true;
+        shard->socket_handle.fd = -1;
+        shard->tokens_per_kib = INITIAL_TOKENS_PER_KIB;
+        atomic_init(&shard->latency, -1);
+        if (g_compress) ZlibStream_Init(&shard->inflater);
+        if (g_encoding == GATEWAY_ENCODING_ETF) EtfWriter_Init(&shard->writer);
+    }
+
+    RecordedFrame recorded;
+    int res;
+    uint64_t start = NowUs();
+
+    while ((res = Recording_Next(&reader, &recorded)) > 0) {
+        if (recorded.shard_id >= g_shard_count) continue;
+
+        if (recorded.opened) {
+            ZlibStream_Reset(&g_shards[recorded.shard_id].inflater);
+            continue;
+        }
+
+        if (speed > 0) {
+            uint64_t due = start + (uint64_t) ((double) recorded.time_us / speed);
+            uint64_t now = NowUs();
+            if (due > now) usleep((useconds_t) (due - now));
+        }
+
+        FrameBuffer* frame = FrameBuffer_Acquire(recorded.length + 1);
+        memcpy(frame->data, recorded.data, recorded.length + 1);
+        frame->length = recorded.length;
+
+        uint64_t decode_start = NowUs();
+        HandleGatewayFrame(&g_shards[recorded.shard_id], frame);
+        Histogram_Record(&stats->decode, NowUs() - decode_start);
+
+        stats->frames++;
+    }
+
+    // the workers drain what's queued before they exit
+    EventLoop_Shutdown(true);
+    EventLoop_SetStageHistograms(NULL, NULL);
+
+    stats->seconds = (double) (NowUs() - start) / 1e6;
+    stats->events = Histogram_Count(&stats->handler);
+    Discord_GetSkippedEventStats(&stats->events_skipped, NULL);
+
+    for (int i = 0; i < g_shard_count; i++) {
+        ZlibStream_Destroy(&g_shards[i].inflater);
+        EtfWriter_Destroy(&g_shards[i].writer);
+    }
+
+    HeapFree(g_shards);
+    g_shards = NULL;
+
+    g_compress = compress;
+    g_encoding = encoding;
+    g_shard_count = shard_count;
+
+    Recording_CloseReader(&reader);
 
-    DisconnectGateway(GOING_AWAY);
+    if (res < 0) LOG(LOG_CATEGORY_CORE, LOG_LEVEL_WARN, "recording %s is cut off after %llu message(s)", path, (unsigned long long) stats->frames);
+    return 0;
 }
@@ -2,24 +2,57 @@
 
 #include "discord/api.h"
 
+#include <pthread.h>
+#include <stdio.h>
+
 extern SSL_CTX* g_ssl_ctx;
 
 static HTTPClient g_http_client;
+static pthread_mutex_t g_http_lock = PTHREAD_MUTEX_INITIALIZER; // handlers send requests from every event worker
+
+#define DISCORD_API_HOST "discord.com"
+#define DISCORD_API_PORT "443"
 
+// nothing connects here, the first request does. that way the host can still be changed after Discord_LibInit
 int DiscordAPI_Init(void) {
-    if (HTTP_Connect(&g_http_client, g_ssl_ctx, "discord.com", "443") != 0) return 1;
+    g_http_client.ctx = g_ssl_ctx;
+    g_http_client.connected = false;
+    DiscordAPI_SetHost(DISCORD_API_HOST, DISCORD_API_PORT);
 
     return 0;
 }
 
+void DiscordAPI_SetHost(const char* host, const char* port) {
+    pthread_mutex_lock(&g_http_lock);
+
+    HTTP_Disconnect(&g_http_client);
+    snprintf(g_http_client.host, sizeof(g_http_client.host), "%s", host);
+    snprintf(g_http_client.port, sizeof(g_http_client.port), "%s", port != NULL ? port : DISCORD_API_PORT);
+
+    pthread_mutex_unlock(&g_http_lock);
+}
+
 void DiscordAPI_Shutdown(void) {
     HTTP_Disconnect(&g_http_client);
 }
 
 void DiscordAPI_SetAuth(const char* auth) {
+    pthread_mutex_lock(&g_http_lock);
     HTTP_SetAuthorization(&g_http_client, auth);
+    pthread_mutex_unlock(&g_http_lock);
 }
 
 HTTPResponse* DiscordAPI_SendRequest(Arena* arena, const char* method, const char* path, const char* body) {
-    return HTTP_Request(&g_http_client, arena, method, path, body);
+    pthread_mutex_lock(&g_http_lock);
+    HTTPResponse* res = HTTP_Request(&g_http_client, arena, method, path, body);
+    pthread_mutex_unlock(&g_http_lock);
+    return res;
+}
+
+HTTPResponse* DiscordAPI_SendFile(Arena* arena, const char* method, const char* path, const char* content_type,
+                                  const HTTPFileBody* body) {
+    pthread_mutex_lock(&g_http_lock);
+    HTTPResponse* res = HTTP_RequestFile(&g_http_client, arena, method, path, content_type, body);
+    pthread_mutex_unlock(&g_http_lock);
+    return res;
 }
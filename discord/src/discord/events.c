@@ -2,28 +2,543 @@
 
 #include "discord/events.h"
 
+#include "discord.h"
+
+#include "internal/memory.h"
+
+#include "utils/histogram.h"
+#include "utils/time.h"
+
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-typedef struct EventLoop {
+typedef struct EventWorker {
     pthread_t thread;
+    int index;
 
-    bool active;
-
+    // per worker deque. the owner pops from the front and so do thieves, because event order matters more to us than cache locality
     pthread_mutex_t lock;
-    pthread_cond_t cond;
     Event* front;
     Event* back;
+
+    // keyed events hashed onto this worker. nobody steals these, so events with the same key run one after another in order
+    Event* lane_front;
+    Event* lane_back;
+    atomic_size_t lane_length;
+    uint64_t next_seq; // under lock, lets the owner take whichever list has the older event
+
+    pthread_cond_t cond; // waited on with the loop lock
+    bool sleeping; // under the loop lock
+
+    Arena arena; // reset after every event, handlers can use it through Discord_GetEventArena
+} EventWorker;
+
+typedef struct EventLoop {
+    EventWorker* workers;
+    int worker_count;
+
+    EventDispatchMode mode;
+    atomic_bool active;
+
+    pthread_mutex_t lock;
+    atomic_size_t pending; // events sitting in any worker deque, lanes not included
+    atomic_int sleeping; // workers waiting on cond
+    atomic_uint next_worker;
+
+    // stage latencies, NULL unless someone is measuring (the replay driver)
+    Histogram* queue_wait;
+    Histogram* handler;
 } EventLoop;
 
 static EventLoop g_event_loop;
 
-void EventLoop_Init(int thread_count) {
-    g_event_loop.front = NULL;
-    g_event_loop.back = NULL;
+static _Thread_local EventWorker* g_current_worker = NULL;
+
+Event* Event_Create(FrameBuffer* frame, GatewayEncoding encoding, int token_count) {
+    size_t token_size = encoding == GATEWAY_ENCODING_ETF ? sizeof(EtfTerm) : sizeof(jsmntok_t);
+
+    // HeapAlloc zeroes, and the token array is about to be overwritten anyway
+    Event* event = malloc(sizeof(Event) + token_count * token_size);
+    if (event == NULL) exit(42);
+    memset(event, 0, sizeof(Event));
+
+    event->encoding = encoding;
+    event->frame = frame;
+    event->json = frame->data;
+    event->length = frame->length;
+    event->t = JSON_NULL;
+    event->d = JSON_NULL;
+
+    if (encoding == GATEWAY_ENCODING_ETF) event->terms = (const EtfTerm*) (event + 1);
+    else event->tokens = (const jsmntok_t*) (event + 1);
+
+    return event;
+}
+
+Event* Event_Grow(Event* event, int token_count) {
+    size_t token_size = event->encoding == GATEWAY_ENCODING_ETF ? sizeof(EtfTerm) : sizeof(jsmntok_t);
+
+    event = HeapRealloc(event, sizeof(Event) + token_count * token_size);
+
+    if (event->encoding == GATEWAY_ENCODING_ETF) event->terms = (const EtfTerm*) (event + 1);
+    else event->tokens = (const jsmntok_t*) (event + 1);
+
+    return event;
+}
+
+void Event_Free(Event* event) {
+    FrameBuffer_Release(event->frame);
+    free(event);
+}
+
+GatewayEventType Event_LookupType(const Event* event) {
+    if (event->t == JSON_NULL) return GATEWAY_EVENT_UNKNOWN;
+
+    if (event->encoding == GATEWAY_ENCODING_ETF) {
+        const EtfTerm* term = &event->terms[event->t];
+        if (term->type != ETF_ATOM && term->type != ETF_BINARY) return GATEWAY_EVENT_UNKNOWN;
+        return GatewayEvent_FromName(event->json + term->start, term->end - term->start);
+    }
+
+    // event names never have escapes in them, so the raw token is the name
+    const jsmntok_t* token = &event->tokens[event->t];
+    if (token->type != JSMN_STRING) return GATEWAY_EVENT_UNKNOWN;
+    return GatewayEvent_FromName(event->json + token->start, token->end - token->start);
+}
+
+JsonObject Event_FindKey(const Event* event, JsonObject object, const char* key) {
+    if (object == JSON_NULL) return JSON_NULL;
+
+    if (event->encoding == GATEWAY_ENCODING_ETF) {
+        int value = etf_find_key((const unsigned char*) event->json, event->terms, object, key);
+        return value < 0 ? JSON_NULL : value;
+    }
+
+    if (event->tokens[object].type != JSMN_OBJECT) return JSON_NULL;
+    return jsmn_find_key(event->json, event->tokens, object, key);
+}
+
+bool Event_IsObject(const Event* event, JsonObject value) {
+    if (value == JSON_NULL) return false;
+    if (event->encoding == GATEWAY_ENCODING_ETF) return event->terms[value].type == ETF_MAP;
+    return event->tokens[value].type == JSMN_OBJECT;
+}
+
+int Event_GetString(const Event* event, JsonObject value, char* dest, size_t dest_size) {
+    if (value == JSON_NULL) return 1;
+
+    if (event->encoding == GATEWAY_ENCODING_ETF) {
+        const EtfTerm* term = &event->terms[value];
+        if (term->type != ETF_BINARY) return 1;
+        etf_copy_string((const unsigned char*) event->json, event->terms, value, dest, dest_size);
+        return 0;
+    }
+
+    if (event->tokens[value].type != JSMN_STRING) return 1;
+    jsmn_copy_unescaped(event->json, event->tokens, value, dest, dest_size);
+    return 0;
+}
+
+int Event_GetInteger(const Event* event, JsonObject value, int64_t* out) {
+    if (value == JSON_NULL) return 1;
+
+    if (event->encoding == GATEWAY_ENCODING_ETF) {
+        const EtfTerm* term = &event->terms[value];
+        if (term->type != ETF_INTEGER) return 1;
+        *out = term->negative ? -(int64_t) term->integer : (int64_t) term->integer;
+        return 0;
+    }
+
+    // snowflakes come as strings in json, so those count too
+    const jsmntok_t* token = &event->tokens[value];
+    char c = event->json[token->start];
+    if (token->type != JSMN_PRIMITIVE && token->type != JSMN_STRING) return 1;
+    if ((c < '0' || c > '9') && c != '-') return 1;
+
+    *out = strtoll(event->json + token->start, NULL, 10);
+    return 0;
+}
+
+int Event_GetBoolean(const Event* event, JsonObject value, bool* out) {
+    if (value == JSON_NULL) return 1;
+
+    if (event->encoding == GATEWAY_ENCODING_ETF) {
+        const unsigned char* data = (const unsigned char*) event->json;
+        const EtfTerm* term = &event->terms[value];
+        if (etf_eq(data, term, "true")) *out = true;
+        else if (term->type == ETF_ATOM && etf_eq(data, term, "false")) *out = false;
+        else return 1;
+        return 0;
+    }
+
+    const jsmntok_t* token = &event->tokens[value];
+    if (token->type != JSMN_PRIMITIVE) return 1;
+
+    char c = event->json[token->start];
+    if (c == 't') *out = true;
+    else if (c == 'f') *out = false;
+    else return 1;
+    return 0;
+}
+
+static Event* PopFrontLocked(EventWorker* worker) {
+    Event* event = worker->front;
+    if (event != NULL) {
+        worker->front = event->next;
+        if (worker->front == NULL) worker->back = NULL;
+        event->next = NULL;
+        atomic_fetch_sub(&g_event_loop.pending, 1);
+    }
+
+    return event;
+}
+
+static Event* PopLaneLocked(EventWorker* worker) {
+    Event* event = worker->lane_front;
+    if (event != NULL) {
+        worker->lane_front = event->next;
+        if (worker->lane_front == NULL) worker->lane_back = NULL;
+        event->next = NULL;
+        atomic_fetch_sub(&worker->lane_length, 1);
+    }
+
+    return event;
+}
+
+// the owner's pop, oldest of the deque and the lane
+static Event* PopOwn(EventWorker* worker) {
+    pthread_mutex_lock(&worker->lock);
+
+    Event* event;
+    if (worker->lane_front != NULL && (worker->front == NULL || worker->lane_front->seq < worker->front->seq)) {
+        event = PopLaneLocked(worker);
+    } else {
+        event = PopFrontLocked(worker);
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+    return event;
+}
+
+static Event* Steal(EventWorker* thief) {
+    for (int i = 1; i < g_event_loop.worker_count; i++) {
+        EventWorker* victim = &g_event_loop.workers[(thief->index + i) % g_event_loop.worker_count];
+
+        // a busy victim is either being fed or robbed by someone else, so just move on to the next one
+        if (pthread_mutex_trylock(&victim->lock) != 0) continue;
+        Event* event = PopFrontLocked(victim);
+        pthread_mutex_unlock(&victim->lock);
+
+        if (event != NULL) return event;
+    }
+
+    return NULL;
+}
+
+// Reads the id the dispatch mode keys on straight out of the tokens, before anything gets parsed.
+// Returns false if the event doesn't have one, those go to any worker like in EVENT_DISPATCH_ANY
+static bool FindEventKey(const Event* event, uint64_t* key) {
+    JsonObject d = event->d;
+    JsonObject value = JSON_NULL;
+
+    switch (g_event_loop.mode) {
+        case EVENT_DISPATCH_BY_CHANNEL:
+            switch (event->type) {
+                case GATEWAY_EVENT_CHANNEL_CREATE:
+                case GATEWAY_EVENT_CHANNEL_UPDATE:
+                case GATEWAY_EVENT_CHANNEL_DELETE:
+                case GATEWAY_EVENT_THREAD_CREATE:
+                case GATEWAY_EVENT_THREAD_UPDATE:
+                case GATEWAY_EVENT_THREAD_DELETE:
+                    value = Event_FindKey(event, d, "id");
+                    break;
+                default:
+                    value = Event_FindKey(event, d, "channel_id");
+                    break;
+            }
+            break;
+
+        case EVENT_DISPATCH_BY_GUILD:
+            switch (event->type) {
+                case GATEWAY_EVENT_GUILD_CREATE:
+                case GATEWAY_EVENT_GUILD_UPDATE:
+                case GATEWAY_EVENT_GUILD_DELETE:
+                    value = Event_FindKey(event, d, "id");
+                    break;
+                default:
+                    value = Event_FindKey(event, d, "guild_id");
+                    break;
+            }
+            break;
+
+        case EVENT_DISPATCH_BY_USER:
+            switch (event->type) {
+                case GATEWAY_EVENT_MESSAGE_CREATE:
+                case GATEWAY_EVENT_MESSAGE_UPDATE:
+                    value = Event_FindKey(event, Event_FindKey(event, d, "author"), "id");
+                    break;
+                case GATEWAY_EVENT_PRESENCE_UPDATE:
+                case GATEWAY_EVENT_GUILD_MEMBER_ADD:
+                case GATEWAY_EVENT_GUILD_MEMBER_UPDATE:
+                case GATEWAY_EVENT_GUILD_MEMBER_REMOVE:
+                case GATEWAY_EVENT_GUILD_BAN_ADD:
+                case GATEWAY_EVENT_GUILD_BAN_REMOVE:
+                    value = Event_FindKey(event, Event_FindKey(event, d, "user"), "id");
+                    break;
+                case GATEWAY_EVENT_INTERACTION_CREATE:
+                    // guild interactions have member.user, dms just user
+                    value = Event_FindKey(event, Event_FindKey(event, Event_FindKey(event, d, "member"), "user"), "id");
+                    if (value == JSON_NULL) value = Event_FindKey(event, Event_FindKey(event, d, "user"), "id");
+                    break;
+                case GATEWAY_EVENT_USER_UPDATE:
+                    value = Event_FindKey(event, d, "id");
+                    break;
+                default:
+                    value = Event_FindKey(event, d, "user_id");
+                    break;
+            }
+            break;
+
+        default:
+            return false;
+    }
+
+    int64_t id;
+    if (Event_GetInteger(event, value, &id) != 0) return false;
+
+    *key = (uint64_t) id;
+    return true;
+}
+
+// snowflakes are mostly timestamp in the high bits, so mix before taking the modulo
+static unsigned int LaneOf(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (unsigned int) (key % (uint64_t) g_event_loop.worker_count);
+}
+
+// Parses the event into whatever its callback takes and calls it. Only runs when a callback is set
+typedef void (*DispatchFn)(EventWorker* worker, const Event* event, EventCallbackFn callback);
+
+static void DispatchReady(EventWorker* worker, const Event* event, EventCallbackFn callback) {
+    (void) worker;
+    (void) event;
+
+    ((OnReadyFn) callback)();
+}
+
+static void DispatchMessageCreate(EventWorker* worker, const Event* event, EventCallbackFn callback) {
+    Message message = {0};
+    int err;
+    if (event->encoding == GATEWAY_ENCODING_ETF) {
+        err = ParseMessageEtf(&message, &worker->arena, (const unsigned char*) event->json, event->terms, event->d);
+    } else {
+        err = ParseMessage(&message, &worker->arena, event->json, event->tokens, event->d);
+    }
+
+    if (err == 0) ((OnMessageCreateFn) callback)(&message);
+}
+
+// events without an entry have nothing to hand to a callback yet
+static const DispatchFn g_dispatchers[GATEWAY_EVENT_COUNT] = {
+        [GATEWAY_EVENT_READY] = DispatchReady,
+        [GATEWAY_EVENT_MESSAGE_CREATE] = DispatchMessageCreate,
+};
+
+static void Dispatch(EventWorker* worker, Event* event) {
+    uint64_t start = 0;
+    if (g_event_loop.handler != NULL) {
+        start = NowUs();
+        Histogram_Record(g_event_loop.queue_wait, start - event->queued_at);
+    }
+
+    DispatchFn dispatch = g_dispatchers[event->type];
+    EventCallbackFn callback = Discord_GetCallback(event->type);
+    if (dispatch != NULL && callback != NULL) dispatch(worker, event, callback);
+
+    if (g_event_loop.handler != NULL) Histogram_Record(g_event_loop.handler, NowUs() - start);
+
+    ArenaReset(&worker->arena);
+    Event_Free(event);
+}
+
+static void* WorkerMain(void* arg) {
+    EventWorker* worker = arg;
+    g_current_worker = worker;
+
+    while (true) {
+        Event* event = PopOwn(worker);
+        if (event == NULL) event = Steal(worker);
+
+        if (event != NULL) {
+            Dispatch(worker, event);
+            continue;
+        }
+
+        pthread_mutex_lock(&g_event_loop.lock);
+        worker->sleeping = true;
+        atomic_fetch_add(&g_event_loop.sleeping, 1);
+
+        while (atomic_load(&worker->lane_length) == 0 && atomic_load(&g_event_loop.pending) == 0 && atomic_load(&g_event_loop.active)) {
+            pthread_cond_wait(&worker->cond, &g_event_loop.lock);
+        }
+
+        atomic_fetch_sub(&g_event_loop.sleeping, 1);
+        worker->sleeping = false;
+        bool done = !atomic_load(&g_event_loop.active) && atomic_load(&g_event_loop.pending) == 0 && atomic_load(&worker->lane_length) == 0;
+        pthread_mutex_unlock(&g_event_loop.lock);
+
+        if (done) break;
+    }
+
+    ArenaDestroy(worker->arena);
+    g_current_worker = NULL;
+    return NULL;
+}
+
+void EventLoop_SetStageHistograms(Histogram* queue_wait, Histogram* handler) {
+    if (queue_wait == NULL || handler == NULL) queue_wait = handler = NULL;
+
+    g_event_loop.queue_wait = queue_wait;
+    g_event_loop.handler = handler;
+}
+
+void EventLoop_Init(int thread_count, EventDispatchMode mode) {
+    if (thread_count <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cores > 0 ? (int) cores : 1;
+    }
+
+    g_event_loop.workers = HeapAlloc(thread_count * sizeof(EventWorker));
+    g_event_loop.worker_count = thread_count;
+    g_event_loop.mode = mode;
+    atomic_store(&g_event_loop.active, true);
+
+    pthread_mutex_init(&g_event_loop.lock, NULL);
+    atomic_store(&g_event_loop.pending, 0);
+    atomic_store(&g_event_loop.sleeping, 0);
+    atomic_store(&g_event_loop.next_worker, 0);
+
+    for (int i = 0; i < thread_count; i++) {
+        EventWorker* worker = &g_event_loop.workers[i];
+        worker->index = i;
+        worker->front = NULL;
+        worker->back = NULL;
+        worker->lane_front = NULL;
+        worker->lane_back = NULL;
+        atomic_store(&worker->lane_length, 0);
+        worker->next_seq = 0;
+        worker->sleeping = false;
+        worker->arena = ArenaCreate(0);
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->cond, NULL);
+    }
+
+    // start them after everything is set up because thieves look at the other workers right away
+    for (int i = 0; i < thread_count; i++) {
+        pthread_create(&g_event_loop.workers[i].thread, NULL, WorkerMain, &g_event_loop.workers[i]);
+    }
 }
 
 void EventLoop_Shutdown(bool join) {
+    if (g_event_loop.workers == NULL) return;
+
+    pthread_mutex_lock(&g_event_loop.lock);
+    atomic_store(&g_event_loop.active, false);
+    for (int i = 0; i < g_event_loop.worker_count; i++) {
+        pthread_cond_signal(&g_event_loop.workers[i].cond);
+    }
+    pthread_mutex_unlock(&g_event_loop.lock);
+
+    if (!join) {
+        // they will still drain whatever is queued before exiting, we just don't wait for it
+        for (int i = 0; i < g_event_loop.worker_count; i++) {
+            pthread_detach(g_event_loop.workers[i].thread);
+        }
+        return;
+    }
+
+    for (int i = 0; i < g_event_loop.worker_count; i++) {
+        pthread_join(g_event_loop.workers[i].thread, NULL);
+    }
+
+    // not in the join loop, workers still running can try to steal from ones that already exited
+    for (int i = 0; i < g_event_loop.worker_count; i++) {
+        pthread_mutex_destroy(&g_event_loop.workers[i].lock);
+        pthread_cond_destroy(&g_event_loop.workers[i].cond);
+    }
+
+    pthread_mutex_destroy(&g_event_loop.lock);
+
+    HeapFree(g_event_loop.workers);
+    g_event_loop.workers = NULL;
+    g_event_loop.worker_count = 0;
+}
+
+// Wakes the worker the event went to, or for a stealable event anyone who is asleep
+static void WakeWorker(EventWorker* target, bool keyed) {
+    pthread_mutex_lock(&g_event_loop.lock);
+
+    if (target->sleeping) {
+        pthread_cond_signal(&target->cond);
+    } else if (!keyed) {
+        for (int i = 0; i < g_event_loop.worker_count; i++) {
+            EventWorker* worker = &g_event_loop.workers[i];
+            if (worker->sleeping) {
+                pthread_cond_signal(&worker->cond);
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&g_event_loop.lock);
 }
 
 void EventLoop_Enqueue(Event* event) {
+    if (g_event_loop.workers == NULL || !atomic_load(&g_event_loop.active)) {
+        Event_Free(event);
+        return;
+    }
+
+    event->next = NULL;
+    if (g_event_loop.queue_wait != NULL) event->queued_at = NowUs();
+
+    uint64_t key;
+    bool keyed = g_event_loop.mode != EVENT_DISPATCH_ANY && FindEventKey(event, &key);
+
+    unsigned int index = keyed ? LaneOf(key) : atomic_fetch_add(&g_event_loop.next_worker, 1) % g_event_loop.worker_count;
+    EventWorker* worker = &g_event_loop.workers[index];
+
+    pthread_mutex_lock(&worker->lock);
+    event->seq = worker->next_seq++;
+
+    if (keyed) {
+        if (worker->lane_back != NULL) worker->lane_back->next = event;
+        else worker->lane_front = event;
+        worker->lane_back = event;
+        atomic_fetch_add(&worker->lane_length, 1);
+    } else {
+        if (worker->back != NULL) worker->back->next = event;
+        else worker->front = event;
+        worker->back = event;
+        atomic_fetch_add(&g_event_loop.pending, 1);
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    // only take the lock if someone is actually asleep. workers bump sleeping before re-checking the counts, so one of us always sees the other
+    if (atomic_load(&g_event_loop.sleeping) > 0) WakeWorker(worker, keyed);
+}
+
+bool EventLoop_WantsEvent(GatewayEventType type) {
+    return g_dispatchers[type] != NULL && Discord_GetCallback(type) != NULL;
+}
+
+Arena* EventLoop_GetWorkerArena(void) {
+    if (g_current_worker == NULL) return NULL;
+    return &g_current_worker->arena;
 }
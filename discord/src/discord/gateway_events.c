@@ -0,0 +1,154 @@
+// Copyright 2025 JesusTouchMe
+
+#include "discord/gateway_events.h"
+
+#include "utils/log.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Perfect hash from event name to GatewayEventType. g_names is the source of truth, the slot table gets built from it
+// once at startup with a seed where no two names land in the same slot. EVENT_HASH_SEED is one that works for the names
+// below, if a new name collides the search moves on to the next seed and says so, so EVENT_HASH_SEED can be updated.
+// A lookup is one hash over the name, one slot and one memcmp, no matter how many names there are.
+
+#define EVENT_HASH_SLOTS 256 // power of two, and small enough that the slots fit in a uint8_t
+#define EVENT_HASH_SEED 0x812123a6u
+
+_Static_assert(GATEWAY_EVENT_COUNT <= 256, "slots store the type in a uint8_t");
+
+static const char* const g_names[GATEWAY_EVENT_COUNT] = {
+        [GATEWAY_EVENT_READY] = "READY",
+        [GATEWAY_EVENT_RESUMED] = "RESUMED",
+        [GATEWAY_EVENT_APPLICATION_COMMAND_PERMISSIONS_UPDATE] = "APPLICATION_COMMAND_PERMISSIONS_UPDATE",
+        [GATEWAY_EVENT_AUTO_MODERATION_RULE_CREATE] = "AUTO_MODERATION_RULE_CREATE",
+        [GATEWAY_EVENT_AUTO_MODERATION_RULE_UPDATE] = "AUTO_MODERATION_RULE_UPDATE",
+        [GATEWAY_EVENT_AUTO_MODERATION_RULE_DELETE] = "AUTO_MODERATION_RULE_DELETE",
+        [GATEWAY_EVENT_AUTO_MODERATION_ACTION_EXECUTION] = "AUTO_MODERATION_ACTION_EXECUTION",
+        [GATEWAY_EVENT_CHANNEL_CREATE] = "CHANNEL_CREATE",
+        [GATEWAY_EVENT_CHANNEL_UPDATE] = "CHANNEL_UPDATE",
+        [GATEWAY_EVENT_CHANNEL_DELETE] = "CHANNEL_DELETE",
+        [GATEWAY_EVENT_CHANNEL_PINS_UPDATE] = "CHANNEL_PINS_UPDATE",
+        [GATEWAY_EVENT_THREAD_CREATE] = "THREAD_CREATE",
+        [GATEWAY_EVENT_THREAD_UPDATE] = "THREAD_UPDATE",
+        [GATEWAY_EVENT_THREAD_DELETE] = "THREAD_DELETE",
+        [GATEWAY_EVENT_THREAD_LIST_SYNC] = "THREAD_LIST_SYNC",
+        [GATEWAY_EVENT_THREAD_MEMBER_UPDATE] = "THREAD_MEMBER_UPDATE",
+        [GATEWAY_EVENT_THREAD_MEMBERS_UPDATE] = "THREAD_MEMBERS_UPDATE",
+        [GATEWAY_EVENT_ENTITLEMENT_CREATE] = "ENTITLEMENT_CREATE",
+        [GATEWAY_EVENT_ENTITLEMENT_UPDATE] = "ENTITLEMENT_UPDATE",
+        [GATEWAY_EVENT_ENTITLEMENT_DELETE] = "ENTITLEMENT_DELETE",
+        [GATEWAY_EVENT_GUILD_CREATE] = "GUILD_CREATE",
+        [GATEWAY_EVENT_GUILD_UPDATE] = "GUILD_UPDATE",
+        [GATEWAY_EVENT_GUILD_DELETE] = "GUILD_DELETE",
+        [GATEWAY_EVENT_GUILD_AUDIT_LOG_ENTRY_CREATE] = "GUILD_AUDIT_LOG_ENTRY_CREATE",
+        [GATEWAY_EVENT_GUILD_BAN_ADD] = "GUILD_BAN_ADD",
+        [GATEWAY_EVENT_GUILD_BAN_REMOVE] = "GUILD_BAN_REMOVE",
+        [GATEWAY_EVENT_GUILD_EMOJIS_UPDATE] = "GUILD_EMOJIS_UPDATE",
+        [GATEWAY_EVENT_GUILD_STICKERS_UPDATE] = "GUILD_STICKERS_UPDATE",
+        [GATEWAY_EVENT_GUILD_INTEGRATIONS_UPDATE] = "GUILD_INTEGRATIONS_UPDATE",
+        [GATEWAY_EVENT_GUILD_MEMBER_ADD] = "GUILD_MEMBER_ADD",
+        [GATEWAY_EVENT_GUILD_MEMBER_REMOVE] = "GUILD_MEMBER_REMOVE",
+        [GATEWAY_EVENT_GUILD_MEMBER_UPDATE] = "GUILD_MEMBER_UPDATE",
+        [GATEWAY_EVENT_GUILD_MEMBERS_CHUNK] = "GUILD_MEMBERS_CHUNK",
+        [GATEWAY_EVENT_GUILD_ROLE_CREATE] = "GUILD_ROLE_CREATE",
+        [GATEWAY_EVENT_GUILD_ROLE_UPDATE] = "GUILD_ROLE_UPDATE",
+        [GATEWAY_EVENT_GUILD_ROLE_DELETE] = "GUILD_ROLE_DELETE",
+        [GATEWAY_EVENT_GUILD_SCHEDULED_EVENT_CREATE] = "GUILD_SCHEDULED_EVENT_CREATE",
+        [GATEWAY_EVENT_GUILD_SCHEDULED_EVENT_UPDATE] = "GUILD_SCHEDULED_EVENT_UPDATE",
+        [GATEWAY_EVENT_GUILD_SCHEDULED_EVENT_DELETE] = "GUILD_SCHEDULED_EVENT_DELETE",
+        [GATEWAY_EVENT_GUILD_SCHEDULED_EVENT_USER_ADD] = "GUILD_SCHEDULED_EVENT_USER_ADD",
+        [GATEWAY_EVENT_GUILD_SCHEDULED_EVENT_USER_REMOVE] = "GUILD_SCHEDULED_EVENT_USER_REMOVE",
+        [GATEWAY_EVENT_GUILD_SOUNDBOARD_SOUND_CREATE] = "GUILD_SOUNDBOARD_SOUND_CREATE",
+        [GATEWAY_EVENT_GUILD_SOUNDBOARD_SOUND_UPDATE] = "GUILD_SOUNDBOARD_SOUND_UPDATE",
+        [GATEWAY_EVENT_GUILD_SOUNDBOARD_SOUND_DELETE] = "GUILD_SOUNDBOARD_SOUND_DELETE",
+        [GATEWAY_EVENT_GUILD_SOUNDBOARD_SOUNDS_UPDATE] = "GUILD_SOUNDBOARD_SOUNDS_UPDATE",
+        [GATEWAY_EVENT_SOUNDBOARD_SOUNDS] = "SOUNDBOARD_SOUNDS",
+        [GATEWAY_EVENT_INTEGRATION_CREATE] = "INTEGRATION_CREATE",
+        [GATEWAY_EVENT_INTEGRATION_UPDATE] = "INTEGRATION_UPDATE",
+        [GATEWAY_EVENT_INTEGRATION_DELETE] = "INTEGRATION_DELETE",
+        [GATEWAY_EVENT_INTERACTION_CREATE] = "INTERACTION_CREATE",
+        [GATEWAY_EVENT_INVITE_CREATE] = "INVITE_CREATE",
+        [GATEWAY_EVENT_INVITE_DELETE] = "INVITE_DELETE",
+        [GATEWAY_EVENT_MESSAGE_CREATE] = "MESSAGE_CREATE",
+        [GATEWAY_EVENT_MESSAGE_UPDATE] = "MESSAGE_UPDATE",
+        [GATEWAY_EVENT_MESSAGE_DELETE] = "MESSAGE_DELETE",
+        [GATEWAY_EVENT_MESSAGE_DELETE_BULK] = "MESSAGE_DELETE_BULK",
+        [GATEWAY_EVENT_MESSAGE_REACTION_ADD] = "MESSAGE_REACTION_ADD",
+        [GATEWAY_EVENT_MESSAGE_REACTION_REMOVE] = "MESSAGE_REACTION_REMOVE",
+        [GATEWAY_EVENT_MESSAGE_REACTION_REMOVE_ALL] = "MESSAGE_REACTION_REMOVE_ALL",
+        [GATEWAY_EVENT_MESSAGE_REACTION_REMOVE_EMOJI] = "MESSAGE_REACTION_REMOVE_EMOJI",
+        [GATEWAY_EVENT_MESSAGE_POLL_VOTE_ADD] = "MESSAGE_POLL_VOTE_ADD",
+        [GATEWAY_EVENT_MESSAGE_POLL_VOTE_REMOVE] = "MESSAGE_POLL_VOTE_REMOVE",
+        [GATEWAY_EVENT_PRESENCE_UPDATE] = "PRESENCE_UPDATE",
+        [GATEWAY_EVENT_STAGE_INSTANCE_CREATE] = "STAGE_INSTANCE_CREATE",
+        [GATEWAY_EVENT_STAGE_INSTANCE_UPDATE] = "STAGE_INSTANCE_UPDATE",
+        [GATEWAY_EVENT_STAGE_INSTANCE_DELETE] = "STAGE_INSTANCE_DELETE",
+        [GATEWAY_EVENT_SUBSCRIPTION_CREATE] = "SUBSCRIPTION_CREATE",
+        [GATEWAY_EVENT_SUBSCRIPTION_UPDATE] = "SUBSCRIPTION_UPDATE",
+        [GATEWAY_EVENT_SUBSCRIPTION_DELETE] = "SUBSCRIPTION_DELETE",
+        [GATEWAY_EVENT_TYPING_START] = "TYPING_START",
+        [GATEWAY_EVENT_USER_UPDATE] = "USER_UPDATE",
+        [GATEWAY_EVENT_VOICE_CHANNEL_EFFECT_SEND] = "VOICE_CHANNEL_EFFECT_SEND",
+        [GATEWAY_EVENT_VOICE_STATE_UPDATE] = "VOICE_STATE_UPDATE",
+        [GATEWAY_EVENT_VOICE_SERVER_UPDATE] = "VOICE_SERVER_UPDATE",
+        [GATEWAY_EVENT_WEBHOOKS_UPDATE] = "WEBHOOKS_UPDATE",
+};
+
+static size_t g_name_lengths[GATEWAY_EVENT_COUNT];
+static uint8_t g_slots[EVENT_HASH_SLOTS]; // GATEWAY_EVENT_UNKNOWN is 0, which doubles as empty
+static uint32_t g_seed = EVENT_HASH_SEED;
+
+// fnv-1a with the seed as the offset basis and a final shift so the low bits see the whole name
+static uint32_t HashName(uint32_t seed, const char* name, size_t length) {
+    uint32_t hash = seed;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+
+    return hash ^ (hash >> 15);
+}
+
+static bool TryBuildTable(uint32_t seed) {
+    memset(g_slots, 0, sizeof(g_slots));
+
+    for (int type = 1; type < GATEWAY_EVENT_COUNT; type++) {
+        uint32_t slot = HashName(seed, g_names[type], g_name_lengths[type]) & (EVENT_HASH_SLOTS - 1);
+        if (g_slots[slot] != GATEWAY_EVENT_UNKNOWN) return false;
+
+        g_slots[slot] = (uint8_t) type;
+    }
+
+    return true;
+}
+
+void GatewayEvent_InitTable(void) {
+    for (int type = 1; type < GATEWAY_EVENT_COUNT; type++) {
+        g_name_lengths[type] = strlen(g_names[type]);
+    }
+
+    uint32_t seed = EVENT_HASH_SEED;
+    while (!TryBuildTable(seed)) seed++;
+
+    if (seed != EVENT_HASH_SEED) LOG(LOG_CATEGORY_CORE, LOG_LEVEL_WARN, "event name table: seed 0x%08x has collisions, using 0x%08x", EVENT_HASH_SEED, seed);
+    g_seed = seed;
+}
+
+GatewayEventType GatewayEvent_FromName(const char* name, size_t length) {
+    uint32_t slot = HashName(g_seed, name, length) & (EVENT_HASH_SLOTS - 1);
+    GatewayEventType type = g_slots[slot];
+
+    // anything not in the table hashes somewhere too, so the name still has to match
+    if (type == GATEWAY_EVENT_UNKNOWN || g_name_lengths[type] != length || memcmp(g_names[type], name, length) != 0) {
+        return GATEWAY_EVENT_UNKNOWN;
+    }
+
+    return type;
+}
+
+const char* GatewayEvent_GetName(GatewayEventType type) {
+    if (type == GATEWAY_EVENT_UNKNOWN || (unsigned int) type >= GATEWAY_EVENT_COUNT) return NULL;
+    return g_names[type];
+}
@@ -2,7 +2,12 @@
 
 #include "discord.h"
 
+#include "utils/log.h"
+
+#include <openssl/rand.h>
+
 #include <inttypes.h>
+#include <sys/stat.h>
 
 static void CreatePath(char* out, size_t out_size, snowflake_t channel_id) {
     snprintf(out, out_size, "/api/v10/channels/%" PRIu64 "/messages", channel_id);
@@ -70,39 +75,38 @@ static void EncodeMessageContent(char* req, size_t req_size, int* offset, const
     }
 }
 
-int SendMessageEx(snowflake_t channel_id, const MessageContent* message) {
-    char path[256];
-    char req[1024];
+// the message object, with attachment as the filename of attachment 0 if it isn't NULL
+static void EncodeMessage(char* req, size_t req_size, const MessageContent* message, const char* attachment) {
     int offset = 0;
 
-    offset += snprintf(req + offset, sizeof(req) - offset, "{\"content\":\"%s\"", message->content);
+    offset += snprintf(req + offset, req_size - offset, "{\"content\":\"%s\"", message->content);
     switch (message->nonce.state) {
         case OPTION_ABSENT:
             break;
         case OPTION_NULL:
-            offset += snprintf(req + offset, sizeof(req) - offset, ",\"nonce\":null");
+            offset += snprintf(req + offset, req_size - offset, ",\"nonce\":null");
             break;
         case OPTION_EXISTS:
             if (message->nonce.value.is_string) {
-                offset += snprintf(req + offset, sizeof(req) - offset, ",\"nonce\":\"%s\"", message->nonce.value.string);
+                offset += snprintf(req + offset, req_size - offset, ",\"nonce\":\"%s\"", message->nonce.value.string);
             } else {
-                offset += snprintf(req + offset, sizeof(req) - offset, ",\"nonce\":% " PRIu64 "", message->nonce.value.integer);
+                offset += snprintf(req + offset, req_size - offset, ",\"nonce\":% " PRIu64 "", message->nonce.value.integer);
             }
             break;
     }
 
-    offset += snprintf(req + offset, sizeof(req) - offset, ",\"tts\":%s", BOOLEAN_TO_STRING(message->tts));
+    offset += snprintf(req + offset, req_size - offset, ",\"tts\":%s", BOOLEAN_TO_STRING(message->tts));
 
     switch (message->message_reference.state) {
         case OPTION_ABSENT:
             break;
         case OPTION_NULL:
-            offset += snprintf(req + offset, sizeof(req) - offset, ",\"message_reference\":null");
+            offset += snprintf(req + offset, req_size - offset, ",\"message_reference\":null");
             break;
         case OPTION_EXISTS:
-            offset += snprintf(req + offset, sizeof(req) - offset, ",\"message_reference\":{");
-            EncodeMessageContent(req, sizeof(req), &offset, &message->message_reference.value);
-            offset += snprintf(req + offset, sizeof(req) - offset, "}");
+            offset += snprintf(req + offset, req_size - offset, ",\"message_reference\":{");
+            EncodeMessageContent(req, req_size, &offset, &message->message_reference.value);
+            offset += snprintf(req + offset, req_size - offset, "}");
             break;
     }
 
@@ -110,27 +114,100 @@ int SendMessageEx(snowflake_t channel_id, const MessageContent* message) {
         case OPTION_ABSENT:
             break;
         case OPTION_NULL:
-            offset += snprintf(req + offset, sizeof(req) - offset, ",\"enforce_nonce\":null");
+            offset += snprintf(req + offset, req_size - offset, ",\"enforce_nonce\":null");
             break;
         case OPTION_EXISTS:
-            offset += snprintf(req + offset, sizeof(req) - offset, ",\"enforce_nonce\":%s", BOOLEAN_TO_STRING(message->enforce_nonce.value));
+            offset += snprintf(req + offset, req_size - offset, ",\"enforce_nonce\":%s", BOOLEAN_TO_STRING(message->enforce_nonce.value));
             break;
     }
 
-    offset += snprintf(req + offset, sizeof(req) - offset, "}");
+    if (attachment != NULL) {
+        offset += snprintf(req + offset, req_size - offset, ",\"attachments\":[{\"id\":0,\"filename\":\"%s\"}]", attachment);
+    }
+
+    offset += snprintf(req + offset, req_size - offset, "}");
+}
 
+int SendMessageEx(snowflake_t channel_id, const MessageContent* message) {
+    char path[256];
+    char req[1024];
+
+    EncodeMessage(req, sizeof(req), message, NULL);
     CreatePath(path, sizeof(path), channel_id);
 
     HTTPResponse* res = DiscordAPI_SendRequest(Discord_GetEventArena(), "POST", path, req);
     if (res == NULL || res->code != 200) {
         if (res != NULL) {
-            printf("SendMessageEx error: code=%d, body:\n", res->code);
-            printf("%s\n", res->body);
+            LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "SendMessageEx error: code=%d, body:\n%s", res->code, res->body);
         } else {
-            printf("SendMessageEx error: web problem\n");
+            LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "SendMessageEx error: web problem");
         }
 
-        fflush(stdout);
+        return 1;
+    }
+
+    return 0;
+}
+
+int SendMessageWithFile(snowflake_t channel_id, const MessageContent* message, const char* filename, int fd) {
+    char path[256];
+    char json[1280];
+    char boundary[40];
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "SendMessageWithFile error: not a regular file");
+        return 1;
+    }
+
+    // it goes into the json and a header as is
+    for (const char* c = filename; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\' || (unsigned char) *c < 0x20) {
+            LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "SendMessageWithFile error: can't use %s as a filename", filename);
+            return 1;
+        }
+    }
+
+    unsigned char random[12];
+    RAND_bytes(random, sizeof(random));
+    int length = snprintf(boundary, sizeof(boundary), "gambler");
+    for (size_t i = 0; i < sizeof(random); i++) length += snprintf(boundary + length, sizeof(boundary) - length, "%02x", random[i]);
+
+    EncodeMessage(json, sizeof(json), message, filename);
+
+    // payload_json and then files[0], whose bytes are the file itself
+    char head[2048];
+    char tail[64];
+    int head_length = snprintf(head, sizeof(head),
+                               "--%s\r\n"
+                               "Content-Disposition: form-data; name=\"payload_json\"\r\n"
+                               "Content-Type: application/json\r\n\r\n"
+                               "%s\r\n"
+                               "--%s\r\n"
+                               "Content-Disposition: form-data; name=\"files[0]\"; filename=\"%s\"\r\n"
+                               "Content-Type: application/octet-stream\r\n\r\n",
+                               boundary, json, boundary, filename);
+    int tail_length = snprintf(tail, sizeof(tail), "\r\n--%s--\r\n", boundary);
+
+    if (head_length >= (int) sizeof(head)) {
+        LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "SendMessageWithFile error: message too long");
+        return 1;
+    }
+
+    char content_type[80];
+    snprintf(content_type, sizeof(content_type), "multipart/form-data; boundary=%s", boundary);
+
+    HTTPFileBody body = {head, (size_t) head_length, fd, 0, (size_t) st.st_size, tail, (size_t) tail_length};
+
+    CreatePath(path, sizeof(path), channel_id);
+
+    HTTPResponse* res = DiscordAPI_SendFile(Discord_GetEventArena(), "POST", path, content_type, &body);
+    if (res == NULL || res->code != 200) {
+        if (res != NULL) {
+            LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "SendMessageWithFile error: code=%d, body:\n%s", res->code, res->body);
+        } else {
+            LOG(LOG_CATEGORY_REST, LOG_LEVEL_ERROR, "SendMessageWithFile error: web problem");
+        }
 
         return 1;
     }
@@ -3,6 +3,7 @@
 #include "discord/types.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 static int ParseInteger(integer_t* i, const char* json, const jsmntok_t* tokens, JsonObject object, const char* key) {
     JsonObject obj = jsmn_find_key(json, tokens, object, key);
@@ -27,11 +28,61 @@ static int ParseString(string_t* s, const char* json, const jsmntok_t* tokens, J
     if (tokens[obj].type != JSMN_STRING) return 1;
     int len = tokens[obj].end - tokens[obj].start + 1;
     char* str = ArenaAlloc(arena, len);
-    jsmn_copy_string(json, tokens, obj, str, len);
+    jsmn_copy_unescaped(json, tokens, obj, str, len);
     *s = str;
     return 0;
 }
 
+static int ParseOptionalString(OptionalState* state, string_t* s, const char* json, const jsmntok_t* tokens, JsonObject object, const char* key, Arena* arena) {
+    JsonObject obj = jsmn_find_key(json, tokens, object, key);
+    if (obj == JSON_NULL) {
+        *state = OPTION_ABSENT;
+        return 0;
+    }
+
+    if (tokens[obj].type == JSMN_PRIMITIVE && json[tokens[obj].start] == 'n') {
+        *state = OPTION_NULL;
+        return 0;
+    }
+
+    if (ParseString(s, json, tokens, object, key, arena) != 0) return 1;
+    *state = OPTION_EXISTS;
+    return 0;
+}
+
+static int ParseOptionalBoolean(OptionalState* state, boolean_t* b, const char* json, const jsmntok_t* tokens, JsonObject object, const char* key) {
+    JsonObject obj = jsmn_find_key(json, tokens, object, key);
+    if (obj == JSON_NULL) {
+        *state = OPTION_ABSENT;
+        return 0;
+    }
+
+    if (tokens[obj].type != JSMN_PRIMITIVE) return 1;
+
+    char c = json[tokens[obj].start];
+    if (c == 'n') {
+        *state = OPTION_NULL;
+        return 0;
+    }
+
+    *b = c == 't';
+    *state = OPTION_EXISTS;
+    return 0;
+}
+
+int ParseUser(User* user, Arena* arena, const char* json, const jsmntok_t* tokens, JsonObject user_obj) {
+    if (user_obj == JSON_NULL || tokens[user_obj].type != JSMN_OBJECT) return 1;
+
+    if (ParseSnowflake(&user->id, json, tokens, user_obj, "id") != 0) return 1;
+    if (ParseString(&user->username, json, tokens, user_obj, "username", arena) != 0) return 1;
+    if (ParseString(&user->discriminator, json, tokens, user_obj, "discriminator", arena) != 0) user->discriminator = "0";
+    if (ParseOptionalString(&user->global_name.state, &user->global_name.value, json, tokens, user_obj, "global_name", arena) != 0) return 1;
+    if (ParseOptionalString(&user->avatar.state, &user->avatar.value, json, tokens, user_obj, "avatar", arena) != 0) return 1;
+    if (ParseOptionalBoolean(&user->bot.state, &user->bot.value, json, tokens, user_obj, "bot") != 0) return 1;
+
+    return 0;
+}
+
 int ParseMessage(Message* message, Arena* arena, const char* json, const jsmntok_t* tokens, JsonObject message_obj) {
     if (message_obj == JSON_NULL || tokens[message_obj].type != JSMN_OBJECT) return 1;
 
@@ -39,5 +90,105 @@ int ParseMessage(Message* message, Arena* arena, const char* json, const jsmntok
     if (ParseSnowflake(&message->channel_id, json, tokens, message_obj, "channel_id") != 0) return 1;
     if (ParseString(&message->content, json, tokens, message_obj, "content", arena) != 0) return 1;
 
+    JsonObject author = jsmn_find_key(json, tokens, message_obj, "author");
+    if (author != JSON_NULL && ParseUser(&message->author, arena, json, tokens, author) != 0) return 1;
+
+    return 0;
+}
+
+// etf versions of the above. snowflakes are real integers here and strings need no unescaping
+
+static int ParseEtfSnowflake(snowflake_t* i, const unsigned char* data, const EtfTerm* terms, int object, const char* key) {
+    int term = etf_find_key(data, terms, object, key);
+    if (term < 0) return 1;
+
+    if (terms[term].type == ETF_INTEGER) {
+        if (terms[term].negative) return 1;
+        *i = terms[term].integer;
+        return 0;
+    }
+
+    // tolerate string snowflakes in case they ever show up
+    if (terms[term].type == ETF_BINARY) {
+        char buf[24];
+        etf_copy_string(data, terms, term, buf, sizeof(buf));
+        *i = strtoull(buf, NULL, 10);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int ParseEtfString(string_t* s, const unsigned char* data, const EtfTerm* terms, int object, const char* key, Arena* arena) {
+    int term = etf_find_key(data, terms, object, key);
+    if (term < 0) return 1;
+    if (terms[term].type != ETF_BINARY) return 1;
+    size_t len = terms[term].end - terms[term].start;
+    char* str = ArenaAlloc(arena, len + 1);
+    memcpy(str, data + terms[term].start, len);
+    str[len] = '\0';
+    *s = str;
+    return 0;
+}
+
+static int ParseEtfOptionalString(OptionalState* state, string_t* s, const unsigned char* data, const EtfTerm* terms, int object, const char* key, Arena* arena) {
+    int term = etf_find_key(data, terms, object, key);
+    if (term < 0) {
+        *state = OPTION_ABSENT;
+        return 0;
+    }
+
+    if (etf_is_nil(data, &terms[term])) {
+        *state = OPTION_NULL;
+        return 0;
+    }
+
+    if (ParseEtfString(s, data, terms, object, key, arena) != 0) return 1;
+    *state = OPTION_EXISTS;
+    return 0;
+}
+
+static int ParseEtfOptionalBoolean(OptionalState* state, boolean_t* b, const unsigned char* data, const EtfTerm* terms, int object, const char* key) {
+    int term = etf_find_key(data, terms, object, key);
+    if (term < 0) {
+        *state = OPTION_ABSENT;
+        return 0;
+    }
+
+    if (terms[term].type != ETF_ATOM) return 1;
+
+    if (etf_is_nil(data, &terms[term])) {
+        *state = OPTION_NULL;
+        return 0;
+    }
+
+    *b = etf_eq(data, &terms[term], "true");
+    *state = OPTION_EXISTS;
+    return 0;
+}
+
+int ParseUserEtf(User* user, Arena* arena, const unsigned char* data, const EtfTerm* terms, int user_obj) {
+    if (user_obj < 0 || terms[user_obj].type != ETF_MAP) return 1;
+
+    if (ParseEtfSnowflake(&user->id, data, terms, user_obj, "id") != 0) return 1;
+    if (ParseEtfString(&user->username, data, terms, user_obj, "username", arena) != 0) return 1;
+    if (ParseEtfString(&user->discriminator, data, terms, user_obj, "discriminator", arena) != 0) user->discriminator = "0";
+    if (ParseEtfOptionalString(&user->global_name.state, &user->global_name.value, data, terms, user_obj, "global_name", arena) != 0) return 1;
+    if (ParseEtfOptionalString(&user->avatar.state, &user->avatar.value, data, terms, user_obj, "avatar", arena) != 0) return 1;
+    if (ParseEtfOptionalBoolean(&user->bot.state, &user->bot.value, data, terms, user_obj, "bot") != 0) return 1;
+
+    return 0;
+}
+
+int ParseMessageEtf(Message* message, Arena* arena, const unsigned char* data, const EtfTerm* terms, int message_obj) {
+    if (message_obj < 0 || terms[message_obj].type != ETF_MAP) return 1;
+
+    if (ParseEtfSnowflake(&message->id, data, terms, message_obj, "id") != 0) return 1;
+    if (ParseEtfSnowflake(&message->channel_id, data, terms, message_obj, "channel_id") != 0) return 1;
+    if (ParseEtfString(&message->content, data, terms, message_obj, "content", arena) != 0) return 1;
+
+    int author = etf_find_key(data, terms, message_obj, "author");
+    if (author >= 0 && ParseUserEtf(&message->author, arena, data, terms, author) != 0) return 1;
+
     return 0;
 }
@@ -0,0 +1,478 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/etf.h"
+
+#include "internal/memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ETF_MAX_DEPTH 128
+
+#define NEW_FLOAT_EXT 70
+#define SMALL_INTEGER_EXT 97
+#define INTEGER_EXT 98
+#define FLOAT_EXT 99
+#define ATOM_EXT 100
+#define SMALL_TUPLE_EXT 104
+#define LARGE_TUPLE_EXT 105
+#define NIL_EXT 106
+#define STRING_EXT 107
+#define LIST_EXT 108
+#define BINARY_EXT 109
+#define SMALL_BIG_EXT 110
+#define LARGE_BIG_EXT 111
+#define SMALL_ATOM_EXT 115
+#define MAP_EXT 116
+#define ATOM_UTF8_EXT 118
+#define SMALL_ATOM_UTF8_EXT 119
+
+typedef struct EtfParser {
+    const unsigned char* data;
+    size_t length;
+    size_t pos;
+
+    EtfTerm* terms;
+    unsigned int num_terms;
+    unsigned int next;
+} EtfParser;
+
+static uint16_t ReadU16(const unsigned char* p) {
+    return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+static uint32_t ReadU32(const unsigned char* p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+#define NEED(parser, n) if ((parser)->length - (parser)->pos < (size_t) (n)) return ETF_ERROR_PART
+
+static int ParseTerm(EtfParser* parser, int depth);
+
+static int ParseChildren(EtfParser* parser, uint64_t count, int depth) {
+    for (uint64_t i = 0; i < count; i++) {
+        int err = ParseTerm(parser, depth + 1);
+        if (err < 0) return err;
+    }
+    return 0;
+}
+
+static int ParseBig(EtfParser* parser, EtfTerm* term, uint32_t digits) {
+    NEED(parser, 1 + (size_t) digits);
+
+    bool negative = parser->data[parser->pos] != 0;
+    const unsigned char* bytes = parser->data + parser->pos + 1;
+    parser->pos += 1 + digits;
+
+    // snowflakes are the only bigs we get and they always fit in 64 bits
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < digits; i++) {
+        if (i >= 8) {
+            if (bytes[i] != 0) return ETF_ERROR_INVAL;
+            continue;
+        }
+        value |= (uint64_t) bytes[i] << (8 * i);
+    }
+
+    if (term != NULL) {
+        term->type = ETF_INTEGER;
+        term->negative = negative && value != 0;
+        term->integer = value;
+    }
+
+    return 0;
+}
+
+static int ParseTerm(EtfParser* parser, int depth) {
+    if (depth > ETF_MAX_DEPTH) return ETF_ERROR_INVAL;
+
+    NEED(parser, 1);
+    unsigned char tag = parser->data[parser->pos++];
+
+    unsigned int index = parser->next++;
+    EtfTerm* term = NULL;
+    if (parser->terms != NULL) {
+        if (index >= parser->num_terms) return ETF_ERROR_NOMEM;
+        term = &parser->terms[index];
+        memset(term, 0, sizeof(EtfTerm));
+    }
+
+    const unsigned char* p = parser->data + parser->pos;
+    uint64_t children = 0;
+
+    switch (tag) {
+        case SMALL_INTEGER_EXT: {
+            NEED(parser, 1);
+            if (term != NULL) {
+                term->type = ETF_INTEGER;
+                term->integer = p[0];
+            }
+            parser->pos += 1;
+            break;
+        }
+
+        case INTEGER_EXT: {
+            NEED(parser, 4);
+            int32_t value = (int32_t) ReadU32(p);
+            if (term != NULL) {
+                term->type = ETF_INTEGER;
+                term->negative = value < 0;
+                term->integer = value < 0 ? (uint64_t) -(int64_t) value : (uint64_t) value;
+            }
+            parser->pos += 4;
+            break;
+        }
+
+        case SMALL_BIG_EXT: {
+            NEED(parser, 1);
+            parser->pos += 1;
+            int err = ParseBig(parser, term, p[0]);
+            if (err < 0) return err;
+            break;
+        }
+
+        case LARGE_BIG_EXT: {
+            NEED(parser, 4);
+            parser->pos += 4;
+            int err = ParseBig(parser, term, ReadU32(p));
+            if (err < 0) return err;
+            break;
+        }
+
+        case NEW_FLOAT_EXT: {
+            NEED(parser, 8);
+            if (term != NULL) {
+                uint64_t bits = ((uint64_t) ReadU32(p) << 32) | ReadU32(p + 4);
+                term->type = ETF_FLOAT;
+                memcpy(&term->number, &bits, sizeof(double));
+            }
+            parser->pos += 8;
+            break;
+        }
+
+        case FLOAT_EXT: {
+            NEED(parser, 31);
+            if (term != NULL) {
+                char text[32];
+                memcpy(text, p, 31);
+                text[31] = '\0';
+                term->type = ETF_FLOAT;
+                term->number = strtod(text, NULL);
+            }
+            parser->pos += 31;
+            break;
+        }
+
+        case ATOM_EXT:
+        case ATOM_UTF8_EXT:
+        case STRING_EXT: {
+            NEED(parser, 2);
+            uint16_t len = ReadU16(p);
+            NEED(parser, 2 + (size_t) len);
+            if (term != NULL) {
+                term->type = tag == STRING_EXT ? ETF_BINARY : ETF_ATOM;
+                term->start = parser->pos + 2;
+                term->end = parser->pos + 2 + len;
+            }
+            parser->pos += 2 + len;
+            break;
+        }
+
+        case SMALL_ATOM_EXT:
+        case SMALL_ATOM_UTF8_EXT: {
+            NEED(parser, 1);
+            uint8_t len = p[0];
+            NEED(parser, 1 + (size_t) len);
+            if (term != NULL) {
+                term->type = ETF_ATOM;
+                term->start = parser->pos + 1;
+                term->end = parser->pos + 1 + len;
+            }
+            parser->pos += 1 + len;
+            break;
+        }
+
+        case BINARY_EXT: {
+            NEED(parser, 4);
+            uint32_t len = ReadU32(p);
+            NEED(parser, 4 + (size_t) len);
+            if (term != NULL) {
+                term->type = ETF_BINARY;
+                term->start = parser->pos + 4;
+                term->end = parser->pos + 4 + len;
+            }
+            parser->pos += 4 + (size_t) len;
+            break;
+        }
+
+        case NIL_EXT: {
+            if (term != NULL) term->type = ETF_LIST;
+            break;
+        }
+
+        case LIST_EXT: {
+            NEED(parser, 4);
+            children = ReadU32(p);
+            parser->pos += 4;
+            if (term != NULL) {
+                term->type = ETF_LIST;
+                term->size = (int) children;
+            }
+
+            int err = ParseChildren(parser, children, depth);
+            if (err < 0) return err;
+
+            // proper lists end with NIL_EXT, the gateway never sends improper ones
+            NEED(parser, 1);
+            if (parser->data[parser->pos] != NIL_EXT) return ETF_ERROR_INVAL;
+            parser->pos += 1;
+            break;
+        }
+
+        case MAP_EXT: {
+            NEED(parser, 4);
+            children = ReadU32(p);
+            parser->pos += 4;
+            if (term != NULL) {
+                term->type = ETF_MAP;
+                term->size = (int) children;
+            }
+
+            int err = ParseChildren(parser, children * 2, depth);
+            if (err < 0) return err;
+            break;
+        }
+
+        case SMALL_TUPLE_EXT:
+        case LARGE_TUPLE_EXT: {
+            size_t header = tag == SMALL_TUPLE_EXT ? 1 : 4;
+            NEED(parser, header);
+            children = tag == SMALL_TUPLE_EXT ? p[0] : ReadU32(p);
+            parser->pos += header;
+            if (term != NULL) {
+                term->type = ETF_TUPLE;
+                term->size = (int) children;
+            }
+
+            int err = ParseChildren(parser, children, depth);
+            if (err < 0) return err;
+            break;
+        }
+
+        default:
+            return ETF_ERROR_INVAL;
+    }
+
+    if (term != NULL) term->span = (int) (parser->next - index - 1);
+    return 0;
+}
+
+int etf_parse(const unsigned char* data, size_t length, EtfTerm* terms, unsigned int num_terms) {
+    if (length < 1 || data[0] != ETF_VERSION) return ETF_ERROR_INVAL;
+
+    EtfParser parser = {
+        .data = data,
+        .length = length,
+        .pos = 1,
+        .terms = terms,
+        .num_terms = num_terms,
+        .next = 0,
+    };
+
+    int err = ParseTerm(&parser, 0);
+    if (err < 0) return err;
+
+    return (int) parser.next;
+}
+
+int etf_scan_map(const unsigned char* data, size_t length, const char* const* keys, int key_count, EtfTerm* values) {
+    for (int i = 0; i < key_count; i++) memset(&values[i], 0, sizeof(EtfTerm));
+
+    if (length < 6 || data[0] != ETF_VERSION || data[1] != MAP_EXT) return ETF_ERROR_INVAL;
+
+    EtfParser parser = {
+        .data = data,
+        .length = length,
+        .pos = 6,
+    };
+
+    uint32_t pairs = ReadU32(data + 2);
+    int found = 0;
+
+    for (uint32_t pair = 0; pair < pairs && found < key_count; pair++) {
+        EtfTerm key;
+        parser.terms = &key;
+        parser.num_terms = 1;
+        parser.next = 0;
+
+        int err = ParseTerm(&parser, 1);
+        if (err < 0) return err;
+
+        int wanted = -1;
+        for (int i = 0; i < key_count; i++) {
+            if (values[i].type == ETF_UNDEFINED && etf_eq(data, &key, keys[i])) {
+                wanted = i;
+                break;
+            }
+        }
+
+        // a wanted value gets exactly one term, so one with children fails with ETF_ERROR_NOMEM
+        parser.terms = wanted >= 0 ? &values[wanted] : NULL;
+        parser.num_terms = 1;
+        parser.next = 0;
+
+        err = ParseTerm(&parser, 1);
+        if (err < 0) return err;
+
+        if (wanted >= 0) found++;
+    }
+
+    return found;
+}
+
+bool etf_eq(const unsigned char* data, const EtfTerm* term, const char* s) {
+    if (term->type != ETF_ATOM && term->type != ETF_BINARY) return false;
+    size_t len = term->end - term->start;
+    return strlen(s) == len && memcmp(data + term->start, s, len) == 0;
+}
+
+bool etf_is_nil(const unsigned char* data, const EtfTerm* term) {
+    return term->type == ETF_ATOM && etf_eq(data, term, "nil");
+}
+
+int etf_find_key(const unsigned char* data, const EtfTerm* terms, int map, const char* key) {
+    if (map < 0 || terms[map].type != ETF_MAP) return -1;
+
+    int i = map + 1;
+    for (int k = 0; k < terms[map].size; k++) {
+        int val = i + 1 + terms[i].span;
+        if (etf_eq(data, &terms[i], key)) return val;
+        i = val + 1 + terms[val].span;
+    }
+
+    return -1;
+}
+
+void etf_copy_string(const unsigned char* data, const EtfTerm* terms, int term, char* dest, size_t dest_size) {
+    size_t len = terms[term].end - terms[term].start;
+    if (len >= dest_size) len = dest_size - 1;
+    memcpy(dest, data + terms[term].start, len);
+    dest[len] = '\0';
+}
+
+void EtfWriter_Init(EtfWriter* writer) {
+    writer->capacity = 1024;
+    writer->data = HeapAlloc(writer->capacity);
+    writer->length = 0;
+}
+
+void EtfWriter_Destroy(EtfWriter* writer) {
+    HeapFree(writer->data);
+    writer->data = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+}
+
+static unsigned char* Reserve(EtfWriter* writer, size_t n) {
+    if (writer->length + n > writer->capacity) {
+        while (writer->length + n > writer->capacity) writer->capacity *= 2;
+        writer->data = HeapRealloc(writer->data, writer->capacity);
+    }
+
+    unsigned char* p = writer->data + writer->length;
+    writer->length += n;
+    return p;
+}
+
+static void WriteU32(unsigned char* p, uint32_t value) {
+    p[0] = (value >> 24) & 0xFF;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >> 8) & 0xFF;
+    p[3] = value & 0xFF;
+}
+
+void EtfWriter_Reset(EtfWriter* writer) {
+    writer->length = 0;
+    *Reserve(writer, 1) = ETF_VERSION;
+}
+
+void etf_write_map_header(EtfWriter* writer, uint32_t pairs) {
+    unsigned char* p = Reserve(writer, 5);
+    p[0] = MAP_EXT;
+    WriteU32(p + 1, pairs);
+}
+
+void etf_write_list_header(EtfWriter* writer, uint32_t count) {
+    unsigned char* p = Reserve(writer, 5);
+    p[0] = LIST_EXT;
+    WriteU32(p + 1, count);
+}
+
+void etf_write_nil(EtfWriter* writer) {
+    *Reserve(writer, 1) = NIL_EXT;
+}
+
+void etf_write_atom(EtfWriter* writer, const char* atom) {
+    size_t len = strlen(atom);
+    if (len > 255) len = 255;
+
+    unsigned char* p = Reserve(writer, 2 + len);
+    p[0] = SMALL_ATOM_UTF8_EXT;
+    p[1] = (unsigned char) len;
+    memcpy(p + 2, atom, len);
+}
+
+void etf_write_null(EtfWriter* writer) {
+    etf_write_atom(writer, "nil");
+}
+
+void etf_write_bool(EtfWriter* writer, bool value) {
+    etf_write_atom(writer, value ? "true" : "false");
+}
+
+void etf_write_binary(EtfWriter* writer, const char* data, size_t length) {
+    unsigned char* p = Reserve(writer, 5 + length);
+    p[0] = BINARY_EXT;
+    WriteU32(p + 1, (uint32_t) length);
+    memcpy(p + 5, data, length);
+}
+
+void etf_write_string(EtfWriter* writer, const char* s) {
+    etf_write_binary(writer, s, strlen(s));
+}
+
+static void WriteBig(EtfWriter* writer, uint64_t magnitude, bool negative) {
+    unsigned char digits[8];
+    int n = 0;
+    while (magnitude > 0) {
+        digits[n++] = magnitude & 0xFF;
+        magnitude >>= 8;
+    }
+
+    unsigned char* p = Reserve(writer, 3 + n);
+    p[0] = SMALL_BIG_EXT;
+    p[1] = (unsigned char) n;
+    p[2] = negative ? 1 : 0;
+    memcpy(p + 3, digits, n);
+}
+
+void etf_write_integer(EtfWriter* writer, int64_t value) {
+    if (value >= 0 && value <= 255) {
+        unsigned char* p = Reserve(writer, 2);
+        p[0] = SMALL_INTEGER_EXT;
+        p[1] = (unsigned char) value;
+    } else if (value >= INT32_MIN && value <= INT32_MAX) {
+        unsigned char* p = Reserve(writer, 5);
+        p[0] = INTEGER_EXT;
+        WriteU32(p + 1, (uint32_t) (int32_t) value);
+    } else if (value < 0) {
+        WriteBig(writer, (uint64_t) 0 - (uint64_t) value, true);
+    } else {
+        WriteBig(writer, (uint64_t) value, false);
+    }
+}
+
+void etf_write_unsigned(EtfWriter* writer, uint64_t value) {
+    if (value <= INT32_MAX) etf_write_integer(writer, (int64_t) value);
+    else WriteBig(writer, value, false);
+}
@@ -0,0 +1,124 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/framebuffer.h"
+
+#include "internal/memory.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_CLASS_SHIFT 12 // 4 KiB
+#define MAX_CLASS_SHIFT 24 // 16 MiB, anything bigger is a plain allocation
+#define CLASS_COUNT (MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1)
+#define CLASS_CACHE_BYTES (8 * 1024 * 1024) // how much each class keeps around at most
+
+typedef struct SizeClass {
+    pthread_mutex_t lock;
+    FrameBuffer* free;
+    size_t cached;
+    size_t max_cached;
+} SizeClass;
+
+static SizeClass g_classes[CLASS_COUNT];
+static pthread_once_t g_pool_once = PTHREAD_ONCE_INIT;
+
+static atomic_uint_fast64_t g_acquired;
+static atomic_uint_fast64_t g_reused;
+
+static void InitPool(void) {
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        pthread_mutex_init(&g_classes[i].lock, NULL);
+        g_classes[i].free = NULL;
+        g_classes[i].cached = 0;
+
+        size_t size = (size_t) 1 << (MIN_CLASS_SHIFT + i);
+        g_classes[i].max_cached = CLASS_CACHE_BYTES / size;
+        if (g_classes[i].max_cached < 2) g_classes[i].max_cached = 2;
+    }
+}
+
+static int ClassOf(size_t capacity) {
+    int shift = MIN_CLASS_SHIFT;
+    while (shift <= MAX_CLASS_SHIFT && ((size_t) 1 << shift) < capacity) shift++;
+    return shift <= MAX_CLASS_SHIFT ? shift - MIN_CLASS_SHIFT : -1;
+}
+
+FrameBuffer* FrameBuffer_Acquire(size_t capacity) {
+    pthread_once(&g_pool_once, InitPool);
+    atomic_fetch_add_explicit(&g_acquired, 1, memory_order_relaxed);
+
+    int size_class = ClassOf(capacity);
+    FrameBuffer* buffer = NULL;
+
+    if (size_class >= 0) {
+        SizeClass* c = &g_classes[size_class];
+
+        pthread_mutex_lock(&c->lock);
+        buffer = c->free;
+        if (buffer != NULL) {
+            c->free = buffer->next;
+            c->cached--;
+        }
+        pthread_mutex_unlock(&c->lock);
+
+        if (buffer != NULL) {
+            atomic_fetch_add_explicit(&g_reused, 1, memory_order_relaxed);
+        } else {
+            capacity = (size_t) 1 << (MIN_CLASS_SHIFT + size_class);
+            buffer = malloc(sizeof(FrameBuffer) + capacity); // no HeapAlloc, zeroing megabytes we're about to overwrite is a waste
+            if (buffer == NULL) exit(42);
+            buffer->capacity = capacity;
+        }
+    } else {
+        buffer = malloc(sizeof(FrameBuffer) + capacity);
+        if (buffer == NULL) exit(42);
+        buffer->capacity = capacity;
+    }
+
+    atomic_init(&buffer->refs, 1);
+    buffer->size_class = size_class;
+    buffer->length = 0;
+    buffer->next = NULL;
+    return buffer;
+}
+
+void FrameBuffer_Retain(FrameBuffer* buffer) {
+    atomic_fetch_add_explicit(&buffer->refs, 1, memory_order_relaxed);
+}
+
+void FrameBuffer_Release(FrameBuffer* buffer) {
+    if (buffer == NULL) return;
+    if (atomic_fetch_sub_explicit(&buffer->refs, 1, memory_order_acq_rel) != 1) return;
+
+    if (buffer->size_class >= 0) {
+        SizeClass* c = &g_classes[buffer->size_class];
+
+        pthread_mutex_lock(&c->lock);
+        if (c->cached < c->max_cached) {
+            buffer->next = c->free;
+            c->free = buffer;
+            c->cached++;
+            buffer = NULL;
+        }
+        pthread_mutex_unlock(&c->lock);
+    }
+
+    free(buffer);
+}
+
+FrameBuffer* FrameBuffer_Grow(FrameBuffer* buffer, size_t capacity) {
+    if (capacity <= buffer->capacity) return buffer;
+
+    FrameBuffer* grown = FrameBuffer_Acquire(capacity);
+    memcpy(grown->data, buffer->data, buffer->length);
+    grown->length = buffer->length;
+
+    FrameBuffer_Release(buffer);
+    return grown;
+}
+
+void FrameBuffer_GetPoolStats(uint64_t* acquired, uint64_t* reused) {
+    if (acquired != NULL) *acquired = atomic_load_explicit(&g_acquired, memory_order_relaxed);
+    if (reused != NULL) *reused = atomic_load_explicit(&g_reused, memory_order_relaxed);
+}
@@ -0,0 +1,70 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/histogram.h"
+
+static int BucketOf(uint64_t value) {
+    if (value == 0) return 0;
+
+    int bucket = 64 - __builtin_clzll(value);
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+void Histogram_Init(Histogram* histogram) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) atomic_init(&histogram->buckets[i], 0);
+    atomic_init(&histogram->count, 0);
+    atomic_init(&histogram->sum, 0);
+    atomic_init(&histogram->max, 0);
+}
+
+void Histogram_Record(Histogram* histogram, uint64_t value) {
+    atomic_fetch_add_explicit(&histogram->buckets[BucketOf(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+
+    uint_fast64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed, memory_order_relaxed));
+}
+
+uint64_t Histogram_Count(const Histogram* histogram) {
+    return atomic_load_explicit(&histogram->count, memory_order_relaxed);
+}
+
+uint64_t Histogram_Mean(const Histogram* histogram) {
+    uint64_t count = Histogram_Count(histogram);
+    if (count == 0) return 0;
+    return atomic_load_explicit(&histogram->sum, memory_order_relaxed) / count;
+}
+
+uint64_t Histogram_Max(const Histogram* histogram) {
+    return atomic_load_explicit(&histogram->max, memory_order_relaxed);
+}
+
+uint64_t Histogram_Percentile(const Histogram* histogram, double percentile) {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+
+    // buckets can move while we read them, use what we saw as the total instead of count
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        counts[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        total += counts[i];
+    }
+
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t) (percentile / 100.0 * (double) total);
+    if (rank >= total) rank = total - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > rank) {
+            if (i == 0) return 0;
+
+            uint64_t upper = ((uint64_t) 1 << i) - 1;
+            uint64_t max = Histogram_Max(histogram);
+            return upper < max ? upper : max;
+        }
+    }
+
+    return Histogram_Max(histogram);
+}
@@ -0,0 +1,85 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/identifyscheduler.h"
+
+#include "internal/memory.h"
+
+#include "utils/log.h"
+#include "utils/time.h"
+
+#define IDENTIFY_WINDOW_US 5000000ULL
+#define IDENTIFY_SLACK_US 50000ULL // timers fire late, never early. this keeps a late one from crowding the next slot
+#define DAY_US (24ULL * 60 * 60 * 1000000)
+
+int IdentifyScheduler_Init(IdentifyScheduler* scheduler, int max_concurrency, int total, int remaining, uint64_t reset_after_ms) {
+    if (max_concurrency <= 0) max_concurrency = 1;
+
+    if (pthread_mutex_init(&scheduler->lock, NULL) != 0) return 1;
+
+    scheduler->bucket_count = max_concurrency;
+    scheduler->bucket_free_at = HeapAlloc(max_concurrency * sizeof(uint64_t));
+    for (int i = 0; i < max_concurrency; i++) scheduler->bucket_free_at[i] = 0;
+
+    scheduler->total = total;
+    scheduler->remaining = total < 0 ? -1 : remaining;
+    scheduler->reset_at = NowUs() + reset_after_ms * 1000;
+
+    scheduler->granted = 0;
+    scheduler->waited_ms = 0;
+
+    return 0;
+}
+
+void IdentifyScheduler_Destroy(IdentifyScheduler* scheduler) {
+    if (scheduler->bucket_free_at == NULL) return;
+
+    pthread_mutex_destroy(&scheduler->lock);
+    HeapFree(scheduler->bucket_free_at);
+    scheduler->bucket_free_at = NULL;
+}
+
+uint64_t IdentifyScheduler_Reserve(IdentifyScheduler* scheduler, int shard_id) {
+    pthread_mutex_lock(&scheduler->lock);
+
+    uint64_t now = NowUs();
+    int bucket = shard_id % scheduler->bucket_count;
+
+    uint64_t slot = scheduler->bucket_free_at[bucket];
+    if (slot < now) slot = now;
+
+    if (scheduler->total >= 0) {
+        // the budget comes back in full once a day
+        while (slot >= scheduler->reset_at) {
+            scheduler->remaining = scheduler->total;
+            scheduler->reset_at += DAY_US;
+        }
+
+        if (scheduler->remaining <= 0) {
+            LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_WARN, "[WS %d] out of identifies for today, waiting %llu s for the reset",
+                shard_id, (unsigned long long) ((scheduler->reset_at - slot) / 1000000));
+
+            slot = scheduler->reset_at;
+            scheduler->remaining = scheduler->total;
+            scheduler->reset_at += DAY_US;
+        }
+
+        scheduler->remaining--;
+    }
+
+    scheduler->bucket_free_at[bucket] = slot + IDENTIFY_WINDOW_US + IDENTIFY_SLACK_US;
+
+    uint64_t delay_ms = (slot - now + 999) / 1000;
+    scheduler->granted++;
+    scheduler->waited_ms += delay_ms;
+
+    pthread_mutex_unlock(&scheduler->lock);
+    return delay_ms;
+}
+
+void IdentifyScheduler_GetStats(IdentifyScheduler* scheduler, int* remaining, uint64_t* granted, uint64_t* waited_ms) {
+    pthread_mutex_lock(&scheduler->lock);
+    if (remaining != NULL) *remaining = scheduler->remaining;
+    if (granted != NULL) *granted = scheduler->granted;
+    if (waited_ms != NULL) *waited_ms = scheduler->waited_ms;
+    pthread_mutex_unlock(&scheduler->lock);
+}
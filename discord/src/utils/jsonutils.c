@@ -2,12 +2,127 @@
 
 #include "utils/jsonutils.h"
 
+#include "internal/memory.h"
+
+#include <stdint.h>
 #include <string.h>
 
 bool jsoneq(const char* json, jsmntok_t tok, const char* s) {
     return tok.type == JSMN_STRING && (int) strlen(s) == tok.end - tok.start && strncmp(json + tok.start, s, tok.end - tok.start) == 0;
 }
 
+int jsmn_parse_growable(const char* json, size_t length, jsmntok_t** tokens, unsigned int* capacity) {
+    if (*tokens == NULL || *capacity == 0) {
+        *capacity = length / 8 + 16; // gateway json averages a token every 10 bytes or so
+        *tokens = HeapRealloc(*tokens, *capacity * sizeof(jsmntok_t));
+    }
+
+    jsmn_parser parser;
+    jsmn_init(&parser);
+
+    while (true) {
+        int count = jsmn_parse(&parser, json, length, *tokens, *capacity);
+        if (count != JSMN_ERROR_NOMEM) return count;
+
+        *capacity *= 2;
+        *tokens = HeapRealloc(*tokens, *capacity * sizeof(jsmntok_t));
+    }
+}
+
+static size_t SkipWhitespace(const char* json, size_t length, size_t pos) {
+    while (pos < length && (json[pos] == ' ' || json[pos] == '\t' || json[pos] == '\n' || json[pos] == '\r')) pos++;
+    return pos;
+}
+
+// json[pos] is the opening quote. Returns the position of the closing one, or length if there isn't one
+static size_t SkipString(const char* json, size_t length, size_t pos) {
+    for (pos++; pos < length; pos++) {
+        if (json[pos] == '\\') pos++;
+        else if (json[pos] == '"') return pos;
+    }
+
+    return length;
+}
+
+// Returns the position right after the value that starts at pos, or length if it's cut off
+static size_t SkipValue(const char* json, size_t length, size_t pos) {
+    if (json[pos] == '"') {
+        size_t end = SkipString(json, length, pos);
+        return end < length ? end + 1 : length;
+    }
+
+    if (json[pos] == '{' || json[pos] == '[') {
+        int depth = 0;
+        for (; pos < length; pos++) {
+            char c = json[pos];
+            if (c == '"') pos = SkipString(json, length, pos);
+            else if (c == '{' || c == '[') depth++;
+            else if ((c == '}' || c == ']') && --depth == 0) return pos + 1;
+        }
+
+        return length;
+    }
+
+    while (pos < length && json[pos] != ',' && json[pos] != '}' && json[pos] != ']' &&
+           json[pos] != ' ' && json[pos] != '\t' && json[pos] != '\n' && json[pos] != '\r') pos++;
+    return pos;
+}
+
+int jsmn_scan_object(const char* json, size_t length, const char* const* keys, int key_count, jsmntok_t* values) {
+    for (int i = 0; i < key_count; i++) {
+        values[i].type = JSMN_UNDEFINED;
+        values[i].start = values[i].end = -1;
+        values[i].size = 0;
+    }
+
+    size_t pos = SkipWhitespace(json, length, 0);
+    if (pos >= length || json[pos] != '{') return -1;
+    pos++;
+
+    int found = 0;
+    while (found < key_count) {
+        pos = SkipWhitespace(json, length, pos);
+        if (pos >= length || json[pos] != '"') break; // '}' or garbage, either way there are no more keys
+
+        size_t key_start = pos + 1;
+        size_t key_end = SkipString(json, length, pos);
+        if (key_end >= length) break;
+
+        pos = SkipWhitespace(json, length, key_end + 1);
+        if (pos >= length || json[pos] != ':') break;
+        pos = SkipWhitespace(json, length, pos + 1);
+        if (pos >= length) break;
+
+        size_t value_start = pos;
+        pos = SkipValue(json, length, pos);
+
+        size_t key_length = key_end - key_start;
+        for (int i = 0; i < key_count; i++) {
+            if (values[i].type != JSMN_UNDEFINED || strlen(keys[i]) != key_length || memcmp(json + key_start, keys[i], key_length) != 0) continue;
+
+            char c = json[value_start];
+            if (c == '"') {
+                values[i].type = JSMN_STRING;
+                values[i].start = (int) value_start + 1;
+                values[i].end = (int) pos - 1;
+            } else {
+                values[i].type = c == '{' ? JSMN_OBJECT : c == '[' ? JSMN_ARRAY : JSMN_PRIMITIVE;
+                values[i].start = (int) value_start;
+                values[i].end = (int) pos;
+            }
+
+            found++;
+            break;
+        }
+
+        pos = SkipWhitespace(json, length, pos);
+        if (pos >= length || json[pos] != ',') break;
+        pos++;
+    }
+
+    return found;
+}
+
 JsonObject jsmn_find_key(const char* json, const jsmntok_t* tokens, JsonObject object, const char* key) {
     JsonObject i = object + 1;
     int count = tokens[object].size;
@@ -82,3 +197,109 @@ void jsmn_copy_string(const char* json, const jsmntok_t* tokens, JsonObject obje
     memcpy(dest, json + token->start, len);
     dest[len] = '\0';
 }
+
+static int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int ReadHex4(const char* p, const char* end, uint32_t* out) {
+    if (end - p < 4) return 1;
+
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = HexValue(p[i]);
+        if (h < 0) return 1;
+        value = (value << 4) | h;
+    }
+
+    *out = value;
+    return 0;
+}
+
+static size_t EncodeUtf8(uint32_t cp, char* out) {
+    if (cp < 0x80) {
+        out[0] = (char) cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char) (0xC0 | (cp >> 6));
+        out[1] = (char) (0x80 | (cp & 0x3F));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char) (0xE0 | (cp >> 12));
+        out[1] = (char) (0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (cp & 0x3F));
+        return 3;
+    }
+
+    out[0] = (char) (0xF0 | (cp >> 18));
+    out[1] = (char) (0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (cp & 0x3F));
+    return 4;
+}
+
+size_t jsmn_copy_unescaped(const char* json, const jsmntok_t* tokens, JsonObject object, char* dest, size_t dest_size) {
+    const char* p = json + tokens[object].start;
+    const char* end = json + tokens[object].end;
+    size_t length = 0;
+
+    // an escape never produces more bytes than it takes up (\uXXXX is 6 bytes for at most 3, a surrogate pair is 12 for 4)
+    while (p < end && length + 1 < dest_size) {
+        if (*p != '\\') {
+            const char* backslash = memchr(p, '\\', end - p);
+            size_t run = (backslash != NULL ? backslash : end) - p;
+            if (run > dest_size - 1 - length) run = dest_size - 1 - length;
+
+            memcpy(dest + length, p, run);
+            length += run;
+            p += run;
+            continue;
+        }
+
+        if (end - p < 2) break;
+        char c = p[1];
+
+        if (c != 'u') {
+            switch (c) {
+                case 'n': dest[length++] = '\n'; break;
+                case 't': dest[length++] = '\t'; break;
+                case 'r': dest[length++] = '\r'; break;
+                case 'b': dest[length++] = '\b'; break;
+                case 'f': dest[length++] = '\f'; break;
+                default: dest[length++] = c; break; // \" \\ \/
+            }
+            p += 2;
+            continue;
+        }
+
+        uint32_t cp;
+        if (ReadHex4(p + 2, end, &cp) != 0) break;
+        const char* next = p + 6;
+
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            uint32_t low;
+            if (end - next >= 6 && next[0] == '\\' && next[1] == 'u' && ReadHex4(next + 2, end, &low) == 0 && low >= 0xDC00 && low <= 0xDFFF) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                next += 6;
+            } else {
+                cp = 0xFFFD; // lone surrogate
+            }
+        } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+            cp = 0xFFFD;
+        }
+
+        char utf8[4];
+        size_t n = EncodeUtf8(cp, utf8);
+        if (length + n > dest_size - 1) break;
+
+        memcpy(dest + length, utf8, n);
+        length += n;
+        p = next;
+    }
+
+    dest[length] = '\0';
+    return length;
+}
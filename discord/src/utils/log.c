@@ -0,0 +1,271 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/log.h"
+
+#include "internal/memory.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_DEFAULT_SLOTS 4096
+
+// bounded mpsc queue in the style of vyukov's: a slot is free for the producer at position pos when its sequence is pos,
+// and readable by the writer when it's pos + 1. producers only ever contend on the tail
+typedef struct LogSlot {
+    atomic_size_t sequence;
+    uint64_t time_us;
+    uint8_t category;
+    uint8_t level;
+    uint16_t length;
+    char text[LOG_MESSAGE_SIZE];
+} LogSlot;
+
+typedef struct LogRing {
+    LogSlot* slots;
+    size_t mask;
+
+    _Alignas(64) atomic_size_t tail;
+    _Alignas(64) size_t head; // writer thread only
+
+    atomic_uint_fast64_t dropped;
+    atomic_int writers; // producers between the started check and publishing, Log_Shutdown waits for them
+    atomic_bool writer_sleeping;
+    atomic_bool running;
+    int wake_fd;
+    pthread_t thread;
+} LogRing;
+
+_Atomic uint8_t g_log_levels[LOG_CATEGORY_COUNT] = {
+        [LOG_CATEGORY_CORE] = LOG_LEVEL_INFO,
+        [LOG_CATEGORY_GATEWAY] = LOG_LEVEL_INFO,
+        [LOG_CATEGORY_PAYLOAD] = LOG_LEVEL_OFF,
+        [LOG_CATEGORY_REST] = LOG_LEVEL_INFO,
+        [LOG_CATEGORY_EVENTS] = LOG_LEVEL_INFO,
+};
+
+static LogRing g_log;
+static atomic_bool g_log_started = false;
+
+static const char* const g_level_names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "OFF"};
+static const char* const g_category_names[] = {"core", "gateway", "payload", "rest", "events"};
+
+static uint64_t RealtimeUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+static void WriteLine(FILE* out, uint64_t time_us, LogCategory category, LogLevel level, const char* text, size_t length) {
+    time_t seconds = (time_t) (time_us / 1000000);
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+
+    fprintf(out, "%02d:%02d:%02d.%03u %-5s %s: %.*s\n", tm.tm_hour, tm.tm_min, tm.tm_sec, (unsigned int) (time_us % 1000000 / 1000),
+            g_level_names[level], g_category_names[category], (int) length, text);
+}
+
+// vsnprintf into text, with "..." at the end if it didn't fit
+static size_t Format(char* text, const char* format, va_list args) {
+    int length = vsnprintf(text, LOG_MESSAGE_SIZE, format, args);
+    if (length < 0) return 0;
+
+    if (length >= LOG_MESSAGE_SIZE) {
+        memcpy(text + LOG_MESSAGE_SIZE - 4, "...", 4);
+        return LOG_MESSAGE_SIZE - 1;
+    }
+
+    return (size_t) length;
+}
+
+static bool RingHasMessage(void) {
+    LogSlot* slot = &g_log.slots[g_log.head & g_log.mask];
+    return atomic_load(&slot->sequence) == g_log.head + 1;
+}
+
+static size_t Drain(void) {
+    size_t count = 0;
+
+    while (true) {
+        LogSlot* slot = &g_log.slots[g_log.head & g_log.mask];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != g_log.head + 1) break;
+
+        WriteLine(stdout, slot->time_us, slot->category, slot->level, slot->text, slot->length);
+
+        // hand the slot back to the producers for the next lap around the ring
+        atomic_store_explicit(&slot->sequence, g_log.head + g_log.mask + 1, memory_order_release);
+        g_log.head++;
+        count++;
+    }
+
+    if (count > 0) fflush(stdout);
+    return count;
+}
+
+static void* WriterMain(void* arg) {
+    (void) arg;
+    uint64_t reported_drops = 0;
+
+    while (true) {
+        size_t written = Drain();
+
+        uint64_t drops = atomic_load_explicit(&g_log.dropped, memory_order_relaxed);
+        if (drops != reported_drops) {
+            char text[64];
+            int length = snprintf(text, sizeof(text), "log ring was full, %llu message(s) dropped so far", (unsigned long long) drops);
+
+            WriteLine(stdout, RealtimeUs(), LOG_CATEGORY_CORE, LOG_LEVEL_WARN, text, (size_t) length);
+            fflush(stdout);
+            reported_drops = drops;
+        }
+
+        if (written > 0) continue;
+        if (!atomic_load(&g_log.running)) break;
+
+        // producers publish before looking at writer_sleeping, and we set it before looking for messages, so one of us sees the other
+        atomic_store(&g_log.writer_sleeping, true);
+        if (!RingHasMessage() && atomic_load(&g_log.running)) {
+            uint64_t value;
+            if (read(g_log.wake_fd, &value, sizeof(value)) < 0) {
+                // nothing sensible to do about it, the next round just checks again
+            }
+        }
+        atomic_store(&g_log.writer_sleeping, false);
+    }
+
+    return NULL;
+}
+
+void Log_Init(unsigned int slot_count) {
+    if (atomic_load(&g_log_started)) return;
+
+    if (slot_count == 0) slot_count = LOG_DEFAULT_SLOTS;
+    size_t capacity = 1;
+    while (capacity < slot_count) capacity <<= 1;
+
+    g_log.wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (g_log.wake_fd < 0) {
+        perror("log: eventfd");
+        return;
+    }
+
+    g_log.slots = HeapAlloc(capacity * sizeof(LogSlot));
+    g_log.mask = capacity - 1;
+    for (size_t i = 0; i < capacity; i++) atomic_init(&g_log.slots[i].sequence, i);
+
+    atomic_init(&g_log.tail, 0);
+    g_log.head = 0;
+    atomic_init(&g_log.dropped, 0);
+    atomic_init(&g_log.writers, 0);
+    atomic_init(&g_log.writer_sleeping, false);
+    atomic_init(&g_log.running, true);
+
+    if (pthread_create(&g_log.thread, NULL, WriterMain, NULL) != 0) {
+        HeapFree(g_log.slots);
+        g_log.slots = NULL;
+        close(g_log.wake_fd);
+        return;
+    }
+
+    atomic_store(&g_log_started, true);
+}
+
+void Log_Shutdown(void) {
+    if (!atomic_load(&g_log_started)) return;
+
+    // new messages go straight to stdout from here on, and the ones already claiming slots get to finish
+    atomic_store(&g_log_started, false);
+    while (atomic_load(&g_log.writers) > 0) sched_yield();
+
+    atomic_store(&g_log.running, false);
+    uint64_t one = 1;
+    if (write(g_log.wake_fd, &one, sizeof(one)) < 0) perror("log: wake");
+
+    pthread_join(g_log.thread, NULL);
+
+    close(g_log.wake_fd);
+    HeapFree(g_log.slots);
+    g_log.slots = NULL;
+}
+
+void Log_SetLevel(LogCategory category, LogLevel level) {
+    if ((unsigned int) category >= LOG_CATEGORY_COUNT) return;
+    atomic_store_explicit(&g_log_levels[category], (uint8_t) level, memory_order_relaxed);
+}
+
+void Log_SetAllLevels(LogLevel level) {
+    for (int i = 0; i < LOG_CATEGORY_COUNT; i++) Log_SetLevel(i, level);
+}
+
+LogLevel Log_GetLevel(LogCategory category) {
+    if ((unsigned int) category >= LOG_CATEGORY_COUNT) return LOG_LEVEL_OFF;
+    return atomic_load_explicit(&g_log_levels[category], memory_order_relaxed);
+}
+
+void Log_Write(LogCategory category, LogLevel level, const char* format, ...) {
+    if ((unsigned int) category >= LOG_CATEGORY_COUNT || level >= LOG_LEVEL_OFF) return;
+
+    va_list args;
+    va_start(args, format);
+
+    atomic_fetch_add(&g_log.writers, 1);
+
+    if (!atomic_load(&g_log_started)) {
+        atomic_fetch_sub(&g_log.writers, 1);
+
+        char text[LOG_MESSAGE_SIZE];
+        size_t length = Format(text, format, args);
+        va_end(args);
+
+        WriteLine(stdout, RealtimeUs(), category, level, text, length);
+        fflush(stdout);
+        return;
+    }
+
+    size_t pos = atomic_load_explicit(&g_log.tail, memory_order_relaxed);
+    LogSlot* slot;
+
+    while (true) {
+        slot = &g_log.slots[pos & g_log.mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&g_log.tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            // the writer hasn't gotten to this slot since the last lap, the ring is full
+            atomic_fetch_add_explicit(&g_log.dropped, 1, memory_order_relaxed);
+            atomic_fetch_sub(&g_log.writers, 1);
+            va_end(args);
+            return;
+        } else {
+            pos = atomic_load_explicit(&g_log.tail, memory_order_relaxed);
+        }
+    }
+
+    slot->time_us = RealtimeUs();
+    slot->category = (uint8_t) category;
+    slot->level = (uint8_t) level;
+    slot->length = (uint16_t) Format(slot->text, format, args);
+    va_end(args);
+
+    atomic_store(&slot->sequence, pos + 1);
+
+    if (atomic_load(&g_log.writer_sleeping)) {
+        uint64_t one = 1;
+        if (write(g_log.wake_fd, &one, sizeof(one)) < 0) {
+            // the eventfd counter can't realistically overflow, and the writer wakes up on the next message anyway
+        }
+    }
+
+    atomic_fetch_sub(&g_log.writers, 1);
+}
+
+uint64_t Log_GetDropped(void) {
+    return atomic_load_explicit(&g_log.dropped, memory_order_relaxed);
+}
@@ -0,0 +1,354 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/net.h"
+
+#include "utils/log.h"
+#include "utils/time.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define NET_KEEPALIVE_IDLE_S 30
+#define NET_KEEPALIVE_INTERVAL_S 10
+#define NET_KEEPALIVE_COUNT 3
+
+typedef struct NetAddress {
+    struct sockaddr_storage addr;
+    socklen_t length;
+} NetAddress;
+
+typedef struct NetCacheEntry {
+    char key[160]; // host:port, empty if the slot is free
+    NetAddress addresses[NET_MAX_ADDRESSES];
+    int count;
+    uint64_t expires_at; // ms
+} NetCacheEntry;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static NetCacheEntry g_cache[NET_DNS_CACHE_SIZE];
+
+static atomic_int g_connect_timeout_ms = NET_DEFAULT_CONNECT_TIMEOUT_MS;
+static atomic_int g_attempt_delay_ms = NET_DEFAULT_ATTEMPT_DELAY_MS;
+static atomic_int g_dns_ttl_ms = NET_DEFAULT_DNS_TTL_MS;
+
+static atomic_uint_fast64_t g_lookups = 0;
+static atomic_uint_fast64_t g_cache_hits = 0;
+static atomic_uint_fast64_t g_connects = 0;
+static atomic_uint_fast64_t g_failures = 0;
+static atomic_uint_fast64_t g_fallbacks = 0;
+
+void Net_SetConnectTimeout(int timeout_ms) {
+    atomic_store(&g_connect_timeout_ms, timeout_ms > 0 ? timeout_ms : NET_DEFAULT_CONNECT_TIMEOUT_MS);
+}
+
+void Net_SetAttemptDelay(int delay_ms) {
+    atomic_store(&g_attempt_delay_ms, delay_ms > 0 ? delay_ms : NET_DEFAULT_ATTEMPT_DELAY_MS);
+}
+
+void Net_SetDnsTtl(int ttl_ms) {
+    atomic_store(&g_dns_ttl_ms, ttl_ms > 0 ? ttl_ms : 0);
+    if (ttl_ms <= 0) Net_FlushDns();
+}
+
+void Net_FlushDns(void) {
+    pthread_mutex_lock(&g_lock);
+    memset(g_cache, 0, sizeof(g_cache));
+    pthread_mutex_unlock(&g_lock);
+}
+
+// with the lock held
+static NetCacheEntry* FindEntry(const char* key) {
+    for (int i = 0; i < NET_DNS_CACHE_SIZE; i++) {
+        if (strcmp(g_cache[i].key, key) == 0) return &g_cache[i];
+    }
+    return NULL;
+}
+
+// RFC 8305 4: getaddrinfo already sorted them by RFC 6724, this keeps that order within each family but alternates the
+// families, starting with whichever came first. One dead family then costs one attempt delay and not all of them
+static int Interleave(const struct addrinfo* res, NetAddress* out) {
+    const struct addrinfo* families[2][NET_MAX_ADDRESSES];
+    int counts[2] = {0, 0};
+    int first = res->ai_family == AF_INET6 ? 0 : 1;
+
+    for (const struct addrinfo* ai = res; ai != NULL; ai = ai->ai_next) {
+        if (ai->ai_family != AF_INET6 && ai->ai_family != AF_INET) continue;
+        if (ai->ai_addrlen > sizeof(struct sockaddr_storage)) continue;
+
+        int family = ai->ai_family == AF_INET6 ? 0 : 1;
+        if (counts[family] < NET_MAX_ADDRESSES) families[family][counts[family]++] = ai;
+    }
+
+    int count = 0;
+    for (int i = 0; count < NET_MAX_ADDRESSES && (i < counts[0] || i < counts[1]); i++) {
+        for (int f = 0; f < 2 && count < NET_MAX_ADDRESSES; f++) {
+            int family = f == 0 ? first : 1 - first;
+            if (i >= counts[family]) continue;
+
+            memcpy(&out[count].addr, families[family][i]->ai_addr, families[family][i]->ai_addrlen);
+            out[count].length = families[family][i]->ai_addrlen;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// Fills addresses from the cache or the resolver. Returns how many, 0 if the name doesn't resolve
+static int Resolve(const char* key, const char* host, const char* port, NetAddress* addresses, bool* cached) {
+    uint64_t now = NowMs();
+
+    pthread_mutex_lock(&g_lock);
+    NetCacheEntry* entry = FindEntry(key);
+    if (entry != NULL && entry->expires_at > now) {
+        int count = entry->count;
+        memcpy(addresses, entry->addresses, count * sizeof(NetAddress));
+        pthread_mutex_unlock(&g_lock);
+
+        atomic_fetch_add(&g_cache_hits, 1);
+        *cached = true;
+        return count;
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    *cached = false;
+    atomic_fetch_add(&g_lookups, 1);
+
+    struct addrinfo hints = {0};
+    struct addrinfo* res = NULL;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+
+    int err = getaddrinfo(host, port, &hints, &res);
+    if (err != 0 || res == NULL) {
+        LOG(LOG_CATEGORY_CORE, LOG_LEVEL_WARN, "couldn't resolve %s: %s", key, gai_strerror(err));
+        return 0;
+    }
+
+    int count = Interleave(res, addresses);
+    freeaddrinfo(res);
+
+    int ttl = atomic_load(&g_dns_ttl_ms);
+    if (count == 0 || ttl == 0) return count;
+
+    pthread_mutex_lock(&g_lock);
+    if (entry == NULL || strcmp(entry->key, key) != 0) entry = FindEntry(key);
+    if (entry == NULL) {
+        // an expired slot or a free one, else the one closest to expiring
+        entry = &g_cache[0];
+        for (int i = 1; i < NET_DNS_CACHE_SIZE; i++) {
+            if (g_cache[i].expires_at < entry->expires_at) entry = &g_cache[i];
+        }
+        snprintf(entry->key, sizeof(entry->key), "%s", key);
+    }
+    memcpy(entry->addresses, addresses, count * sizeof(NetAddress));
+    entry->count = count;
+    entry->expires_at = now + ttl;
+    pthread_mutex_unlock(&g_lock);
+
+    return count;
+}
+
+// The address that won goes first next time so a reconnect doesn't race the same slow or dead one again. Nothing
+// connecting at all drops the entry, the host might have moved
+static void Remember(const char* key, const NetAddress* winner) {
+    pthread_mutex_lock(&g_lock);
+
+    NetCacheEntry* entry = FindEntry(key);
+    if (entry != NULL && winner == NULL) {
+        memset(entry, 0, sizeof(NetCacheEntry));
+    } else if (entry != NULL) {
+        for (int i = 1; i < entry->count; i++) {
+            if (entry->addresses[i].length != winner->length || memcmp(&entry->addresses[i].addr, &winner->addr, winner->length) != 0) continue;
+
+            NetAddress address = entry->addresses[i];
+            memmove(&entry->addresses[1], &entry->addresses[0], i * sizeof(NetAddress));
+            entry->addresses[0] = address;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void CloseAll(struct pollfd* fds, int count) {
+    for (int i = 0; i < count; i++) close(fds[i].fd);
+}
+
+// Happy Eyeballs over addresses. Returns the connected socket (still nonblocking) and which address it is, or -1 once
+// everything failed or the timeout ran out
+static int Race(const NetAddress* addresses, int count, uint64_t deadline, int* winner) {
+    struct pollfd fds[NET_MAX_ADDRESSES];
+    int indices[NET_MAX_ADDRESSES];
+    int pending = 0;
+    int next = 0;
+
+    uint64_t now = NowMs();
+    uint64_t next_attempt_at = now;
+    int delay = atomic_load(&g_attempt_delay_ms);
+
+    while ((now = NowMs()) < deadline) {
+        if (next < count && (pending == 0 || now >= next_attempt_at)) {
+            const NetAddress* address = &addresses[next];
+            int fd = socket(address->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+            if (fd >= 0) {
+                if (connect(fd, (const struct sockaddr*) &address->addr, address->length) == 0) {
+                    CloseAll(fds, pending);
+                    *winner = next;
+                    return fd;
+                }
+
+                if (errno == EINPROGRESS) {
+                    fds[pending].fd = fd;
+                    fds[pending].events = POLLOUT;
+                    indices[pending] = next;
+                    pending++;
+                } else {
+                    close(fd);
+                }
+            }
+
+            next++;
+            next_attempt_at = now + delay;
+            continue;
+        }
+
+        if (pending == 0) break;
+
+        uint64_t wait_until = next < count && next_attempt_at < deadline ? next_attempt_at : deadline;
+        int n = poll(fds, pending, (int) (wait_until - now));
+        if (n < 0 && errno != EINTR) break;
+        if (n <= 0) continue;
+
+        for (int i = 0; i < pending;) {
+            if (fds[i].revents == 0) {
+                i++;
+                continue;
+            }
+
+            int err = 0;
+            socklen_t length = sizeof(err);
+            if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &length) == 0 && err == 0) {
+                int fd = fds[i].fd;
+                *winner = indices[i];
+                fds[i] = fds[--pending];
+                CloseAll(fds, pending);
+                return fd;
+            }
+
+            // a failed attempt starts the next one right away instead of waiting out the delay
+            close(fds[i].fd);
+            fds[i] = fds[--pending];
+            indices[i] = indices[pending];
+            next_attempt_at = now;
+        }
+    }
+
+    CloseAll(fds, pending);
+    return -1;
+}
+
+static void SetOptions(int fd) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // frames are written whole, nagle only adds latency
+
+    // a REST connection can sit idle for a long time, this notices when the other end is gone without us writing
+    int idle = NET_KEEPALIVE_IDLE_S;
+    int interval = NET_KEEPALIVE_INTERVAL_S;
+    int count = NET_KEEPALIVE_COUNT;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+}
+
+// 0 means no timeout
+static void SetTimeout(int fd, uint64_t timeout_ms) {
+    struct timeval tv = {.tv_sec = (time_t) (timeout_ms / 1000), .tv_usec = (suseconds_t) (timeout_ms % 1000 * 1000)};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static const char* FormatAddress(const NetAddress* address, char* buf, size_t size) {
+    const void* raw = address->addr.ss_family == AF_INET6 ? (const void*) &((const struct sockaddr_in6*) &address->addr)->sin6_addr
+                                                          : (const void*) &((const struct sockaddr_in*) &address->addr)->sin_addr;
+    if (inet_ntop(address->addr.ss_family, raw, buf, size) == NULL) snprintf(buf, size, "?");
+    return buf;
+}
+
+int Net_Connect(const char* host, const char* port) {
+    char key[160];
+    snprintf(key, sizeof(key), "%s:%s", host, port);
+
+    uint64_t start = NowUs();
+
+    NetAddress addresses[NET_MAX_ADDRESSES];
+    bool cached = false;
+    int count = Resolve(key, host, port, addresses, &cached);
+
+    uint64_t deadline = NowMs() + atomic_load(&g_connect_timeout_ms);
+    int winner = -1;
+    int fd = count > 0 ? Race(addresses, count, deadline, &winner) : -1;
+
+    if (fd < 0) {
+        atomic_fetch_add(&g_failures, 1);
+        if (count > 0) {
+            LOG(LOG_CATEGORY_CORE, LOG_LEVEL_WARN, "couldn't connect to %s, tried %d address(es)", key, count);
+            Remember(key, NULL);
+        }
+        return -1;
+    }
+
+    // the handshakes after this are blocking, a server that accepts and then says nothing only gets until the deadline
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+        close(fd);
+        atomic_fetch_add(&g_failures, 1);
+        return -1;
+    }
+
+    SetOptions(fd);
+
+    uint64_t now = NowMs();
+    SetTimeout(fd, deadline > now ? deadline - now : 1);
+
+    atomic_fetch_add(&g_connects, 1);
+    if (winner > 0) {
+        atomic_fetch_add(&g_fallbacks, 1);
+        Remember(key, &addresses[winner]);
+    }
+
+    char address[INET6_ADDRSTRLEN];
+    LOG(LOG_CATEGORY_CORE, LOG_LEVEL_DEBUG, "connected to %s at %s in %llu us (%s, address %d of %d)", key,
+        FormatAddress(&addresses[winner], address, sizeof(address)), (unsigned long long) (NowUs() - start),
+        cached ? "cached lookup" : "resolved", winner + 1, count);
+
+    return fd;
+}
+
+void Net_ClearTimeout(int fd) {
+    SetTimeout(fd, 0);
+}
+
+void Net_GetStats(NetStats* stats) {
+    stats->lookups = atomic_load(&g_lookups);
+    stats->cache_hits = atomic_load(&g_cache_hits);
+    stats->connects = atomic_load(&g_connects);
+    stats->failures = atomic_load(&g_failures);
+    stats->fallbacks = atomic_load(&g_fallbacks);
+}
@@ -0,0 +1,228 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/reactor.h"
+
+#include "utils/log.h"
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 64
+
+int Reactor_Init(Reactor* reactor) {
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd == -1) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "reactor: epoll_create1: %s", strerror(errno));
+        return -1;
+    }
+
+    reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->wake_fd == -1) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "reactor: eventfd: %s", strerror(errno));
+        close(reactor->epoll_fd);
+        return -1;
+    }
+
+    // data.ptr NULL is the wake fd, every real handle has a pointer
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &ev) != 0) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "reactor: epoll_ctl: %s", strerror(errno));
+        close(reactor->wake_fd);
+        close(reactor->epoll_fd);
+        return -1;
+    }
+
+    reactor->deferred = NULL;
+    atomic_init(&reactor->running, true); // so a Reactor_Stop before Reactor_Run isn't lost
+    return 0;
+}
+
+void Reactor_Destroy(Reactor* reactor) {
+    close(reactor->wake_fd);
+    close(reactor->epoll_fd);
+    reactor->wake_fd = -1;
+    reactor->epoll_fd = -1;
+}
+
+int Reactor_Add(Reactor* reactor, ReactorHandle* handle, int fd, uint32_t events, ReactorCallback callback, void* userdata) {
+    handle->fd = fd;
+    handle->events = events;
+    handle->callback = callback;
+    handle->userdata = userdata;
+    handle->timer = false;
+    handle->deferred = false;
+    handle->next_deferred = NULL;
+
+    struct epoll_event ev = {0};
+    ev.events = events;
+    ev.data.ptr = handle;
+
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "reactor: epoll_ctl: %s", strerror(errno));
+        handle->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int Reactor_Modify(Reactor* reactor, ReactorHandle* handle, uint32_t events) {
+    if (handle->fd == -1) return -1;
+    if (handle->events == events) return 0;
+
+    struct epoll_event ev = {0};
+    ev.events = events;
+    ev.data.ptr = handle;
+
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, handle->fd, &ev) != 0) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "reactor: epoll_ctl: %s", strerror(errno));
+        return -1;
+    }
+
+    handle->events = events;
+    return 0;
+}
+
+static void Reactor_Undefer(Reactor* reactor, ReactorHandle* handle) {
+    if (!handle->deferred) return;
+
+    ReactorHandle** link = &reactor->deferred;
+    while (*link != NULL && *link != handle) link = &(*link)->next_deferred;
+    if (*link != NULL) *link = handle->next_deferred;
+
+    handle->deferred = false;
+    handle->next_deferred = NULL;
+}
+
+void Reactor_Remove(Reactor* reactor, ReactorHandle* handle) {
+    if (handle->fd == -1) return;
+
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, handle->fd, NULL);
+    Reactor_Undefer(reactor, handle);
+    handle->fd = -1;
+}
+
+void Reactor_Defer(Reactor* reactor, ReactorHandle* handle) {
+    if (handle->deferred || handle->fd == -1) return;
+
+    // append so a handle that keeps deferring itself can't starve the ones behind it
+    ReactorHandle** link = &reactor->deferred;
+    while (*link != NULL) link = &(*link)->next_deferred;
+    *link = handle;
+
+    handle->deferred = true;
+    handle->next_deferred = NULL;
+}
+
+int Reactor_AddTimer(Reactor* reactor, ReactorHandle* handle, ReactorCallback callback, void* userdata) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "reactor: timerfd_create: %s", strerror(errno));
+        return -1;
+    }
+
+    if (Reactor_Add(reactor, handle, fd, EPOLLIN, callback, userdata) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    handle->timer = true;
+    return 0;
+}
+
+void Reactor_RemoveTimer(Reactor* reactor, ReactorHandle* handle) {
+    int fd = handle->fd;
+    if (fd == -1) return;
+
+    Reactor_Remove(reactor, handle);
+    close(fd);
+}
+
+int Reactor_ArmTimer(ReactorHandle* handle, uint64_t delay_ms, uint64_t interval_ms) {
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = delay_ms / 1000;
+    spec.it_value.tv_nsec = (delay_ms % 1000) * 1000000;
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000;
+
+    if (delay_ms == 0) spec.it_value.tv_nsec = 1; // all zeroes would disarm it
+
+    if (timerfd_settime(handle->fd, 0, &spec, NULL) != 0) {
+        LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "reactor: timerfd_settime: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+void Reactor_DisarmTimer(ReactorHandle* handle) {
+    if (handle->fd == -1) return;
+
+    struct itimerspec spec = {0};
+    timerfd_settime(handle->fd, 0, &spec, NULL);
+}
+
+static void Reactor_Dispatch(Reactor* reactor, ReactorHandle* handle, uint32_t events) {
+    if (handle->fd == -1) return; // removed by an earlier callback in the same batch
+
+    if (handle->timer) {
+        uint64_t expirations;
+        if (read(handle->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return; // disarmed or rearmed in between
+    }
+
+    handle->callback(reactor, handle, events);
+}
+
+void Reactor_Run(Reactor* reactor) {
+    struct epoll_event events[MAX_EVENTS];
+
+    while (atomic_load(&reactor->running)) {
+        int timeout = reactor->deferred != NULL ? 0 : -1;
+
+        int n = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG(LOG_CATEGORY_GATEWAY, LOG_LEVEL_ERROR, "reactor: epoll_wait: %s", strerror(errno));
+            break;
+        }
+
+        // only the ones that were deferred before this round, anything deferred now waits for the next one
+        int deferred_count = 0;
+        for (ReactorHandle* h = reactor->deferred; h != NULL; h = h->next_deferred) deferred_count++;
+
+        for (int i = 0; i < n; i++) {
+            ReactorHandle* handle = events[i].data.ptr;
+
+            if (handle == NULL) {
+                uint64_t value;
+                while (read(reactor->wake_fd, &value, sizeof(value)) > 0);
+                continue;
+            }
+
+            Reactor_Dispatch(reactor, handle, events[i].events);
+        }
+
+        while (deferred_count-- > 0 && reactor->deferred != NULL) {
+            ReactorHandle* handle = reactor->deferred;
+            reactor->deferred = handle->next_deferred;
+            handle->deferred = false;
+            handle->next_deferred = NULL;
+
+            Reactor_Dispatch(reactor, handle, EPOLLIN);
+        }
+    }
+}
+
+void Reactor_Stop(Reactor* reactor) {
+    atomic_store(&reactor->running, false);
+
+    uint64_t one = 1;
+    write(reactor->wake_fd, &one, sizeof(one));
+}
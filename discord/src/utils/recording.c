@@ -0,0 +1,288 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/recording.h"
+
+#include "internal/memory.h"
+
+#include "utils/log.h"
+#include "utils/time.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#define RECORDING_MAGIC 0x43455247 // "GREC"
+#define RECORDING_VERSION 2
+#define RECORDING_BUFFER_SIZE (1 << 20)
+
+typedef struct RecordingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t shard_count;
+} RecordingHeader;
+
+static size_t PutVarint(unsigned char* out, uint64_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+
+    out[length++] = (unsigned char) value;
+    return length;
+}
+
+static int GetVarint(FILE* file, uint64_t* value) {
+    uint64_t result = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(file);
+        if (c == EOF) return shift == 0 ? 0 : -1;
+
+        result |= (uint64_t) (c & 0x7F) << shift;
+        if ((c & 0x80) == 0) {
+            *value = result;
+            return 1;
+        }
+    }
+
+    return -1;
+}
+
+// the gateway threads only ever memcpy into pending, this is where the file I/O happens
+static void* WriterThreadMain(void* arg) {
+    RecordingWriter* writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+
+    while (true) {
+        if (!writer->stopping && writer->pending_length < RECORDING_BUFFER_SIZE) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_nsec += RECORDING_FLUSH_INTERVAL_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+
+            pthread_cond_timedwait(&writer->wake, &writer->lock, &deadline);
+        }
+
+        if (writer->pending_length == 0 || writer->failed) {
+            if (writer->stopping) break;
+            continue;
+        }
+
+        char* batch = writer->pending;
+        size_t length = writer->pending_length;
+        size_t capacity = writer->pending_capacity;
+        writer->pending = writer->writing;
+        writer->pending_capacity = writer->writing_capacity;
+        writer->pending_length = 0;
+
+        pthread_mutex_unlock(&writer->lock);
+        bool ok = fwrite(batch, 1, length, writer->file) == length && fflush(writer->file) == 0;
+        int error = errno;
+        pthread_mutex_lock(&writer->lock);
+
+        writer->writing = batch;
+        writer->writing_capacity = capacity;
+
+        if (!ok) {
+            // a record cut in half can't be read past, so that's where the recording ends
+            LOG(LOG_CATEGORY_CORE, LOG_LEVEL_ERROR, "recording write failed, not recording anymore: %s", strerror(error));
+            writer->failed = true;
+        }
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+int Recording_OpenWriter(RecordingWriter* writer, const char* path, uint32_t flags, int shard_count) {
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        LOG(LOG_CATEGORY_CORE, LOG_LEVEL_ERROR, "can't open recording %s: %s", path, strerror(errno));
+        return 1;
+    }
+
+    RecordingHeader header = {RECORDING_MAGIC, RECORDING_VERSION, flags, (uint32_t) shard_count};
+    if (fwrite(&header, sizeof(header), 1, writer->file) != 1 || fflush(writer->file) != 0) {
+        LOG(LOG_CATEGORY_CORE, LOG_LEVEL_ERROR, "can't write recording %s: %s", path, strerror(errno));
+        fclose(writer->file);
+        writer->file = NULL;
+        return 1;
+    }
+
+    // batches are already big, stdio would only copy them once more
+    setvbuf(writer->file, NULL, _IONBF, 0);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&writer->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&writer->lock, NULL);
+
+    writer->stopping = false;
+    writer->pending = HeapAlloc(RECORDING_BUFFER_SIZE * 2);
+    writer->pending_length = 0;
+    writer->pending_capacity = RECORDING_BUFFER_SIZE * 2;
+    writer->writing = HeapAlloc(RECORDING_BUFFER_SIZE * 2);
+    writer->writing_capacity = RECORDING_BUFFER_SIZE * 2;
+    writer->last_us = NowUs();
+    writer->frames = 0;
+    writer->failed = false;
+
+    if (pthread_create(&writer->thread, NULL, WriterThreadMain, writer) != 0) {
+        LOG(LOG_CATEGORY_CORE, LOG_LEVEL_ERROR, "can't start the recording thread for %s", path);
+        HeapFree(writer->pending);
+        HeapFree(writer->writing);
+        pthread_cond_destroy(&writer->wake);
+        pthread_mutex_destroy(&writer->lock);
+        fclose(writer->file);
+        writer->file = NULL;
+        return 1;
+    }
+
+    return 0;
+}
+
+// whatever is still pending gets written before this returns
+void Recording_CloseWriter(RecordingWriter* writer) {
+    if (writer->file == NULL) return;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = true;
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&writer->lock);
+
+    pthread_join(writer->thread, NULL);
+
+    fclose(writer->file);
+    writer->file = NULL;
+    HeapFree(writer->pending);
+    HeapFree(writer->writing);
+    pthread_cond_destroy(&writer->wake);
+    pthread_mutex_destroy(&writer->lock);
+}
+
+static void WriteRecord(RecordingWriter* writer, int shard_id, bool opened, const void* data, size_t length) {
+    unsigned char header[30];
+
+    pthread_mutex_lock(&writer->lock);
+
+    if (writer->failed) {
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+
+    // the clock is read under the lock so the deltas never go negative between threads
+    uint64_t now = NowUs();
+    size_t header_length = PutVarint(header, now - writer->last_us);
+    header_length += PutVarint(header + header_length, (uint64_t) shard_id << 1 | opened);
+    header_length += PutVarint(header + header_length, length);
+
+    size_t needed = writer->pending_length + header_length + length;
+    if (needed > writer->pending_capacity) {
+        if (needed > RECORDING_MAX_PENDING) {
+            LOG(LOG_CATEGORY_CORE, LOG_LEVEL_ERROR, "recording fell %zu bytes behind the gateway, not recording anymore",
+                writer->pending_length);
+            writer->failed = true;
+            pthread_mutex_unlock(&writer->lock);
+            return;
+        }
+
+        size_t capacity = writer->pending_capacity;
+        while (capacity < needed) capacity *= 2;
+        writer->pending = HeapRealloc(writer->pending, capacity);
+        writer->pending_capacity = capacity;
+    }
+
+    bool was_small = writer->pending_length < RECORDING_BUFFER_SIZE;
+
+    memcpy(writer->pending + writer->pending_length, header, header_length);
+    if (length > 0) memcpy(writer->pending + writer->pending_length + header_length, data, length);
+    writer->pending_length = needed;
+    writer->last_us = now;
+    if (!opened) writer->frames++;
+
+    // the writer thread would otherwise wait out the rest of its interval
+    if (was_small && writer->pending_length >= RECORDING_BUFFER_SIZE) pthread_cond_signal(&writer->wake);
+
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void Recording_Write(RecordingWriter* writer, int shard_id, const void* data, size_t length) {
+    WriteRecord(writer, shard_id, false, data, length);
+}
+
+void Recording_WriteOpened(RecordingWriter* writer, int shard_id) {
+    WriteRecord(writer, shard_id, true, NULL, 0);
+}
+
+int Recording_OpenReader(RecordingReader* reader, const char* path) {
+    memset(reader, 0, sizeof(RecordingReader));
+
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL) return 1;
+
+    RecordingHeader header;
+    if (fread(&header, sizeof(header), 1, reader->file) != 1 || header.magic != RECORDING_MAGIC ||
+        header.version < 1 || header.version > RECORDING_VERSION) {
+        fclose(reader->file);
+        reader->file = NULL;
+        return 1;
+    }
+
+    setvbuf(reader->file, NULL, _IOFBF, RECORDING_BUFFER_SIZE);
+
+    reader->version = header.version;
+    reader->flags = header.flags;
+    reader->shard_count = (int) header.shard_count;
+    return 0;
+}
+
+void Recording_CloseReader(RecordingReader* reader) {
+    if (reader->file != NULL) fclose(reader->file);
+    HeapFree(reader->data);
+
+    reader->file = NULL;
+    reader->data = NULL;
+    reader->capacity = 0;
+}
+
+int Recording_Next(RecordingReader* reader, RecordedFrame* frame) {
+    uint64_t delta, shard_id, length;
+
+    int res = GetVarint(reader->file, &delta);
+    if (res <= 0) return res;
+
+    if (GetVarint(reader->file, &shard_id) != 1 || GetVarint(reader->file, &length) != 1) return -1;
+    bool opened = false;
+    if (reader->version >= 2) {
+        opened = (shard_id & 1) != 0;
+        shard_id >>= 1;
+    }
+
+    if (shard_id > INT32_MAX || length > SIZE_MAX / 2 || (opened && length != 0)) return -1;
+
+    // one spare byte for a terminator, the receive path always leaves one after the payload
+    if (length + 1 > reader->capacity) {
+        reader->capacity = length + 1;
+        reader->data = HeapRealloc(reader->data, reader->capacity);
+    }
+
+    if (fread(reader->data, 1, length, reader->file) != length) return -1;
+    reader->data[length] = '\0';
+
+    reader->time_us += delta;
+
+    frame->time_us = reader->time_us;
+    frame->shard_id = (int) shard_id;
+    frame->opened = opened;
+    frame->data = reader->data;
+    frame->length = length;
+    return 1;
+}
@@ -0,0 +1,155 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/sessionfile.h"
+
+#include "utils/log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SESSION_FILE_MAGIC 0x53534447 // "GDSS"
+#define SESSION_FILE_VERSION 1
+
+typedef struct SessionSlot {
+    char session_id[64];
+    char resume_host[128];
+    char resume_port[8];
+    _Atomic int64_t last_seq;
+} SessionSlot;
+
+// a cache line of its own, shards on different gateway threads bump their sequence numbers all the time
+typedef struct SessionRecord {
+    _Alignas(64) _Atomic uint32_t active; // which slot is live, the other one is where the next session gets written
+    SessionSlot slots[2];
+} SessionRecord;
+
+struct SessionFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t shard_count;
+    uint32_t record_size;
+    SessionRecord records[];
+};
+
+static void CopyField(char* dest, size_t dest_size, const char* src) {
+    size_t length = strlen(src);
+    if (length >= dest_size) length = dest_size - 1;
+
+    memcpy(dest, src, length);
+    memset(dest + length, 0, dest_size - length);
+}
+
+int SessionFile_Open(SessionFile* file, const char* path, int shard_count) {
+    file->fd = -1;
+    file->header = NULL;
+    file->size = sizeof(SessionFileHeader) + (size_t) shard_count * sizeof(SessionRecord);
+    file->shard_count = shard_count;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOG(LOG_CATEGORY_CORE, LOG_LEVEL_ERROR, "session file %s: open: %s", path, strerror(errno));
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        LOG(LOG_CATEGORY_CORE, LOG_LEVEL_ERROR, "session file %s: fstat: %s", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    bool fresh = (size_t) st.st_size != file->size;
+    if (fresh && ftruncate(fd, (off_t) file->size) != 0) {
+        LOG(LOG_CATEGORY_CORE, LOG_LEVEL_ERROR, "session file %s: ftruncate: %s", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    SessionFileHeader* header = mmap(NULL, file->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        LOG(LOG_CATEGORY_CORE, LOG_LEVEL_ERROR, "session file %s: mmap: %s", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    if (fresh || header->magic != SESSION_FILE_MAGIC || header->version != SESSION_FILE_VERSION ||
+        header->shard_count != (uint32_t) shard_count || header->record_size != sizeof(SessionRecord)) {
+        memset(header, 0, file->size);
+        header->magic = SESSION_FILE_MAGIC;
+        header->version = SESSION_FILE_VERSION;
+        header->shard_count = (uint32_t) shard_count;
+        header->record_size = sizeof(SessionRecord);
+    }
+
+    file->fd = fd;
+    file->header = header;
+    return 0;
+}
+
+void SessionFile_Close(SessionFile* file) {
+    if (file->header == NULL) return;
+
+    msync(file->header, file->size, MS_ASYNC);
+    munmap(file->header, file->size);
+    close(file->fd);
+
+    file->header = NULL;
+    file->fd = -1;
+}
+
+static SessionRecord* GetRecord(const SessionFile* file, int shard_id) {
+    if (file->header == NULL || shard_id < 0 || shard_id >= file->shard_count) return NULL;
+    return &file->header->records[shard_id];
+}
+
+bool SessionFile_Load(const SessionFile* file, int shard_id, SessionState* state) {
+    SessionRecord* record = GetRecord(file, shard_id);
+    if (record == NULL) return false;
+
+    SessionSlot* slot = &record->slots[atomic_load(&record->active) & 1];
+    if (slot->session_id[0] == '\0' || slot->resume_host[0] == '\0') return false;
+
+    // the file could have been edited by hand, so don't trust the terminators
+    memcpy(state->session_id, slot->session_id, sizeof(state->session_id));
+    state->session_id[sizeof(state->session_id) - 1] = '\0';
+    memcpy(state->resume_host, slot->resume_host, sizeof(state->resume_host));
+    state->resume_host[sizeof(state->resume_host) - 1] = '\0';
+    memcpy(state->resume_port, slot->resume_port, sizeof(state->resume_port));
+    state->resume_port[sizeof(state->resume_port) - 1] = '\0';
+    state->last_seq = (long long) atomic_load(&slot->last_seq);
+
+    return true;
+}
+
+void SessionFile_SaveSession(SessionFile* file, int shard_id, const char* session_id, const char* resume_host, const char* resume_port, long long last_seq) {
+    SessionRecord* record = GetRecord(file, shard_id);
+    if (record == NULL) return;
+
+    uint32_t spare = (atomic_load(&record->active) & 1) ^ 1;
+    SessionSlot* slot = &record->slots[spare];
+
+    CopyField(slot->session_id, sizeof(slot->session_id), session_id);
+    CopyField(slot->resume_host, sizeof(slot->resume_host), resume_host);
+    CopyField(slot->resume_port, sizeof(slot->resume_port), resume_port);
+    atomic_store(&slot->last_seq, last_seq);
+
+    atomic_store(&record->active, spare);
+}
+
+void SessionFile_SaveSeq(SessionFile* file, int shard_id, long long last_seq) {
+    SessionRecord* record = GetRecord(file, shard_id);
+    if (record == NULL) return;
+
+    atomic_store_explicit(&record->slots[atomic_load_explicit(&record->active, memory_order_relaxed) & 1].last_seq, last_seq, memory_order_release);
+}
+
+void SessionFile_Clear(SessionFile* file, int shard_id) {
+    SessionFile_SaveSession(file, shard_id, "", "", "", 0);
+}
@@ -0,0 +1,348 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/simd.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+typedef bool (*ValidateUtf8Fn)(const unsigned char* data, size_t length);
+typedef void (*MaskCopyFn)(unsigned char* dst, const unsigned char* src, size_t length, const unsigned char mask[4]);
+
+// Length of the sequence starting at data[0] if it's valid, 0 if not. data[0] isn't ascii
+static size_t CheckSequence(const unsigned char* data, size_t remaining) {
+    unsigned char lead = data[0];
+    size_t continuations;
+    unsigned char low = 0x80, high = 0xBF; // range of the second byte
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        continuations = 1;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        continuations = 2;
+        if (lead == 0xE0) low = 0xA0; // overlong
+        else if (lead == 0xED) high = 0x9F; // surrogates
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        continuations = 3;
+        if (lead == 0xF0) low = 0x90; // overlong
+        else if (lead == 0xF4) high = 0x8F; // past U+10FFFF
+    } else {
+        return 0;
+    }
+
+    if (remaining <= continuations) return 0;
+    if (data[1] < low || data[1] > high) return 0;
+
+    for (size_t i = 2; i <= continuations; i++) {
+        if ((data[i] & 0xC0) != 0x80) return 0;
+    }
+
+    return continuations + 1;
+}
+
+static bool ValidateUtf8Scalar(const unsigned char* data, size_t length) {
+    size_t i = 0;
+
+    while (i < length) {
+        if (i + 8 <= length) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            if ((word & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+
+        if (data[i] < 0x80) {
+            i++;
+            continue;
+        }
+
+        size_t consumed = CheckSequence(data + i, length - i);
+        if (consumed == 0) return false;
+        i += consumed;
+    }
+
+    return true;
+}
+
+static void MaskCopyScalar(unsigned char* dst, const unsigned char* src, size_t length, const unsigned char mask[4]) {
+    uint32_t mask32;
+    memcpy(&mask32, mask, 4);
+    uint64_t mask64 = ((uint64_t) mask32 << 32) | mask32;
+
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, src + i, 8);
+        word ^= mask64;
+        memcpy(dst + i, &word, 8);
+    }
+
+    for (; i < length; i++)
+        dst[i] = src[i] ^ mask[i & 3];
+}
+
+#ifdef SIMD_X86
+
+// sse2 has no byte shuffle for the lookup tables, so it only skips ascii 16 bytes at a time and checks the rest
+// sequence by sequence
+__attribute__((target("sse2")))
+static bool ValidateUtf8Sse2(const unsigned char* data, size_t length) {
+    size_t i = 0;
+
+    while (i + 16 <= length) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (data + i));
+        if (_mm_movemask_epi8(block) == 0) {
+            i += 16;
+            continue;
+        }
+
+        size_t block_end = i + 16;
+        while (i < block_end) {
+            if (data[i] < 0x80) {
+                i++;
+                continue;
+            }
+
+            size_t consumed = CheckSequence(data + i, length - i);
+            if (consumed == 0) return false;
+            i += consumed;
+        }
+    }
+
+    return ValidateUtf8Scalar(data + i, length - i);
+}
+
+__attribute__((target("sse2")))
+static void MaskCopySse2(unsigned char* dst, const unsigned char* src, size_t length, const unsigned char mask[4]) {
+    int32_t mask32;
+    memcpy(&mask32, mask, 4);
+    __m128i mask128 = _mm_set1_epi32(mask32);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (src + i));
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_xor_si128(block, mask128));
+    }
+
+    MaskCopyScalar(dst + i, src + i, length - i, mask); // i is a multiple of 4, the mask is still in phase
+}
+
+// The lookup algorithm from Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte" (2021).
+// Each byte is classified together with the one before it through three 16 entry tables indexed by nibbles; every
+// bit of the result is one kind of error. The only legal bit is TWO_CONTS, and only where a 3 or 4 byte sequence
+// needs a second or third continuation, which the prev2/prev3 check below accounts for
+
+#define UTF8_TOO_SHORT (1 << 0) // lead byte followed by a lead byte or ascii
+#define UTF8_TOO_LONG (1 << 1) // ascii followed by a continuation
+#define UTF8_OVERLONG_3 (1 << 2)
+#define UTF8_TOO_LARGE (1 << 3)
+#define UTF8_SURROGATE (1 << 4)
+#define UTF8_OVERLONG_2 (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4 (1 << 6)
+#define UTF8_TWO_CONTS (1 << 7)
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+#define UTF8_TABLE(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+typedef struct Utf8State {
+    __m256i error;
+    __m256i prev_input;
+    __m256i prev_incomplete;
+} Utf8State;
+
+__attribute__((target("avx2")))
+static inline __m256i PrevBytes(__m256i input, __m256i prev_input, int n) {
+    __m256i shifted_in = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    switch (n) {
+        case 1: return _mm256_alignr_epi8(input, shifted_in, 15);
+        case 2: return _mm256_alignr_epi8(input, shifted_in, 14);
+        default: return _mm256_alignr_epi8(input, shifted_in, 13);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void CheckBlockAvx2(Utf8State* state, __m256i input) {
+    if (_mm256_movemask_epi8(input) == 0) {
+        // a sequence cut off at the end of the last block can't be finished by ascii
+        state->error = _mm256_or_si256(state->error, state->prev_incomplete);
+        state->prev_input = input;
+        return;
+    }
+
+    const __m256i byte_1_high_table = UTF8_TABLE(
+            UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+            UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+            UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+            UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+            UTF8_TOO_SHORT,
+            UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+            UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+
+    const __m256i byte_1_low_table = UTF8_TABLE(
+            UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+            UTF8_CARRY | UTF8_OVERLONG_2,
+            UTF8_CARRY,
+            UTF8_CARRY,
+            UTF8_CARRY | UTF8_TOO_LARGE,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+            UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000);
+
+    const __m256i byte_2_high_table = UTF8_TABLE(
+            UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+            UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+            UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+            UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+            UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+            UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+            UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    __m256i prev1 = PrevBytes(input, state->prev_input, 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // bytes 2 and 3 after a 3 or 4 byte lead have to be continuations, that's where TWO_CONTS is expected
+    __m256i prev2 = PrevBytes(input, state->prev_input, 2);
+    __m256i prev3 = PrevBytes(input, state->prev_input, 3);
+    __m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xE0 - 0x80)));
+    __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xF0 - 0x80)));
+    __m256i must_be_continuation = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8((char) 0x80));
+
+    state->error = _mm256_or_si256(state->error, _mm256_xor_si256(must_be_continuation, special));
+
+    // a lead byte in the last 3 positions that the block doesn't have room to finish
+    const __m256i max_value = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            (char) (0xF0 - 1), (char) (0xE0 - 1), (char) (0xC0 - 1));
+    state->prev_incomplete = _mm256_subs_epu8(input, max_value);
+    state->prev_input = input;
+}
+
+__attribute__((target("avx2")))
+static bool ValidateUtf8Avx2(const unsigned char* data, size_t length) {
+    Utf8State state = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        CheckBlockAvx2(&state, _mm256_loadu_si256((const __m256i*) (data + i)));
+    }
+
+    // the tail is padded with zeros, a sequence cut off by the end of the data runs into them
+    if (i < length) {
+        unsigned char tail[32] = {0};
+        memcpy(tail, data + i, length - i);
+        CheckBlockAvx2(&state, _mm256_loadu_si256((const __m256i*) tail));
+    }
+
+    __m256i error = _mm256_or_si256(state.error, state.prev_incomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+__attribute__((target("avx2")))
+static void MaskCopyAvx2(unsigned char* dst, const unsigned char* src, size_t length, const unsigned char mask[4]) {
+    int32_t mask32;
+    memcpy(&mask32, mask, 4);
+    __m256i mask256 = _mm256_set1_epi32(mask32);
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*) (src + i));
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_xor_si256(block, mask256));
+    }
+
+    MaskCopyScalar(dst + i, src + i, length - i, mask);
+}
+
+#endif // SIMD_X86
+
+static const ValidateUtf8Fn g_validate_utf8_kernels[SIMD_LEVEL_COUNT] = {
+        [SIMD_LEVEL_SCALAR] = ValidateUtf8Scalar,
+#ifdef SIMD_X86
+        [SIMD_LEVEL_SSE2] = ValidateUtf8Sse2,
+        [SIMD_LEVEL_AVX2] = ValidateUtf8Avx2,
+#endif
+};
+
+static const MaskCopyFn g_mask_copy_kernels[SIMD_LEVEL_COUNT] = {
+        [SIMD_LEVEL_SCALAR] = MaskCopyScalar,
+#ifdef SIMD_X86
+        [SIMD_LEVEL_SSE2] = MaskCopySse2,
+        [SIMD_LEVEL_AVX2] = MaskCopyAvx2,
+#endif
+};
+
+static SimdLevel g_level = SIMD_LEVEL_SCALAR;
+static ValidateUtf8Fn g_validate_utf8 = ValidateUtf8Scalar;
+static MaskCopyFn g_mask_copy = MaskCopyScalar;
+
+bool Simd_IsSupported(SimdLevel level) {
+    switch (level) {
+        case SIMD_LEVEL_SCALAR:
+            return true;
+#ifdef SIMD_X86
+        case SIMD_LEVEL_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case SIMD_LEVEL_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+void Simd_Init(void) {
+    for (int level = SIMD_LEVEL_COUNT - 1; level >= 0; level--) {
+        if (Simd_SetLevel((SimdLevel) level) == 0) return;
+    }
+}
+
+int Simd_SetLevel(SimdLevel level) {
+    if (level < 0 || level >= SIMD_LEVEL_COUNT || !Simd_IsSupported(level)) return 1;
+
+    g_level = level;
+    g_validate_utf8 = g_validate_utf8_kernels[level];
+    g_mask_copy = g_mask_copy_kernels[level];
+    return 0;
+}
+
+SimdLevel Simd_GetLevel(void) {
+    return g_level;
+}
+
+const char* Simd_LevelName(SimdLevel level) {
+    switch (level) {
+        case SIMD_LEVEL_SCALAR: return "scalar";
+        case SIMD_LEVEL_SSE2: return "sse2";
+        case SIMD_LEVEL_AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+bool Simd_ValidateUtf8(const void* data, size_t length) {
+    return g_validate_utf8(data, length);
+}
+
+void Simd_MaskCopy(void* dst, const void* src, size_t length, const unsigned char mask[4]) {
+    g_mask_copy(dst, src, length, mask);
+}
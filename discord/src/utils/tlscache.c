@@ -0,0 +1,158 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/tlscache.h"
+
+#include "internal/memory.h"
+
+#include "utils/log.h"
+#include "utils/time.h"
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct TlsCacheEntry {
+    char key[160]; // host:port, empty if the slot is free
+    SSL_SESSION* session;
+    uint64_t stored_at;
+} TlsCacheEntry;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static TlsCacheEntry g_entries[TLS_CACHE_MAX_HOSTS];
+static int g_key_index = -1; // ex_data slot on each SSL with the host:port its sessions get filed under
+
+static Histogram g_full_handshakes;
+static Histogram g_resumed_handshakes;
+
+static atomic_uint_fast64_t g_ktls_send = 0;
+static atomic_uint_fast64_t g_ktls_recv = 0;
+
+static void FreeKey(void* parent, void* key, CRYPTO_EX_DATA* ad, int index, long argl, void* argp) {
+    if (key != NULL) HeapFree(key);
+}
+
+// with the lock held
+static TlsCacheEntry* FindEntry(const char* key, bool create) {
+    TlsCacheEntry* oldest = &g_entries[0];
+
+    for (int i = 0; i < TLS_CACHE_MAX_HOSTS; i++) {
+        TlsCacheEntry* entry = &g_entries[i];
+        if (strcmp(entry->key, key) == 0) return entry;
+        if (entry->stored_at < oldest->stored_at) oldest = entry; // free slots have 0 so they go first
+    }
+
+    if (!create) return NULL;
+
+    if (oldest->session != NULL) SSL_SESSION_free(oldest->session);
+    oldest->session = NULL;
+    snprintf(oldest->key, sizeof(oldest->key), "%s", key);
+    return oldest;
+}
+
+// openssl calls this for every session the server hands out. with TLS 1.3 that's after the handshake, from inside
+// whatever SSL_read picks up the ticket, and usually more than once per connection. The newest one wins
+static int OnNewSession(SSL* ssl, SSL_SESSION* session) {
+    const char* key = SSL_get_ex_data(ssl, g_key_index);
+    if (key == NULL || !SSL_SESSION_is_resumable(session)) return 0;
+
+    pthread_mutex_lock(&g_lock);
+
+    TlsCacheEntry* entry = FindEntry(key, true);
+    if (entry->session != NULL) SSL_SESSION_free(entry->session);
+    entry->session = session;
+    entry->stored_at = NowUs();
+
+    pthread_mutex_unlock(&g_lock);
+    return 1; // we keep the reference
+}
+
+int TlsCache_Init(SSL_CTX* ctx) {
+    Histogram_Init(&g_full_handshakes);
+    Histogram_Init(&g_resumed_handshakes);
+
+    if (g_key_index < 0) g_key_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, FreeKey);
+    if (g_key_index < 0) return 1;
+
+    // openssl's own client cache is never looked at, sessions only get reused through SSL_set_session
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, OnNewSession);
+    return 0;
+}
+
+void TlsCache_Destroy(void) {
+    pthread_mutex_lock(&g_lock);
+
+    for (int i = 0; i < TLS_CACHE_MAX_HOSTS; i++) {
+        if (g_entries[i].session != NULL) SSL_SESSION_free(g_entries[i].session);
+        memset(&g_entries[i], 0, sizeof(TlsCacheEntry));
+    }
+
+    pthread_mutex_unlock(&g_lock);
+}
+
+int TlsCache_Connect(SSL* ssl, const char* host, const char* port) {
+    char key[sizeof(g_entries[0].key)];
+    snprintf(key, sizeof(key), "%s:%s", host, port);
+
+    // tickets are per server name, without SNI a server behind a shared address can't tell which keys to use.
+    // literal addresses aren't allowed in it
+    unsigned char address[sizeof(struct in6_addr)];
+    if (inet_pton(AF_INET, host, address) != 1 && inet_pton(AF_INET6, host, address) != 1) SSL_set_tlsext_host_name(ssl, host);
+
+    if (g_key_index >= 0) {
+        SSL_set_ex_data(ssl, g_key_index, CopyString(key));
+
+        pthread_mutex_lock(&g_lock);
+        TlsCacheEntry* entry = FindEntry(key, false);
+        if (entry != NULL && entry->session != NULL) SSL_set_session(ssl, entry->session); // takes its own reference
+        pthread_mutex_unlock(&g_lock);
+    }
+
+    uint64_t start = NowUs();
+    int res = SSL_connect(ssl);
+    uint64_t elapsed = NowUs() - start;
+
+    if (res == 1) {
+        bool resumed = SSL_session_reused(ssl);
+        Histogram_Record(resumed ? &g_resumed_handshakes : &g_full_handshakes, elapsed);
+
+        // openssl turns kTLS on right after the handshake if it can, this is where we find out whether it did
+        const char* ktls = "";
+#ifdef SSL_OP_ENABLE_KTLS
+        if (SSL_get_options(ssl) & SSL_OP_ENABLE_KTLS) {
+            static const char* const states[] = {", ktls off", ", ktls send only", ", ktls recv only", ", ktls"};
+            unsigned int offload = TlsCache_GetKernelTls(ssl);
+            if (offload & TLS_KTLS_SEND) atomic_fetch_add(&g_ktls_send, 1);
+            if (offload & TLS_KTLS_RECV) atomic_fetch_add(&g_ktls_recv, 1);
+            ktls = states[offload];
+        }
+#endif
+
+        LOG(LOG_CATEGORY_CORE, LOG_LEVEL_DEBUG, "tls to %s %s in %llu us%s", key, resumed ? "resumed" : "full handshake",
+            (unsigned long long) elapsed, ktls);
+    }
+
+    return res;
+}
+
+unsigned int TlsCache_GetKernelTls(SSL* ssl) {
+    unsigned int offload = 0;
+    if (BIO_get_ktls_send(SSL_get_wbio(ssl))) offload |= TLS_KTLS_SEND;
+    if (BIO_get_ktls_recv(SSL_get_rbio(ssl))) offload |= TLS_KTLS_RECV;
+    return offload;
+}
+
+void TlsCache_GetKernelTlsCounts(uint64_t* send, uint64_t* recv) {
+    *send = atomic_load(&g_ktls_send);
+    *recv = atomic_load(&g_ktls_recv);
+}
+
+const Histogram* TlsCache_FullHandshakes(void) {
+    return &g_full_handshakes;
+}
+
+const Histogram* TlsCache_ResumedHandshakes(void) {
+    return &g_resumed_handshakes;
+}
@@ -4,17 +4,29 @@
 
 #include "utils/webutils.h"
 
+#include "utils/net.h"
+#include "utils/simd.h"
+#include "utils/tlscache.h"
+
+#include <openssl/evp.h>
 #include <openssl/rand.h>
+#include <openssl/sha.h>
 
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <netdb.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <poll.h>
 #include <string.h>
 #include <unistd.h>
 
 #define FALLBACK_KEY "aGFtcHVzIGlzIG1lZ2Egbg=="
+#define WS_RECV_BUFFER_SIZE (64 * 1024) // a few TLS records, every read takes whatever openssl has decrypted up to this
+#define WS_MAX_HANDSHAKE_RESPONSE 8192
+#define WS_ACCEPT_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_DEFLATE_MIN_SIZE 64 // smaller payloads come out about as big as they went in, not worth a deflate call
+#define WS_DEFLATE_TAIL "\x00\x00\xff\xff"
 
 int SSL_read_all(SSL* ssl, char* buf, int max) {
     int total = 0;
@@ -27,31 +39,8 @@ int SSL_read_all(SSL* ssl, char* buf, int max) {
 }
 
 int HTTP_Connect(HTTPClient* client, SSL_CTX* ctx, const char* host, const char* port) {
-    struct addrinfo hints = {0};
-    struct addrinfo* res;
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-
-    int err = getaddrinfo(host, port, &hints, &res);
-    if (err != 0) {
-        freeaddrinfo(res);
-        return err;
-    }
-
-    int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-    if (sock == -1) {
-        freeaddrinfo(res);
-        return -1;
-    }
-
-    err = connect(sock, (__CONST_SOCKADDR_ARG) {res->ai_addr}, res->ai_addrlen);
-    if (err != 0) {
-        freeaddrinfo(res);
-        close(sock);
-        return err;
-    }
-
-    freeaddrinfo(res);
+    int sock = Net_Connect(host, port);
+    if (sock == -1) return -1;
 
     SSL* ssl = SSL_new(ctx);
     if (ssl == NULL) {
@@ -68,7 +57,7 @@ int HTTP_Connect(HTTPClient* client, SSL_CTX* ctx, const char* host, const char*
         return -1;
     }
 
-    if (SSL_connect(ssl) != 1) {
+    if (TlsCache_Connect(ssl, host, port) != 1) {
         ERR_print_errors_fp(stderr);
         SSL_shutdown(ssl);
         SSL_free(ssl);
@@ -76,12 +65,15 @@ int HTTP_Connect(HTTPClient* client, SSL_CTX* ctx, const char* host, const char*
         return -1;
     }
 
+    Net_ClearTimeout(sock); // requests can take their time
+
     client->sock = sock;
     client->ctx = ctx;
     client->ssl = ssl;
-    strncpy(client->host, host, sizeof(client->host) - 1);
-    strncpy(client->port, port, sizeof(client->port) - 1);
+    if (host != client->host) strncpy(client->host, host, sizeof(client->host) - 1); // HTTP_Reconnect passes our own
+    if (port != client->port) strncpy(client->port, port, sizeof(client->port) - 1);
     client->connected = true;
+    client->ktls = TlsCache_GetKernelTls(ssl);
     client->authorization[0] = '\0';
 
     return 0;
@@ -330,6 +322,71 @@ HTTPResponse* HTTP_Request(HTTPClient* client, Arena* arena, const char* method,
     return HTTP_GetResponse(client, arena);
 }
 
+static int HTTP_SendFileBody(HTTPClient* client, int fd, off_t offset, size_t length) {
+#ifdef SSL_OP_ENABLE_KTLS
+    // kTLS encrypts whatever goes into the socket, so the page cache can go straight to it
+    if (client->ktls & TLS_KTLS_SEND) {
+        while (length > 0) {
+            ossl_ssize_t sent = SSL_sendfile(client->ssl, fd, offset, length, 0);
+            if (sent <= 0) return -1;
+            offset += sent;
+            length -= sent;
+        }
+        return 0;
+    }
+#endif
+
+    char buffer[16384];
+    while (length > 0) {
+        ssize_t r = pread(fd, buffer, length < sizeof(buffer) ? length : sizeof(buffer), offset);
+        if (r <= 0) return -1;
+        if (SSL_write(client->ssl, buffer, (int) r) != r) return -1;
+        offset += r;
+        length -= r;
+    }
+    return 0;
+}
+
+HTTPResponse* HTTP_RequestFile(HTTPClient* client, Arena* arena, const char* method, const char* path, const char* content_type,
+                               const HTTPFileBody* body) {
+    char auth[300] = "";
+    if (client->authorization[0] != '\0') {
+        snprintf(auth, sizeof(auth), "Authorization: %s\r\n", client->authorization);
+    }
+
+    // the head goes out in the same write as the headers
+    size_t req_len = strlen(method) + strlen(path) + strlen(client->host) + strlen(auth) + strlen(content_type) + body->head_length + 512;
+    char* req = ArenaAlloc(GetTempArena(), req_len);
+
+    int len = snprintf(req, req_len,
+        "%s %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "User-Agent: gambler/1.0\r\n"
+        "Accept: application/json\r\n"
+        "%s"
+        "Content-Type: %s\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: keep-alive\r\n\r\n",
+        method, path, client->host, auth, content_type, body->head_length + body->length + body->tail_length);
+
+    if (body->head_length > 0) memcpy(req + len, body->head, body->head_length);
+    len += (int) body->head_length;
+
+    if (!client->connected && HTTP_Reconnect(client) != 0) return NULL;
+
+    // the body can be sent again from the same offset, so a dead keep-alive connection gets one more try like HTTP_Request
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (SSL_write(client->ssl, req, len) == len && HTTP_SendFileBody(client, body->fd, body->offset, body->length) == 0 &&
+            (body->tail_length == 0 || SSL_write(client->ssl, body->tail, (int) body->tail_length) == (int) body->tail_length)) {
+            return HTTP_GetResponse(client, arena);
+        }
+
+        if (attempt == 0 && HTTP_Reconnect(client) != 0) return NULL;
+    }
+
+    return NULL;
+}
+
 char* GenerateWebsocketKey(void) {
     unsigned char key[16];
     if (RAND_bytes(key, sizeof(key)) != 1) { // rng error somehow
@@ -355,30 +412,125 @@ char* GenerateWebsocketKey(void) {
     return b64text;
 }
 
-int WS_Connect(WSClient* client, SSL_CTX* ctx, const char* host, const char* port, const char* path) {
-    struct addrinfo hints = {0},* res;
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+// Finds a header in the handshake response and copies its value out. The response has to end right after its last header line
+static bool WS_GetHeader(const char* response, const char* name, char* value, size_t size) {
+    size_t name_length = strlen(name);
+
+    for (const char* line = strstr(response, "\r\n"); line != NULL && line[2] != '\0'; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, name, name_length) != 0 || line[name_length] != ':') continue;
+
+        const char* start = line + name_length + 1;
+        while (*start == ' ' || *start == '\t') start++;
+
+        const char* end = strstr(start, "\r\n");
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
 
-    int err = getaddrinfo(host, port, &hints, &res);
-    if (err != 0) {
-        freeaddrinfo(res);
-        return err;
+        size_t length = end - start;
+        if (length >= size) length = size - 1;
+        memcpy(value, start, length);
+        value[length] = '\0';
+        return true;
     }
 
-    int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-    if (sock == -1) {
-        return -1;
+    return false;
+}
+
+static char* Trim(char* s) {
+    while (*s == ' ' || *s == '\t') s++;
+
+    char* end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    *end = '\0';
+
+    return s;
+}
+
+// Reads what the server agreed to in Sec-WebSocket-Extensions, -1 if it answered with something we didn't offer.
+// We only ever offer permessage-deflate so that's the only thing that can be in there
+static int WS_ParseExtensions(WSClient* client, char* extensions, int* client_window_bits) {
+    char* save;
+    char* param = strtok_r(extensions, ";", &save);
+    if (param == NULL || strcmp(Trim(param), "permessage-deflate") != 0) return -1;
+
+    while ((param = strtok_r(NULL, ";", &save)) != NULL) {
+        char* name = Trim(param);
+        char* value = strchr(name, '=');
+        int bits = 0;
+
+        if (value != NULL) {
+            *value++ = '\0';
+            name = Trim(name);
+            value = Trim(value);
+            if (*value == '"') value++; // quoted-string is allowed for these
+
+            bits = atoi(value);
+            if (bits < 8 || bits > 15) return -1;
+        }
+
+        if (strcmp(name, "server_no_context_takeover") == 0 && value == NULL) {
+            client->server_no_context_takeover = true;
+        } else if (strcmp(name, "client_no_context_takeover") == 0 && value == NULL) {
+            client->client_no_context_takeover = true;
+        } else if (strcmp(name, "server_max_window_bits") == 0 && value != NULL) {
+            // nothing to do, an inflater with the biggest window reads streams made with any smaller one
+        } else if (strcmp(name, "client_max_window_bits") == 0 && value != NULL) {
+            *client_window_bits = bits;
+        } else {
+            return -1;
+        }
     }
 
-    err = connect(sock, (__CONST_SOCKADDR_ARG) {res->ai_addr}, res->ai_addrlen);
-    if (err != 0) {
-        freeaddrinfo(res);
-        close(sock);
-        return err;
+    client->deflate = true;
+    return 0;
+}
+
+// RFC 6455 4.2.2: the status, the upgrade and an accept made from our key. Anything else is some proxy or a server that
+// doesn't speak websocket, better to fail here than on the first frame
+static int WS_CheckHandshake(WSClient* client, const char* response, const char* key, unsigned int flags, int* client_window_bits) {
+    if (strncmp(response, "HTTP/1.1 101", 12) != 0) return -1;
+
+    char value[256];
+    if (!WS_GetHeader(response, "Upgrade", value, sizeof(value)) || strcasecmp(value, "websocket") != 0) return -1;
+    if (!WS_GetHeader(response, "Connection", value, sizeof(value)) || strcasestr(value, "upgrade") == NULL) return -1;
+
+    char accept_source[128];
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    char accept[4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1];
+
+    snprintf(accept_source, sizeof(accept_source), "%s" WS_ACCEPT_GUID, key);
+    SHA1((const unsigned char*) accept_source, strlen(accept_source), digest);
+    EVP_EncodeBlock((unsigned char*) accept, digest, SHA_DIGEST_LENGTH);
+
+    if (!WS_GetHeader(response, "Sec-WebSocket-Accept", value, sizeof(value)) || strcmp(value, accept) != 0) return -1;
+
+    if (WS_GetHeader(response, "Sec-WebSocket-Extensions", value, sizeof(value))) {
+        if (!(flags & WS_PERMESSAGE_DEFLATE)) return -1;
+        if (WS_ParseExtensions(client, value, client_window_bits) != 0) return -1;
+    }
+
+    return 0;
+}
+
+// The inflater takes any window the server uses. Sends only get compressed when the caller asked for it, and never
+// with an 8 bit window since zlib quietly makes those 9 bits, which the server could refuse to read
+static int WS_InitDeflate(WSClient* client, unsigned int flags, int client_window_bits) {
+    if (inflateInit2(&client->inflater, -MAX_WBITS) != Z_OK) return -1;
+
+    if ((flags & WS_DEFLATE_SENDS) && client_window_bits > 8) {
+        if (deflateInit2(&client->deflater, Z_BEST_SPEED, Z_DEFLATED, -client_window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            inflateEnd(&client->inflater);
+            return -1;
+        }
+        client->deflate_sends = true;
     }
 
-    freeaddrinfo(res);
+    return 0;
+}
+
+int WS_Connect(WSClient* client, SSL_CTX* ctx, const char* host, const char* port, const char* path, unsigned int flags) {
+    int sock = Net_Connect(host, port);
+    if (sock == -1) return -1;
 
     SSL* ssl = SSL_new(ctx);
     if (ssl == NULL) {
@@ -395,7 +547,7 @@ int WS_Connect(WSClient* client, SSL_CTX* ctx, const char* host, const char* por
         return -1;
     }
 
-    if (SSL_connect(ssl) != 1) {
+    if (TlsCache_Connect(ssl, host, port) != 1) {
         ERR_print_errors_fp(stderr);
         SSL_shutdown(ssl);
         SSL_free(ssl);
@@ -413,198 +565,555 @@ int WS_Connect(WSClient* client, SSL_CTX* ctx, const char* host, const char* por
              "Sec-WebSocket-Key: %s\r\n"
              "Sec-WebSocket-Version: 13\r\n"
              "Sec-WebSocket-Protocol: json\r\n"
+             "%s"
              "User-Agent: GamblerWebutils\r\n"
-             "\r\n", path, host, key);
-
-    HeapFree(key);
+             "\r\n", path, host, key,
+             (flags & WS_PERMESSAGE_DEFLATE) ? "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n" : "");
 
     int written = SSL_write(ssl, req, strlen(req));
     if (written <= 0 || written != strlen(req)) {
         ERR_print_errors_fp(stderr);
+        HeapFree(key);
         SSL_shutdown(ssl);
         SSL_free(ssl);
         close(sock);
         return -1;
     }
 
-    char resp[1024];
-    int n = SSL_read(ssl, resp, sizeof(resp) - 1);
-    if (n <= 0) {
-        SSL_shutdown(ssl);
-        SSL_free(ssl);
-        close(sock);
-        return -1;
+    // the server can send its first frames right behind the response, they stay in the receive buffer
+    unsigned char* in = HeapAlloc(WS_RECV_BUFFER_SIZE);
+    size_t in_length = 0;
+    char* header_end = NULL;
+
+    while (header_end == NULL) {
+        int n = SSL_read(ssl, in + in_length, WS_MAX_HANDSHAKE_RESPONSE - 1 - (int) in_length);
+        if (n <= 0) break;
+
+        in_length += n;
+        in[in_length] = '\0';
+        header_end = strstr((char*) in, "\r\n\r\n");
+        if (in_length == WS_MAX_HANDSHAKE_RESPONSE - 1) break;
     }
 
-    resp[n] = '\0';
+    client->deflate = false;
+    client->deflate_sends = false;
+    client->server_no_context_takeover = false;
+    client->client_no_context_takeover = false;
+    int client_window_bits = MAX_WBITS;
 
-    if (!strstr(resp, "101 Switching Protocols")) {
+    if (header_end != NULL) header_end[2] = '\0'; // the headers end at their last line for WS_GetHeader
+
+    if (header_end == NULL || WS_CheckHandshake(client, (char*) in, key, flags, &client_window_bits) != 0 ||
+        (client->deflate && WS_InitDeflate(client, flags, client_window_bits) != 0)) {
+        client->deflate = false;
+        HeapFree(key);
+        HeapFree(in);
         SSL_shutdown(ssl);
         SSL_free(ssl);
         close(sock);
         return -1;
     }
 
+    HeapFree(key);
+    Net_ClearTimeout(sock); // the gateway can stay quiet for a whole heartbeat interval
+
     client->sock = sock;
     client->ssl = ssl;
+    client->last_close_code = 0;
+    client->nonblocking = false;
+    client->read_wants_write = false;
+    client->write_wants_read = false;
+    client->in = in;
+    client->in_offset = header_end + 4 - (char*) in;
+    client->in_length = in_length;
+    client->message = NULL;
+    client->max_message_size = WS_DEFAULT_MAX_MESSAGE_SIZE;
+    client->message_compressed = false;
+    client->in_frame = false;
+    client->mask_pool_offset = sizeof(client->mask_pool);
+    client->close_sent = false;
+    client->ktls = TlsCache_GetKernelTls(ssl);
+    client->out = NULL;
+    client->out_length = 0;
+    client->out_offset = 0;
+    client->out_capacity = 0;
+    client->deflated = NULL;
+    client->deflated_capacity = 0;
 
     return 0;
 }
 
-void WS_Disconnect(WSClient client, int _code) {
+static int WS_SendFrame(WSClient* client, unsigned char opcode, const unsigned char* data, size_t len);
+
+// Queues the close frame. Only the first one counts, whatever closes the connection later doesn't send another
+static void WS_Close(WSClient* client, int _code) {
+    if (client->close_sent) return;
+    client->close_sent = true;
+
     if (_code != DONT_SEND_CODE) {
         uint16_t code = htons((uint16_t) _code);
-        unsigned char close_frame[4];
-        close_frame[0] = 0x88;
-        close_frame[1] = 2;
-        memcpy(close_frame + 2, &code, 2);
-        SSL_write(client.ssl, close_frame, sizeof(close_frame));
+        WS_SendFrame(client, 0x8, (const unsigned char*) &code, sizeof(code));
     } else {
-        unsigned char close_frame[2] = {0x88, 0x0};
-        SSL_write(client.ssl, close_frame, sizeof(close_frame));
+        WS_SendFrame(client, 0x8, NULL, 0);
     }
+}
+
+void WS_Disconnect(WSClient client, int _code) {
+    WS_Close(&client, _code);
 
-    unsigned char buffer[512];
-    SSL_read(client.ssl, buffer, sizeof(buffer));
+    // best effort, a socket that can't take the close frame right now is about to be closed anyway
+    if (client.nonblocking) WS_Flush(&client);
+
+    if (!client.nonblocking) {
+        unsigned char buffer[512];
+        SSL_read(client.ssl, buffer, sizeof(buffer));
+    }
 
     SSL_shutdown(client.ssl);
     SSL_free(client.ssl);
     close(client.sock);
+
+    if (client.deflate) inflateEnd(&client.inflater);
+    if (client.deflate_sends) deflateEnd(&client.deflater);
+
+    if (client.out != NULL) HeapFree(client.out);
+    if (client.deflated != NULL) HeapFree(client.deflated);
+    HeapFree(client.in);
+    FrameBuffer_Release(client.message);
 }
 
-int WS_SendText(WSClient* client, const char* text) {
-    SSL* ssl = client->ssl;
-    size_t len = strlen(text);
-    unsigned char header[14];
+void WS_SetMaxMessageSize(WSClient* client, size_t size) {
+    if (size == 0) size = WS_DEFAULT_MAX_MESSAGE_SIZE;
+    client->max_message_size = size < INT_MAX ? size : INT_MAX;
+}
+
+int WS_SetNonBlocking(WSClient* client) {
+    int flags = fcntl(client->sock, F_GETFL, 0);
+    if (flags == -1 || fcntl(client->sock, F_SETFL, flags | O_NONBLOCK) == -1) return -1;
+
+    // the out buffer can move when it grows while openssl is still waiting to retry a write from it
+    SSL_set_mode(client->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    client->nonblocking = true;
+    return 0;
+}
+
+int WS_Flush(WSClient* client) {
+    client->write_wants_read = false;
+
+    while (client->out_offset < client->out_length) {
+        int r = SSL_write(client->ssl, client->out + client->out_offset, (int) (client->out_length - client->out_offset));
+        if (r > 0) {
+            client->out_offset += r;
+            continue;
+        }
+
+        int err = SSL_get_error(client->ssl, r);
+        if (err == SSL_ERROR_WANT_WRITE) return 1;
+        if (err == SSL_ERROR_WANT_READ) {
+            client->write_wants_read = true;
+            return 1;
+        }
+        return -1;
+    }
+
+    client->out_offset = 0;
+    client->out_length = 0;
+    return 0;
+}
+
+bool WS_WantsWrite(const WSClient* client) {
+    return (client->out_offset < client->out_length && !client->write_wants_read) || client->read_wants_write;
+}
+
+// Makes room for length more bytes at the end of the out buffer and returns where they go
+static unsigned char* WS_Reserve(WSClient* client, size_t length) {
+    if (client->out_length + length > client->out_capacity) {
+        size_t capacity = client->out_capacity != 0 ? client->out_capacity : 4096;
+        while (capacity < client->out_length + length) capacity *= 2;
+        client->out = HeapRealloc(client->out, capacity);
+        client->out_capacity = capacity;
+    }
+
+    return client->out + client->out_length;
+}
+
+// Masks come from openssl's rng a pool at a time, clients are supposed to make them unpredictable
+static void WS_NextMask(WSClient* client, unsigned char mask[4]) {
+    if (client->mask_pool_offset + 4 > sizeof(client->mask_pool)) {
+        if (RAND_bytes(client->mask_pool, sizeof(client->mask_pool)) != 1) {
+            for (size_t i = 0; i < sizeof(client->mask_pool); i++)
+                client->mask_pool[i] = rand() & 0xFF;
+        }
+        client->mask_pool_offset = 0;
+    }
+
+    memcpy(mask, client->mask_pool + client->mask_pool_offset, 4);
+    client->mask_pool_offset += 4;
+}
+
+// Frames go into the out buffer with the payload masked in place, nothing is allocated once the buffer has grown to
+// fit. On a nonblocking socket that's all, whatever got queued during a callback goes out in one write with WS_Flush
+static int WS_SendFrame(WSClient* client, unsigned char opcode, const unsigned char* data, size_t len) {
+    unsigned char* frame = WS_Reserve(client, len + 14);
     size_t header_len = 0;
 
-    header[0] = 0x81; // FIN=1, opcode=0x1 (text)
+    frame[0] = 0x80 | opcode; // FIN=1, opcode can carry rsv1 for a compressed message
 
     if (len <= 125) {
-        header[1] = 0x80 | (unsigned char) len; // mask bit set
+        frame[1] = 0x80 | (unsigned char) len; // mask bit set
         header_len = 2;
     } else if (len <= 0xFFFF) {
-        header[1] = 0x80 | 126;
-        header[2] = (len >> 8) & 0xFF;
-        header[3] = len & 0xFF;
+        frame[1] = 0x80 | 126;
+        frame[2] = (len >> 8) & 0xFF;
+        frame[3] = len & 0xFF;
         header_len = 4;
     } else {
-        header[1] = 0x80 | 127;
+        frame[1] = 0x80 | 127;
         for (int i = 0; i < 8; i++)
-            header[2 + i] = (len >> (56 - i * 8)) & 0xFF;
+            frame[2 + i] = (len >> (56 - i * 8)) & 0xFF;
         header_len = 10;
     }
 
-    unsigned char mask[4];
-    for (int i = 0; i < 4; i++)
-        mask[i] = rand() & 0xFF;
-
-    memcpy(header + header_len, mask, 4);
+    unsigned char* mask = frame + header_len;
+    WS_NextMask(client, mask);
     header_len += 4;
 
-    unsigned char* masked = HeapAlloc(len);
-    for (size_t i = 0; i < len; i++)
-        masked[i] = text[i] ^ mask[i % 4];
+    if (len > 0) Simd_MaskCopy(frame + header_len, data, len, mask);
+    client->out_length += header_len + len;
 
-    size_t total_sent = 0;
-    while (total_sent < header_len) {
-        int r = SSL_write(ssl, header + total_sent, (int) (header_len - total_sent));
-        if (r <= 0) {
-            HeapFree(masked);
-            return -1;
-        }
-        total_sent += r;
-    }
+    if (client->nonblocking) return 0;
 
-    total_sent = 0;
-    while (total_sent < len) {
-        int r = SSL_write(ssl, masked + total_sent, (int) (len - total_sent));
+    while (client->out_offset < client->out_length) {
+        int r = SSL_write(client->ssl, client->out + client->out_offset, (int) (client->out_length - client->out_offset));
         if (r <= 0) {
-            HeapFree(masked);
+            client->out_offset = 0;
+            client->out_length = 0;
             return -1;
         }
-        total_sent += r;
+        client->out_offset += r;
     }
 
-    HeapFree(masked);
+    client->out_offset = 0;
+    client->out_length = 0;
     return 0;
 }
 
-int WS_RecvText(WSClient* client, char** out_payload, Arena* arena) {
-    SSL* ssl = client->ssl;
-    unsigned char hdr[14];
+// Text and binary go through here. With permessage-deflate on the payload is compressed into one frame with rsv1 set,
+// flushed to a byte boundary and with the empty block that flush ends in left off, RFC 7692 7.2.1
+static int WS_SendMessage(WSClient* client, unsigned char opcode, const unsigned char* data, size_t len) {
+    if (!client->deflate_sends || len < WS_DEFLATE_MIN_SIZE) return WS_SendFrame(client, opcode, data, len);
 
-    int n = SSL_read(ssl, hdr, 2);
-    if (n != 2) return -1;
+    z_stream* z = &client->deflater;
+    size_t bound = deflateBound(z, len) + 16; // the sync flush adds a few bytes the bound doesn't count
+    if (bound > client->deflated_capacity) {
+        client->deflated = HeapRealloc(client->deflated, bound);
+        client->deflated_capacity = bound;
+    }
 
-    unsigned char fin = hdr[0] & 0x80;
-    unsigned char opcode = hdr[0] & 0x0F;
-    int masked = (hdr[1] & 0x80) != 0;
-    uint64_t payload_len = hdr[1] & 0x7F;
+    z->next_in = (Bytef*) data;
+    z->avail_in = (uInt) len;
+    z->next_out = client->deflated;
+    z->avail_out = (uInt) client->deflated_capacity;
+
+    if (deflate(z, Z_SYNC_FLUSH) != Z_OK || z->avail_in != 0 || z->avail_out == 0) return -1;
+
+    size_t deflated_length = client->deflated_capacity - z->avail_out;
+    if (deflated_length >= 4 && memcmp(client->deflated + deflated_length - 4, WS_DEFLATE_TAIL, 4) == 0) deflated_length -= 4;
+
+    if (client->client_no_context_takeover) deflateReset(z);
+
+    return WS_SendFrame(client, 0x40 | opcode, client->deflated, deflated_length);
+}
+
+int WS_SendText(WSClient* client, const char* text, size_t length) {
+    if (!Simd_ValidateUtf8(text, length)) return -1; // the server would close on it, better to find out here
+    return WS_SendMessage(client, 0x1, (const unsigned char*) text, length);
+}
+
+int WS_SendBinary(WSClient* client, const void* data, size_t length) {
+    return WS_SendMessage(client, 0x2, data, length);
+}
+
+// Returns how much was read, 0 if the socket would block and -1 on close or error
+static int WS_ReadSome(WSClient* client, void* buf, size_t length) {
+    int r = SSL_read(client->ssl, buf, length > INT_MAX ? INT_MAX : (int) length);
+    if (r > 0) {
+        client->read_wants_write = false;
+        return r;
+    }
+
+    int err = SSL_get_error(client->ssl, r);
+    if (err == SSL_ERROR_WANT_READ) return 0;
+    if (err == SSL_ERROR_WANT_WRITE) {
+        client->read_wants_write = true;
+        return 0;
+    }
+
+    return -1;
+}
+
+// Reads as much as fits after what's buffered. Same returns as WS_ReadSome
+static int WS_FillBuffer(WSClient* client) {
+    // this only runs once the buffer has nothing usable left, at most a partial header
+    if (client->in_offset > 0) {
+        memmove(client->in, client->in + client->in_offset, client->in_length - client->in_offset);
+        client->in_length -= client->in_offset;
+        client->in_offset = 0;
+    }
+
+    int r = WS_ReadSome(client, client->in + client->in_length, WS_RECV_BUFFER_SIZE - client->in_length);
+    if (r > 0) client->in_length += r;
+    return r;
+}
 
+// Parses the next frame header out of the buffer. 1 if there was a whole one, 0 if more bytes are needed, -1 if the
+// frame breaks the protocol
+static int WS_ParseHeader(WSClient* client) {
+    const unsigned char* hdr = client->in + client->in_offset;
+    size_t available = client->in_length - client->in_offset;
+    if (available < 2) return 0;
+
+    size_t needed = 2;
+    if ((hdr[1] & 0x7F) == 126) needed += 2;
+    else if ((hdr[1] & 0x7F) == 127) needed += 8;
+    if (hdr[1] & 0x80) needed += 4;
+    if (available < needed) return 0;
+
+    uint64_t payload_len = hdr[1] & 0x7F;
     if (payload_len == 126) {
-        if (SSL_read(ssl, hdr + 2, 2) != 2) return -1;
         payload_len = ((uint64_t) hdr[2] << 8) | hdr[3];
     } else if (payload_len == 127) {
-        if (SSL_read(ssl, hdr + 2, 8) != 8) return -1;
         payload_len = 0;
         for (int i = 0; i < 8; i++)
             payload_len = (payload_len << 8) | hdr[2 + i];
     }
 
-    unsigned char mask[4] = {0};
-    if (masked) {
-        if (SSL_read(ssl, mask, 4) != 4) return -1;
+    unsigned char opcode = hdr[0] & 0x0F;
+    bool fin = (hdr[0] & 0x80) != 0;
+
+    // rsv1 is permessage-deflate's and only goes on the first frame of a message, nothing uses rsv2 and rsv3
+    bool compressed = (hdr[0] & 0x40) != 0;
+    if (hdr[0] & 0x30) return -1;
+    if (compressed && (!client->deflate || (opcode != 0x1 && opcode != 0x2))) return -1;
+
+    if (opcode & 0x8) {
+        if (opcode > 0xA || !fin || payload_len > sizeof(client->control)) return -1;
+        client->payload_start = 0;
+        client->control_length = 0;
+    } else if (opcode == 0x0) {
+        // continuation, the message grows by at least half each time so a long run of fragments isn't quadratic
+        if (client->message == NULL) return -1;
+
+        FrameBuffer* message = client->message;
+        if (payload_len > client->max_message_size - message->length) {
+            WS_Close(client, MESSAGE_TOO_BIG);
+            client->last_close_code = MESSAGE_TOO_BIG;
+            return -1;
+        }
+
+        size_t capacity = message->length + (size_t) payload_len + 1;
+        if (capacity > message->capacity && capacity < message->capacity + message->capacity / 2) {
+            capacity = message->capacity + message->capacity / 2;
+        }
+
+        client->message = FrameBuffer_Grow(message, capacity);
+        client->payload_start = client->message->length;
+    } else if (opcode == 0x1 || opcode == 0x2) {
+        if (client->message != NULL) return -1;
+        if (payload_len > client->max_message_size) {
+            WS_Close(client, MESSAGE_TOO_BIG);
+            client->last_close_code = MESSAGE_TOO_BIG;
+            return -1;
+        }
+
+        client->message = FrameBuffer_Acquire((size_t) payload_len + 1);
+        client->message_opcode = opcode;
+        client->message_compressed = compressed;
+        client->payload_start = 0;
+    } else {
+        return -1;
     }
 
-    if (opcode == 0x8) {
-        client->last_close_code = 1000;
-        if (payload_len >= 2) {
-            unsigned char* tmp = HeapAlloc((size_t) payload_len);
+    client->opcode = opcode;
+    client->fin = fin;
+    client->masked = (hdr[1] & 0x80) != 0;
+    if (client->masked) memcpy(client->mask, hdr + needed - 4, 4);
+
+    client->payload_remaining = payload_len;
+    client->in_frame = true;
+    client->in_offset += needed;
+    return 1;
+}
 
-            size_t read_total = 0;
-            while (read_total < payload_len) {
-                int r = SSL_read(ssl, tmp + read_total, payload_len - read_total);
-                if (r <= 0) {
-                    HeapFree(tmp);
-                    return -1;
+// Inflates a whole compressed message into a new buffer, with the tail the sender left off put back. Returns 0, or
+// the close code if it doesn't inflate or comes out bigger than max_message_size. The buffer never grows much past that
+static int WS_InflateMessage(WSClient* client, const FrameBuffer* compressed, FrameBuffer** inflated) {
+    z_stream* z = &client->inflater;
+    size_t limit = client->max_message_size + 2; // room for one byte too many and the terminator
+    size_t initial = compressed->length * 4 + 256;
+    FrameBuffer* out = FrameBuffer_Acquire(initial < limit ? initial : limit);
+    int err = Z_OK;
+
+    for (int part = 0; part < 2 && err != Z_STREAM_END; part++) {
+        z->next_in = (Bytef*) (part == 0 ? (const unsigned char*) compressed->data : (const unsigned char*) WS_DEFLATE_TAIL);
+        z->avail_in = (uInt) (part == 0 ? compressed->length : 4);
+
+        do {
+            if (out->capacity - out->length < 2) {
+                if (out->length > client->max_message_size) {
+                    FrameBuffer_Release(out);
+                    inflateReset(z);
+                    return MESSAGE_TOO_BIG;
                 }
-                read_total += r;
+                out = FrameBuffer_Grow(out, out->capacity * 2 < limit ? out->capacity * 2 : limit);
             }
-            client->last_close_code = (tmp[0] << 8) | tmp[1];
-            HeapFree(tmp);
-        } else if (payload_len > 0) {
-            unsigned char dummy[1024];
-            size_t remaining = payload_len;
-            while (remaining > 0) {
-                int to_read = remaining > sizeof(dummy) ? sizeof(dummy) : (int) remaining;
-                int r = SSL_read(ssl, dummy, to_read);
-                if (r <= 0) break;
-                remaining -= r;
+
+            z->next_out = (Bytef*) (out->data + out->length);
+            z->avail_out = (uInt) (out->capacity - out->length - 1);
+            uInt space = z->avail_out;
+
+            err = inflate(z, Z_SYNC_FLUSH);
+            out->length += space - z->avail_out;
+
+            if (err == Z_BUF_ERROR && z->avail_in > 0 && z->avail_out > 0) err = Z_DATA_ERROR;
+            if (err != Z_OK && err != Z_BUF_ERROR && err != Z_STREAM_END) {
+                FrameBuffer_Release(out);
+                return INVALID_FRAME_PAYLOAD_DATA;
             }
+        } while (err != Z_STREAM_END && (z->avail_in > 0 || z->avail_out == 0));
+    }
+
+    if (out->length > client->max_message_size) {
+        FrameBuffer_Release(out);
+        inflateReset(z);
+        return MESSAGE_TOO_BIG;
+    }
+
+    // a message that ended the deflate stream (final block bit) leaves nothing to take over either
+    if (client->server_no_context_takeover || err == Z_STREAM_END) inflateReset(z);
+
+    *inflated = out;
+    return 0;
+}
+
+// Reads the rest of the current frame's payload. Same returns as WS_ReadSome, 1 once it's all there
+static int WS_ReadPayload(WSClient* client) {
+    bool control = (client->opcode & 0x8) != 0;
+    unsigned char* data = control ? client->control : (unsigned char*) client->message->data;
+    size_t* length = control ? &client->control_length : &client->message->length;
+
+    while (client->payload_remaining > 0) {
+        size_t missing = client->payload_remaining;
+        size_t buffered = client->in_length - client->in_offset;
+
+        if (buffered > 0) {
+            size_t take = buffered < missing ? buffered : missing;
+            memcpy(data + *length, client->in + client->in_offset, take);
+            *length += take;
+            client->in_offset += take;
+            client->payload_remaining -= take;
+            continue;
         }
-        return -1;
+
+        // the rest of a big payload goes straight into the message, the buffer would only add a copy
+        if (missing >= WS_RECV_BUFFER_SIZE) {
+            int r = WS_ReadSome(client, data + *length, missing);
+            if (r <= 0) return r;
+            *length += r;
+            client->payload_remaining -= r;
+        } else {
+            int r = WS_FillBuffer(client);
+            if (r <= 0) return r;
+        }
+    }
+
+    if (client->masked) {
+        unsigned char* payload = data + client->payload_start;
+        Simd_MaskCopy(payload, payload, *length - client->payload_start, client->mask);
     }
 
-    if (opcode != 0x1 && opcode != 0x0) return -1;
+    client->in_frame = false;
+    return 1;
+}
 
-    unsigned char* payload = ArenaAlloc(arena, (size_t) payload_len + 1);
+int WS_TryRecv(WSClient* client, FrameBuffer** out) {
+    while (true) {
+        while (!client->in_frame) {
+            int res = WS_ParseHeader(client);
+            if (res < 0) return -1;
+            if (res > 0) break;
 
-    size_t read_total = 0;
-    while (read_total < payload_len) {
-        int r = SSL_read(ssl, payload + read_total, (int) (payload_len - read_total));
-        if (r <= 0) {
+            int r = WS_FillBuffer(client);
+            if (r <= 0) return r;
+        }
+
+        int r = WS_ReadPayload(client);
+        if (r <= 0) return r;
+
+        switch (client->opcode) {
+            case 0x8: {
+                const unsigned char* payload = client->control;
+                client->last_close_code = client->control_length >= 2 ? (payload[0] << 8) | payload[1] : 1000;
+                return -1;
+            }
+
+            case 0x9:
+                // the pong goes out with the same payload, queued behind anything else on a nonblocking socket
+                if (WS_SendFrame(client, 0xA, client->control, client->control_length) < 0) return -1;
+                continue;
+
+            case 0xA:
+                continue;
+
+            default:
+                break;
+        }
+
+        if (!client->fin) continue;
+
+        FrameBuffer* message = client->message;
+        client->message = NULL;
+
+        int error = 0;
+        if (client->message_compressed) {
+            FrameBuffer* inflated = NULL;
+            error = WS_InflateMessage(client, message, &inflated);
+            FrameBuffer_Release(message);
+            message = inflated;
+        }
+
+        if (error == 0 && client->message_opcode == 0x1 && !Simd_ValidateUtf8(message->data, message->length)) {
+            error = INVALID_FRAME_PAYLOAD_DATA;
+        }
+
+        if (error != 0) {
+            FrameBuffer_Release(message);
+            WS_Close(client, error);
+            client->last_close_code = error;
             return -1;
         }
-        read_total += r;
-    }
 
-    if (masked) {
-        for (uint64_t i = 0; i < payload_len; i++)
-            payload[i] ^= mask[i % 4];
+        message->data[message->length] = '\0';
+        *out = message;
+        return 1;
     }
+}
+
+int WS_RecvText(WSClient* client, char** out_payload, Arena* arena) {
+    FrameBuffer* frame;
+    int res;
+
+    // on a blocking socket this only loops if openssl wants another round for something like a key update
+    while ((res = WS_TryRecv(client, &frame)) == 0);
+
+    if (res < 0) return -1;
+
+    char* payload = ArenaAlloc(arena, frame->length + 1);
+    memcpy(payload, frame->data, frame->length + 1);
+    int length = (int) frame->length;
+
+    FrameBuffer_Release(frame);
 
-    payload[payload_len] = '\0';
-    *out_payload = (char*) payload;
-    return (int) payload_len;
+    *out_payload = payload;
+    return length;
 }
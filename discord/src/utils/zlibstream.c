@@ -0,0 +1,109 @@
+// Copyright 2025 JesusTouchMe
+
+#include "utils/zlibstream.h"
+
+#include "internal/memory.h"
+
+#include <string.h>
+
+#define ZLIB_SUFFIX "\x00\x00\xff\xff"
+#define ZLIB_OUT_MIN_SIZE 4096
+#define ZLIB_EXPECTED_RATIO 8 // gateway json inflates to about this many times its size
+
+static bool HasSuffix(const unsigned char* data, size_t length) {
+    return length >= 4 && memcmp(data + length - 4, ZLIB_SUFFIX, 4) == 0;
+}
+
+int ZlibStream_Init(ZlibStream* z) {
+    memset(z, 0, sizeof(ZlibStream));
+
+    if (inflateInit(&z->stream) != Z_OK) return -1;
+    z->initialized = true;
+
+    return 0;
+}
+
+void ZlibStream_Destroy(ZlibStream* z) {
+    if (z->initialized) inflateEnd(&z->stream);
+    z->initialized = false;
+
+    HeapFree(z->in);
+    FrameBuffer_Release(z->out);
+    z->in = NULL;
+    z->out = NULL;
+}
+
+void ZlibStream_Reset(ZlibStream* z) {
+    if (z->initialized) inflateReset(&z->stream);
+    z->in_length = 0;
+}
+
+int ZlibStream_Feed(ZlibStream* z, const void* data, size_t length, char** out, size_t* out_length) {
+    z->bytes_in += length;
+
+    const unsigned char* src = data;
+    size_t src_length = length;
+
+    // the common case is one frame per message, inflate that straight from the frame without buffering it
+    if (z->in_length > 0 || !HasSuffix(data, length)) {
+        if (z->in_length + length > z->in_capacity) {
+            z->in_capacity = (z->in_length + length) * 2;
+            z->in = HeapRealloc(z->in, z->in_capacity);
+        }
+
+        memcpy(z->in + z->in_length, data, length);
+        z->in_length += length;
+
+        if (!HasSuffix(z->in, z->in_length)) return 0;
+
+        src = z->in;
+        src_length = z->in_length;
+    }
+
+    z->stream.next_in = (Bytef*) src;
+    z->stream.avail_in = (uInt) src_length;
+
+    // taken buffers live on in events, so size new ones from this message instead of the biggest one ever seen
+    if (z->out == NULL) {
+        size_t guess = src_length * ZLIB_EXPECTED_RATIO;
+        z->out = FrameBuffer_Acquire(guess > ZLIB_OUT_MIN_SIZE ? guess : ZLIB_OUT_MIN_SIZE);
+    }
+
+    size_t total = 0;
+    while (true) {
+        if (z->out->capacity - total < 2) {
+            z->out->length = total;
+            z->out = FrameBuffer_Grow(z->out, z->out->capacity * 2);
+        }
+
+        z->stream.next_out = (Bytef*) (z->out->data + total);
+        z->stream.avail_out = (uInt) (z->out->capacity - total - 1);
+
+        int err = inflate(&z->stream, Z_SYNC_FLUSH);
+        total = z->out->capacity - 1 - z->stream.avail_out;
+
+        if (err != Z_OK && err != Z_BUF_ERROR) {
+            z->in_length = 0;
+            return -1;
+        }
+
+        // done once zlib ate everything and didn't fill the buffer, otherwise there can be more output pending
+        if (z->stream.avail_in == 0 && z->stream.avail_out > 0) break;
+        if (err == Z_BUF_ERROR && z->stream.avail_out > 0) break;
+    }
+
+    z->in_length = 0;
+    z->out->data[total] = '\0';
+    z->out->length = total;
+    z->bytes_out += total;
+
+    *out = z->out->data;
+    *out_length = total;
+    return 1;
+}
+
+FrameBuffer* ZlibStream_TakeOutput(ZlibStream* z) {
+    FrameBuffer* out = z->out;
+    z->out = NULL;
+    return out;
+}
@@ -23,6 +23,32 @@ int main(int argc, char** argv) {
 
     Discord_LibInit();
 
+    GetLogLevelFn get_log_level = dlsym(dl, "GetLogLevel");
+    if (get_log_level != NULL) {
+        for (int i = 0; i < LOG_CATEGORY_COUNT; i++) Log_SetLevel(i, get_log_level(i));
+    }
+
+    GetRestHostFn get_rest_host = dlsym(dl, "GetRestHost");
+    if (get_rest_host != NULL) {
+        GetRestPortFn get_rest_port = dlsym(dl, "GetRestPort");
+        Discord_SetRestHost(get_rest_host(), CALL_OR_DEFAULT(get_rest_port, NULL));
+    }
+
+    GetGatewayHostFn get_gateway_host = dlsym(dl, "GetGatewayHost");
+    if (get_gateway_host != NULL) {
+        GetGatewayPortFn get_gateway_port = dlsym(dl, "GetGatewayPort");
+        Discord_SetGatewayHost(get_gateway_host(), CALL_OR_DEFAULT(get_gateway_port, NULL));
+    }
+
+    GetKernelTlsFn get_kernel_tls = dlsym(dl, "GetKernelTls");
+    Discord_SetKernelTls(CALL_OR_DEFAULT(get_kernel_tls, false));
+
+    GetConnectTimeoutFn get_connect_timeout = dlsym(dl, "GetConnectTimeout");
+    Discord_SetConnectTimeout(CALL_OR_DEFAULT(get_connect_timeout, 0));
+
+    GetShardCountFn get_shard_count = dlsym(dl, "GetShardCount");
+    Discord_SetShardCount(CALL_OR_DEFAULT(get_shard_count, 0));
+
     GetTokenFn get_token = dlsym(dl, "GetToken");
     if (get_token != NULL) {
         Discord_SetToken(get_token());
@@ -40,6 +66,27 @@ int main(int argc, char** argv) {
     GetIntentsFn get_intents = dlsym(dl, "GetIntents");
     Discord_SetIntents(CALL_OR_DEFAULT(get_intents, 0));
 
+    GetEventThreadCountFn get_event_thread_count = dlsym(dl, "GetEventThreadCount");
+    Discord_SetEventThreadCount(CALL_OR_DEFAULT(get_event_thread_count, 0));
+
+    GetEventDispatchModeFn get_event_dispatch_mode = dlsym(dl, "GetEventDispatchMode");
+    Discord_SetEventDispatchMode(CALL_OR_DEFAULT(get_event_dispatch_mode, EVENT_DISPATCH_ANY));
+
+    GetGatewayThreadCountFn get_gateway_thread_count = dlsym(dl, "GetGatewayThreadCount");
+    Discord_SetGatewayThreadCount(CALL_OR_DEFAULT(get_gateway_thread_count, 1));
+
+    GetGatewayCompressionFn get_gateway_compression = dlsym(dl, "GetGatewayCompression");
+    Discord_SetGatewayCompression(CALL_OR_DEFAULT(get_gateway_compression, false));
+
+    GetGatewayEncodingFn get_gateway_encoding = dlsym(dl, "GetGatewayEncoding");
+    Discord_SetGatewayEncoding(CALL_OR_DEFAULT(get_gateway_encoding, GATEWAY_ENCODING_JSON));
+
+    GetSessionFileFn get_session_file = dlsym(dl, "GetSessionFile");
+    Discord_SetSessionFile(CALL_OR_DEFAULT(get_session_file, NULL));
+
+    GetRecordFileFn get_record_file = dlsym(dl, "GetRecordFile");
+    Discord_SetRecordFile(CALL_OR_DEFAULT(get_record_file, NULL));
+
     Discord_SetOnReady(dlsym(dl, "OnReady"));
     Discord_SetOnMessageCreate(dlsym(dl, "OnMessageCreate"));
 